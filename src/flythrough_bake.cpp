@@ -0,0 +1,422 @@
+// flythrough_bake: headless batch tool on top of the flythrough engine.
+//
+// Reads a DEM (ESRI ASCII grid) and any number of routes (CSV of x,y in the
+// DEM's projected CRS, metres), and writes one baked camera track per route:
+// the camera pose and orbit look-at parameters at every frame. Routes are
+// processed in parallel, one per hardware thread; the DEM and its pyramid
+// are loaded once and shared read-only.
+//
+//   flythrough_bake --dem terrain.asc --out tracks/ route1.csv route2.csv ...
+
+#include "flythrough_dem.h"
+#include "flythrough_path.h"
+#include "flythrough_spline.h"
+#include "flythrough_trajectory.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Options {
+  std::string demPath;
+  std::string outDir = ".";
+  std::vector<std::string> routes;
+  TrajectoryParams trajectory;
+  double lookahead = 1000.0; // metres
+  double smoothing = 0.0;    // Gaussian sigma, metres
+  double simplify = 0.0;     // metres
+  double sampling = 2.0;     // Adaptive resampling tolerance, metres
+  int fps = 30;
+  unsigned threads = 0; // 0 = one per hardware thread
+};
+
+void printUsage() {
+  std::fprintf(
+      stderr,
+      "usage: flythrough_bake --dem FILE.asc [options] ROUTE.csv...\n"
+      "\n"
+      "  --out DIR          output directory (default .)\n"
+      "  --mode MODE        safe | fixed | terrain | follow (default safe)\n"
+      "  --height M         camera height, or altitude for fixed (200)\n"
+      "  --window M         follow: terrain window behind and ahead (500)\n"
+      "  --max-grade X      follow: max climb/descent grade, 0 = off (0.25)\n"
+      "  --pitch DEG        camera pitch (65)\n"
+      "  --exaggeration X   vertical exaggeration (1)\n"
+      "  --speed M/S        ground speed (50)\n"
+      "  --fps N            frames per second (30)\n"
+      "  --lookahead M      look-ahead distance (1000)\n"
+      "  --smooth M         path smoothing sigma, 0 = off (0)\n"
+      "  --simplify M       path simplification tolerance, 0 = off (0)\n"
+      "  --sampling M       adaptive terrain sampling tolerance, 0 = off (2)\n"
+      "  --no-banking       keep the horizon level in turns\n"
+      "  --threads N        worker threads (hardware concurrency)\n"
+      "\n"
+      "Routes are text files with one x,y vertex per line in the DEM's\n"
+      "projected CRS; other lines are skipped. One ROUTE_track.csv is written\n"
+      "per route.\n");
+}
+
+bool parseNumber(const char *text, double &value) {
+  char *end = nullptr;
+  value = std::strtod(text, &end);
+  return end != text && *end == '\0' && std::isfinite(value);
+}
+
+bool parseOptions(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg.compare(0, 2, "--") != 0) {
+      options.routes.push_back(arg);
+      continue;
+    }
+    if (arg == "--no-banking") {
+      options.trajectory.enableBanking = false;
+      continue;
+    }
+    if (arg == "--help") {
+      return false;
+    }
+    if (i + 1 >= argc) {
+      std::fprintf(stderr, "%s needs a value\n", arg.c_str());
+      return false;
+    }
+    const char *value = argv[++i];
+    if (arg == "--dem") {
+      options.demPath = value;
+    } else if (arg == "--out") {
+      options.outDir = value;
+    } else if (arg == "--mode") {
+      const std::string mode = value;
+      if (mode == "safe")
+        options.trajectory.altitudeMode = AltitudeMode::SafePath;
+      else if (mode == "fixed")
+        options.trajectory.altitudeMode = AltitudeMode::FixedAmsl;
+      else if (mode == "terrain")
+        options.trajectory.altitudeMode = AltitudeMode::AboveTerrain;
+      else if (mode == "follow")
+        options.trajectory.altitudeMode = AltitudeMode::TerrainFollow;
+      else {
+        std::fprintf(stderr, "Unknown mode '%s'\n", value);
+        return false;
+      }
+    } else {
+      double number = 0.0;
+      if (!parseNumber(value, number)) {
+        std::fprintf(stderr, "%s: '%s' is not a number\n", arg.c_str(), value);
+        return false;
+      }
+      if (arg == "--height")
+        options.trajectory.cameraHeight = number;
+      else if (arg == "--window" && number >= 0.0)
+        options.trajectory.followWindow = number;
+      else if (arg == "--max-grade" && number >= 0.0)
+        options.trajectory.maxClimbGrade = options.trajectory.maxDescentGrade =
+            number;
+      else if (arg == "--pitch")
+        options.trajectory.cameraPitch = number;
+      else if (arg == "--exaggeration")
+        options.trajectory.verticalExaggeration = number;
+      else if (arg == "--speed" && number > 0.0)
+        options.trajectory.speed = number;
+      else if (arg == "--fps" && number >= 1.0)
+        options.fps = static_cast<int>(number);
+      else if (arg == "--lookahead")
+        options.lookahead = number;
+      else if (arg == "--smooth")
+        options.smoothing = number;
+      else if (arg == "--simplify")
+        options.simplify = number;
+      else if (arg == "--sampling" && number >= 0.0)
+        options.sampling = number;
+      else if (arg == "--threads" && number >= 1.0)
+        options.threads = static_cast<unsigned>(number);
+      else {
+        std::fprintf(stderr, "Bad option %s %s\n", arg.c_str(), value);
+        return false;
+      }
+    }
+  }
+  return !options.demPath.empty() && !options.routes.empty();
+}
+
+// ESRI ASCII grid: a "key value" header (ncols, nrows, xllcorner or
+// xllcenter, yllcorner or yllcenter, cellsize, optional NODATA_value)
+// followed by rows from north to south
+bool loadAsciiGrid(const std::string &path, DemGrid &grid, std::string &error) {
+  std::ifstream in(path);
+  if (!in) {
+    error = "cannot open " + path;
+    return false;
+  }
+
+  int cols = 0, rows = 0;
+  double xll = 0.0, yll = 0.0, cell = 0.0;
+  double noData = -9999.0;
+  bool centre = false;
+  std::string key;
+  while (in >> key) {
+    std::transform(key.begin(), key.end(), key.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    if (key == "ncols") {
+      in >> cols;
+    } else if (key == "nrows") {
+      in >> rows;
+    } else if (key == "xllcorner" || key == "xllcenter") {
+      in >> xll;
+      centre = key == "xllcenter";
+    } else if (key == "yllcorner" || key == "yllcenter") {
+      in >> yll;
+    } else if (key == "cellsize") {
+      in >> cell;
+    } else if (key == "nodata_value") {
+      in >> noData;
+    } else {
+      // First data value: put it back for the cell loop
+      for (size_t i = key.size(); i > 0; --i)
+        in.putback(key[i - 1]);
+      break;
+    }
+  }
+  if (cols < 2 || rows < 2 || !(cell > 0.0)) {
+    error = path + ": invalid ESRI ASCII grid header";
+    return false;
+  }
+  if (centre) {
+    xll -= 0.5 * cell;
+    yll -= 0.5 * cell;
+  }
+
+  grid.reset(xll, yll + rows * cell, cell, cell, cols, rows);
+  float *out = grid.data();
+  const size_t cells = static_cast<size_t>(cols) * rows;
+  for (size_t i = 0; i < cells; ++i) {
+    double v = 0.0;
+    if (!(in >> v)) {
+      error = path + ": grid has fewer cells than its header says";
+      return false;
+    }
+    out[i] = v == noData ? std::numeric_limits<float>::quiet_NaN()
+                         : static_cast<float>(v);
+  }
+  return true;
+}
+
+bool loadRoute(const std::string &path, std::vector<double> &xs,
+               std::vector<double> &ys) {
+  std::ifstream in(path);
+  if (!in)
+    return false;
+  std::string line;
+  while (std::getline(in, line)) {
+    std::replace(line.begin(), line.end(), ',', ' ');
+    std::replace(line.begin(), line.end(), ';', ' ');
+    std::istringstream fields(line);
+    double x, y;
+    if (fields >> x >> y) {
+      xs.push_back(x);
+      ys.push_back(y);
+    }
+  }
+  return true;
+}
+
+std::string trackPath(const Options &options, const std::string &route) {
+  std::string name = route.substr(route.find_last_of("/\\") + 1);
+  const size_t dot = name.find_last_of('.');
+  if (dot != std::string::npos && dot > 0)
+    name.erase(dot);
+  return options.outDir + "/" + name + "_track.csv";
+}
+
+// Shapes one route the way the plugin does, generates its keyframes and
+// writes the per-frame track
+bool bakeRoute(const Options &options, const DemGrid &grid,
+               const DemPyramid &pyramid, const std::string &route,
+               std::string &message) {
+  std::vector<double> xs, ys, scratch;
+  if (!loadRoute(route, xs, ys)) {
+    message = "cannot read route";
+    return false;
+  }
+  if (xs.size() < 2) {
+    message = "route needs at least 2 vertices";
+    return false;
+  }
+
+  simplifyPath(xs, ys, options.simplify);
+  smoothPath(xs, ys, options.smoothing, scratch);
+
+  // Vertices where terrain and turns need them; without that, terrain
+  // following still needs the terrain between vertices: one per DEM cell
+  const double cell = std::min(grid.cellSizeX(), grid.cellSizeY());
+  std::vector<double> denseXs, denseYs;
+  if (options.sampling > 0.0) {
+    AdaptiveSampling sampling;
+    sampling.verticalTolerance = options.sampling;
+    sampling.lateralTolerance = options.sampling;
+    sampling.minSpacing = cell;
+    sampling.maxSpacing = std::max(cell, 250.0);
+    densifyPathAdaptive(
+        xs, ys,
+        [&grid](double x, double y) {
+          return grid.sample(x, y, std::numeric_limits<double>::quiet_NaN());
+        },
+        sampling, denseXs, denseYs);
+    xs.swap(denseXs);
+    ys.swap(denseYs);
+  } else if (options.trajectory.altitudeMode == AltitudeMode::TerrainFollow) {
+    densifyPath(xs, ys, cell, denseXs, denseYs);
+    xs.swap(denseXs);
+    ys.swap(denseYs);
+  }
+
+  const size_t count = xs.size();
+  std::vector<double> elevations(count), distances(count, 0.0);
+  grid.sampleElevations(xs.data(), ys.data(), elevations.data(), count);
+  for (size_t i = 1; i < count; ++i)
+    distances[i] = distances[i - 1] +
+                   std::hypot(xs[i] - xs[i - 1], ys[i] - ys[i - 1]);
+
+  const double radius = std::hypot(grid.cellSizeX(), grid.cellSizeY());
+  const double peak = pyramid.pathMax(xs.data(), ys.data(), count, radius);
+
+  const std::vector<Keyframe> keyframes =
+      generateKeyframes(xs.data(), ys.data(), distances.data(),
+                        elevations.data(), count, peak, options.trajectory);
+  CameraSpline spline;
+  spline.build(keyframes);
+  if (!spline.isValid()) {
+    message = "route has no length";
+    return false;
+  }
+
+  const std::string path = trackPath(options, route);
+  std::FILE *out = std::fopen(path.c_str(), "w");
+  if (!out) {
+    message = "cannot write " + path;
+    return false;
+  }
+
+  // The DEM holds unexaggerated heights; the track is in scene units
+  const double scale = options.trajectory.verticalExaggeration;
+  const TerrainBatchSampler terrain = [&grid, scale](const double *lookXs,
+                                                     const double *lookYs,
+                                                     double *lookZs,
+                                                     size_t lookCount) {
+    grid.sampleElevations(lookXs, lookYs, lookZs, lookCount,
+                          std::numeric_limits<double>::quiet_NaN());
+    for (size_t i = 0; i < lookCount; ++i)
+      lookZs[i] *= scale;
+  };
+  // The views the plugin plays back, baked the same way
+  BakedPoses views;
+  bakePoses(spline, options.fps, options.trajectory.cameraHeight,
+            options.lookahead, terrain, views);
+
+  std::fprintf(out, "frame,time,distance,x,y,z,ground_z,yaw,pitch,roll,"
+                    "look_x,look_y,look_z,orbit_distance,orbit_pitch,"
+                    "orbit_yaw\n");
+  const long frames = static_cast<long>(views.size());
+  for (long i = 0; i < frames; ++i) {
+    const double time =
+        std::min(spline.duration(), static_cast<double>(i) / options.fps);
+    const double s = spline.distanceAt(time);
+    const CameraSpline::Pose pose = spline.poseAtDistance(s);
+    const OrbitView view = views.frame(static_cast<size_t>(i));
+
+    std::fprintf(out,
+                 "%ld,%.4f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,"
+                 "%.3f,%.3f,%.3f,%.3f\n",
+                 i, time, s, pose.x, pose.y, view.cameraZ, pose.groundZ,
+                 pose.yaw, pose.pitch, pose.roll, view.lookX, view.lookY,
+                 view.lookZ, view.distance, view.pitch, view.yaw);
+  }
+
+  const bool ok = std::fclose(out) == 0;
+  std::ostringstream summary;
+  summary << keyframes.size() << " keyframes, " << frames << " frames, "
+          << spline.duration() << " s -> " << path;
+  message = ok ? summary.str() : "error writing " + path;
+  return ok;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    printUsage();
+    return 2;
+  }
+
+  // Tracks are named after the route file, so routes with the same name in
+  // different directories would write over each other's
+  std::map<std::string, std::string> trackRoutes;
+  for (const std::string &route : options.routes) {
+    const std::string track = trackPath(options, route);
+    const auto inserted = trackRoutes.emplace(track, route);
+    if (!inserted.second) {
+      std::fprintf(stderr, "flythrough_bake: %s and %s would both write %s\n",
+                   inserted.first->second.c_str(), route.c_str(),
+                   track.c_str());
+      return 2;
+    }
+  }
+
+  DemGrid grid;
+  std::string error;
+  if (!loadAsciiGrid(options.demPath, grid, error)) {
+    std::fprintf(stderr, "flythrough_bake: %s\n", error.c_str());
+    return 1;
+  }
+  DemPyramid pyramid;
+  pyramid.build(grid);
+
+  std::error_code dirError;
+  std::filesystem::create_directories(options.outDir, dirError);
+
+  // Workers take the next route until none are left
+  unsigned threads = options.threads;
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min<unsigned>(threads, options.routes.size());
+
+  std::atomic<size_t> next{0};
+  std::atomic<int> failures{0};
+  std::mutex outputMutex;
+  auto worker = [&]() {
+    for (size_t i = next++; i < options.routes.size(); i = next++) {
+      const std::string &route = options.routes[i];
+      std::string message;
+      const bool ok = bakeRoute(options, grid, pyramid, route, message);
+      if (!ok)
+        ++failures;
+      std::lock_guard<std::mutex> lock(outputMutex);
+      std::fprintf(ok ? stdout : stderr, "%s: %s\n", route.c_str(),
+                   message.c_str());
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (unsigned t = 1; t < threads; ++t)
+    pool.emplace_back(worker);
+  worker();
+  for (std::thread &thread : pool)
+    thread.join();
+
+  return failures > 0 ? 1 : 0;
+}
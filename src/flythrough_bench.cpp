@@ -0,0 +1,519 @@
+// flythrough_bench: microbenchmarks for the engine's hot paths.
+//
+// Runs each stage (path shaping, DEM sampling, keyframe generation, spline
+// evaluation, look-at math) on synthetic DEMs and synthetic paths of 1k up
+// to 1M vertices, and prints one JSON document with the best and median
+// time per run, throughput and heap allocations per run for every stage.
+// Results are meant to be kept and compared across releases, so field names
+// are stable; add fields rather than renaming them.
+//
+//   flythrough_bench [--max-vertices N] [--min-time S] [--dem-size CELLS]
+//                    [--out results.json]
+
+#include "flythrough_dem.h"
+#include "flythrough_path.h"
+#include "flythrough_spline.h"
+#include "flythrough_trajectory.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <string>
+#include <vector>
+
+// --- Allocation counting ---
+//
+// Every global new/delete in the process goes through these, so a stage's
+// allocations are the counter difference across its body.
+
+namespace {
+std::atomic<std::uint64_t> gAllocCount{0};
+std::atomic<std::uint64_t> gAllocBytes{0};
+
+void *countedAlloc(std::size_t size) {
+  gAllocCount.fetch_add(1, std::memory_order_relaxed);
+  gAllocBytes.fetch_add(size, std::memory_order_relaxed);
+  return std::malloc(size ? size : 1);
+}
+} // namespace
+
+void *operator new(std::size_t size) {
+  if (void *p = countedAlloc(size))
+    return p;
+  throw std::bad_alloc();
+}
+void *operator new[](std::size_t size) {
+  if (void *p = countedAlloc(size))
+    return p;
+  throw std::bad_alloc();
+}
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return countedAlloc(size);
+}
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return countedAlloc(size);
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Keeps results observable so the optimiser can't drop a stage
+volatile double gSink = 0.0;
+
+struct Options {
+  size_t maxVertices = 1000000;
+  double minTime = 0.2; // seconds of timed runs per stage
+  int demSize = 2048;   // cells per side
+  std::string outPath;  // stdout when empty
+};
+
+struct Result {
+  std::string stage;
+  std::string dem;
+  size_t vertices = 0;
+  size_t items = 0; // Units of work per run (points, frames, cells)
+  int runs = 0;
+  double bestSeconds = 0.0;
+  double medianSeconds = 0.0;
+  double allocsPerRun = 0.0;
+  double bytesPerRun = 0.0;
+};
+
+std::vector<Result> gResults;
+Options gOptions;
+
+// Times body() until minTime has been spent (at least 3 runs). setup()
+// runs before each run outside the timed and counted region, so in-place
+// stages start from the same input every time.
+template <typename Setup, typename Body>
+void measure(const std::string &stage, const std::string &dem,
+             size_t vertices, size_t items, Setup setup, Body body) {
+  setup();
+  body(); // Warm-up: page in buffers, size scratch space
+
+  std::vector<double> times;
+  std::uint64_t allocs = 0, bytes = 0;
+  double total = 0.0;
+  while (times.size() < 3 ||
+         (total < gOptions.minTime && times.size() < 1000)) {
+    setup();
+    const std::uint64_t allocsBefore = gAllocCount.load();
+    const std::uint64_t bytesBefore = gAllocBytes.load();
+    const Clock::time_point start = Clock::now();
+    body();
+    const double seconds =
+        std::chrono::duration<double>(Clock::now() - start).count();
+    allocs += gAllocCount.load() - allocsBefore;
+    bytes += gAllocBytes.load() - bytesBefore;
+    times.push_back(seconds);
+    total += seconds;
+  }
+
+  std::sort(times.begin(), times.end());
+  Result result;
+  result.stage = stage;
+  result.dem = dem;
+  result.vertices = vertices;
+  result.items = items;
+  result.runs = static_cast<int>(times.size());
+  result.bestSeconds = times.front();
+  result.medianSeconds = times[times.size() / 2];
+  result.allocsPerRun = static_cast<double>(allocs) / times.size();
+  result.bytesPerRun = static_cast<double>(bytes) / times.size();
+  gResults.push_back(result);
+
+  std::fprintf(stderr,
+               "%-18s %-9s %8zu  %10.3f ms  %8.1f Mitems/s  %.1f allocs\n",
+               stage.c_str(), dem.c_str(), vertices,
+               result.medianSeconds * 1e3, items / result.medianSeconds * 1e-6,
+               result.allocsPerRun);
+}
+
+template <typename Body>
+void measure(const std::string &stage, const std::string &dem,
+             size_t vertices, size_t items, Body body) {
+  measure(stage, dem, vertices, items, [] {}, body);
+}
+
+// --- Synthetic data ---
+
+std::uint32_t hash2(std::int32_t x, std::int32_t y, std::uint32_t seed) {
+  std::uint32_t h = seed ^ (static_cast<std::uint32_t>(x) * 0x27d4eb2dU) ^
+                    (static_cast<std::uint32_t>(y) * 0x165667b1U);
+  h ^= h >> 15;
+  h *= 0x85ebca6bU;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35U;
+  h ^= h >> 16;
+  return h;
+}
+
+// Smoothly interpolated lattice noise in [0, 1]
+double valueNoise(double x, double y, std::uint32_t seed) {
+  const double fx = std::floor(x), fy = std::floor(y);
+  const std::int32_t ix = static_cast<std::int32_t>(fx);
+  const std::int32_t iy = static_cast<std::int32_t>(fy);
+  double tx = x - fx, ty = y - fy;
+  tx = tx * tx * (3.0 - 2.0 * tx);
+  ty = ty * ty * (3.0 - 2.0 * ty);
+  const double scale = 1.0 / 4294967295.0;
+  const double v00 = hash2(ix, iy, seed) * scale;
+  const double v10 = hash2(ix + 1, iy, seed) * scale;
+  const double v01 = hash2(ix, iy + 1, seed) * scale;
+  const double v11 = hash2(ix + 1, iy + 1, seed) * scale;
+  return (v00 + (v10 - v00) * tx) * (1.0 - ty) +
+         (v01 + (v11 - v01) * tx) * ty;
+}
+
+const double kCellSize = 10.0; // metres
+
+enum class DemKind { Fractal, Constant, Holes };
+
+const char *demName(DemKind kind) {
+  switch (kind) {
+  case DemKind::Fractal:
+    return "fractal";
+  case DemKind::Constant:
+    return "constant";
+  case DemKind::Holes:
+    return "holes";
+  }
+  return "";
+}
+
+// Fractal: six octaves of value noise, 0-2000 m relief. Holes: the same
+// terrain with nodata discs covering about a tenth of the area, the way
+// voids show up in SRTM tiles.
+void makeDem(DemKind kind, int size, DemGrid &grid) {
+  grid.reset(0.0, size * kCellSize, kCellSize, kCellSize, size, size);
+  float *cells = grid.data();
+  for (int row = 0; row < size; ++row) {
+    for (int col = 0; col < size; ++col) {
+      double z = 250.0;
+      if (kind != DemKind::Constant) {
+        double amplitude = 1000.0, frequency = 1.0 / 256.0;
+        z = 0.0;
+        for (int octave = 0; octave < 6; ++octave) {
+          z += amplitude * valueNoise(col * frequency, row * frequency, octave);
+          amplitude *= 0.5;
+          frequency *= 2.0;
+        }
+      }
+      cells[static_cast<size_t>(row) * size + col] = static_cast<float>(z);
+    }
+  }
+
+  if (kind == DemKind::Holes) {
+    const int radius = std::max(2, size / 40);
+    const int holes = static_cast<int>(0.1 * size * size /
+                                       (3.14159 * radius * radius));
+    for (int h = 0; h < holes; ++h) {
+      const int cx = hash2(h, 1, 99) % size;
+      const int cy = hash2(h, 2, 99) % size;
+      for (int row = std::max(0, cy - radius);
+           row < std::min(size, cy + radius); ++row) {
+        for (int col = std::max(0, cx - radius);
+             col < std::min(size, cx + radius); ++col) {
+          if ((col - cx) * (col - cx) + (row - cy) * (row - cy) <=
+              radius * radius) {
+            cells[static_cast<size_t>(row) * size + col] =
+                std::numeric_limits<float>::quiet_NaN();
+          }
+        }
+      }
+    }
+  }
+}
+
+// A wandering closed-form route that stays inside the DEM, with GPS-like
+// jitter. More vertices means denser sampling of the same route, as with
+// a track logged at a higher rate.
+void makePath(size_t count, double extent, std::vector<double> &xs,
+              std::vector<double> &ys) {
+  xs.resize(count);
+  ys.resize(count);
+  const double centre = 0.5 * extent;
+  const double radius = 0.4 * extent;
+  for (size_t i = 0; i < count; ++i) {
+    const double t = 6.0 * 3.14159265358979 * i / (count - 1);
+    const std::int32_t seed = static_cast<std::int32_t>(i);
+    const double jitterX = (hash2(seed, 3, 7) & 0xffff) / 65535.0;
+    const double jitterY = (hash2(seed, 4, 7) & 0xffff) / 65535.0;
+    xs[i] = centre + radius * std::sin(1.0 * t) * std::cos(0.31 * t) +
+            4.0 * (jitterX - 0.5);
+    ys[i] = centre + radius * std::sin(0.7 * t + 0.5) +
+            4.0 * (jitterY - 0.5);
+  }
+}
+
+std::vector<double> cumulativeDistances(const std::vector<double> &xs,
+                                        const std::vector<double> &ys) {
+  std::vector<double> distances(xs.size(), 0.0);
+  for (size_t i = 1; i < xs.size(); ++i)
+    distances[i] = distances[i - 1] +
+                   std::hypot(xs[i] - xs[i - 1], ys[i] - ys[i - 1]);
+  return distances;
+}
+
+// --- Stages ---
+
+// Path shaping and the DEM-independent per-frame math
+void benchPathStages(size_t n, double extent) {
+  std::vector<double> xs0, ys0;
+  makePath(n, extent, xs0, ys0);
+  const double spacing = cumulativeDistances(xs0, ys0).back() / (n - 1);
+
+  std::vector<double> xs, ys, outXs, outYs, scratch;
+  auto reset = [&] {
+    xs = xs0;
+    ys = ys0;
+  };
+
+  measure("densifyPath", "none", n, n, [&] {
+    densifyPath(xs0, ys0, 0.25 * spacing, outXs, outYs);
+    gSink = gSink + outXs.back();
+  });
+  measure("simplifyPath", "none", n, n, reset, [&] {
+    gSink = gSink + simplifyPath(xs, ys, kCellSize);
+  });
+  measure("smoothPath", "none", n, n, reset, [&] {
+    smoothPath(xs, ys, 50.0, scratch);
+    gSink = gSink + xs[xs.size() / 2];
+  });
+
+  // Flat profile: generation cost doesn't depend on the terrain
+  const std::vector<double> distances = cumulativeDistances(xs0, ys0);
+  const std::vector<double> elevations(n, 250.0);
+  TrajectoryParams params;
+  std::vector<Keyframe> keyframes;
+  measure("generateKeyframes", "none", n, n, [&] {
+    keyframes = generateKeyframes(xs0.data(), ys0.data(), distances.data(),
+                                  elevations.data(), n, 250.0, params);
+    gSink = gSink + keyframes.back().time;
+  });
+
+  CameraSpline spline;
+  measure("splineBuild", "none", n, n, [&] {
+    spline.build(keyframes);
+    gSink = gSink + spline.length();
+  });
+
+  // One pose per frame, as many frames as vertices
+  const double duration = spline.duration();
+  measure("splinePose", "none", n, n, [&] {
+    double sum = 0.0;
+    for (size_t i = 0; i < n; ++i)
+      sum += spline.poseAt(duration * i / n).z;
+    gSink = gSink + sum;
+  });
+
+  measure("lerpAngle", "none", n, n, [&] {
+    double sum = 0.0;
+    for (size_t i = 0; i < n; ++i)
+      sum += lerpAngle(keyframes[i].yaw, 360.0 - keyframes[i].yaw, 0.3);
+    gSink = gSink + sum;
+  });
+}
+
+// Everything that reads the DEM
+void benchDemStages(size_t n, DemKind kind, const DemGrid &grid,
+                    const DemPyramid &pyramid) {
+  const char *dem = demName(kind);
+  const double extent = grid.xMax() - grid.xMin();
+  std::vector<double> xs, ys;
+  makePath(n, extent, xs, ys);
+  std::vector<double> zs(n);
+
+  // Output size follows the terrain, so items are input vertices
+  AdaptiveSampling sampling;
+  sampling.minSpacing = grid.cellSizeX();
+  const HeightFunction height = [&grid](double x, double y) {
+    return grid.sample(x, y, std::numeric_limits<double>::quiet_NaN());
+  };
+  std::vector<double> outXs, outYs;
+  measure("densifyAdaptive", dem, n, n, [&] {
+    gSink = gSink + densifyPathAdaptive(xs, ys, height, sampling, outXs,
+                                        outYs);
+  });
+
+  measure("sampleElevations", dem, n, n, [&] {
+    grid.sampleElevations(xs.data(), ys.data(), zs.data(), n);
+    gSink = gSink + zs[n / 2];
+  });
+
+  // Point at a time, through DemGrid::sample
+  measure("samplePoint", dem, n, n, [&] {
+    double sum = 0.0;
+    for (size_t i = 0; i < n; ++i)
+      sum += grid.sample(xs[i], ys[i]);
+    gSink = gSink + sum;
+  });
+
+  const double radius = std::hypot(grid.cellSizeX(), grid.cellSizeY());
+  measure("pathMax", dem, n, n, [&] {
+    gSink = gSink + pyramid.pathMax(xs.data(), ys.data(), n, radius);
+  });
+
+  // Sliding-window clearance and grade limits over the real profile
+  const std::vector<double> distances = cumulativeDistances(xs, ys);
+  grid.sampleElevations(xs.data(), ys.data(), zs.data(), n);
+  TrajectoryParams follow;
+  follow.altitudeMode = AltitudeMode::TerrainFollow;
+  measure("terrainFollow", dem, n, n, [&] {
+    const std::vector<Keyframe> keyframes =
+        generateKeyframes(xs.data(), ys.data(), distances.data(), zs.data(),
+                          n, std::nan(""), follow);
+    gSink = gSink + keyframes.back().z;
+  });
+
+  // Look-at math for one frame per vertex, terrain sampled at the target
+  TrajectoryParams params;
+  params.altitudeMode = AltitudeMode::AboveTerrain;
+  CameraSpline spline;
+  spline.build(generateKeyframes(xs.data(), ys.data(), distances.data(),
+                                 zs.data(), n, std::nan(""), params));
+  const TerrainSampler terrain = [&grid](double x, double y) {
+    return grid.sample(x, y, std::numeric_limits<double>::quiet_NaN());
+  };
+  const double step = spline.duration() / n;
+  measure("orbitView", dem, n, n, [&] {
+    double sum = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+      const LookAtInput input = lookAtInputAt(spline, step * i, 1000.0);
+      sum += computeOrbitView(input, 200.0, 1000.0, terrain).distance;
+    }
+    gSink = gSink + sum;
+  });
+
+  // The same views baked for the whole flight, one frame per vertex, with
+  // one batch terrain sample
+  const TerrainBatchSampler batchTerrain =
+      [&grid](const double *lookXs, const double *lookYs, double *lookZs,
+              size_t lookCount) {
+        grid.sampleElevations(lookXs, lookYs, lookZs, lookCount,
+                              std::numeric_limits<double>::quiet_NaN());
+      };
+  BakedPoses poses;
+  measure("bakePoses", dem, n, n, [&] {
+    bakePoses(spline, 1.0 / step, 200.0, 1000.0, batchTerrain, poses);
+    gSink = gSink + poses.distance.back();
+  });
+}
+
+bool parseNumber(const char *text, double &value) {
+  char *end = nullptr;
+  value = std::strtod(text, &end);
+  return end != text && *end == '\0' && std::isfinite(value);
+}
+
+// A whole number in [low, high]: "1e5" is accepted, "12abc" and "1.5" are
+// not
+bool parseCount(const char *text, double low, double high, double &value) {
+  return parseNumber(text, value) && value == std::floor(value) &&
+         value >= low && value <= high;
+}
+
+bool parseOptions(int argc, char **argv) {
+  if (argc % 2 == 0)
+    return false;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string arg = argv[i];
+    const char *value = argv[i + 1];
+    double number = 0.0;
+    if (arg == "--max-vertices") {
+      if (!parseCount(value, 1000.0, 1e9, number))
+        return false;
+      gOptions.maxVertices = static_cast<size_t>(number);
+    } else if (arg == "--min-time") {
+      if (!parseNumber(value, number) || number < 0.0)
+        return false;
+      gOptions.minTime = number;
+    } else if (arg == "--dem-size") {
+      // Up to 32768 cells a side, so that a grid's cell count fits an int
+      if (!parseCount(value, 16.0, 32768.0, number))
+        return false;
+      gOptions.demSize = static_cast<int>(number);
+    } else if (arg == "--out") {
+      gOptions.outPath = value;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+void writeJson(std::FILE *out) {
+  std::fprintf(out, "{\n  \"benchmark\": \"flythrough_bench\",\n");
+  std::fprintf(out, "  \"format\": 1,\n");
+  std::fprintf(out, "  \"dem_size\": %d,\n", gOptions.demSize);
+  std::fprintf(out, "  \"cell_size\": %g,\n", kCellSize);
+  std::fprintf(out, "  \"min_time\": %g,\n", gOptions.minTime);
+  std::fprintf(out, "  \"results\": [\n");
+  for (size_t i = 0; i < gResults.size(); ++i) {
+    const Result &r = gResults[i];
+    std::fprintf(out,
+                 "    {\"stage\": \"%s\", \"dem\": \"%s\", \"vertices\": %zu, "
+                 "\"items\": %zu, \"runs\": %d, \"best_s\": %.9f, "
+                 "\"median_s\": %.9f, \"items_per_s\": %.1f, "
+                 "\"allocs_per_run\": %.2f, \"bytes_per_run\": %.0f}%s\n",
+                 r.stage.c_str(), r.dem.c_str(), r.vertices, r.items, r.runs,
+                 r.bestSeconds, r.medianSeconds, r.items / r.medianSeconds,
+                 r.allocsPerRun, r.bytesPerRun,
+                 i + 1 < gResults.size() ? "," : "");
+  }
+  std::fprintf(out, "  ]\n}\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (!parseOptions(argc, argv)) {
+    std::fprintf(stderr,
+                 "usage: flythrough_bench [--max-vertices N] [--min-time S] "
+                 "[--dem-size CELLS] [--out FILE.json]\n");
+    return 2;
+  }
+
+  std::vector<size_t> sizes;
+  for (size_t n = 1000; n <= gOptions.maxVertices; n *= 10)
+    sizes.push_back(n);
+
+  const double extent = gOptions.demSize * kCellSize;
+  for (size_t n : sizes)
+    benchPathStages(n, extent);
+
+  for (DemKind kind : {DemKind::Fractal, DemKind::Constant, DemKind::Holes}) {
+    DemGrid grid;
+    makeDem(kind, gOptions.demSize, grid);
+    DemPyramid pyramid;
+    const size_t cells = static_cast<size_t>(grid.width()) * grid.height();
+    measure("pyramidBuild", demName(kind), 0, cells, [&] {
+      pyramid.build(grid);
+      gSink = gSink + pyramid.levelCount();
+    });
+    for (size_t n : sizes)
+      benchDemStages(n, kind, grid, pyramid);
+  }
+
+  std::FILE *out = stdout;
+  if (!gOptions.outPath.empty()) {
+    out = std::fopen(gOptions.outPath.c_str(), "w");
+    if (!out) {
+      std::fprintf(stderr, "cannot write %s\n", gOptions.outPath.c_str());
+      return 1;
+    }
+  }
+  writeJson(out);
+  return out == stdout || std::fclose(out) == 0 ? 0 : 1;
+}
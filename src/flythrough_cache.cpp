@@ -0,0 +1,284 @@
+#include "flythrough_cache.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <cstring>
+
+namespace {
+
+const quint32 kByteOrderMark = 0x01020304;
+
+// Shared layout of the cache files: this header, then one array of count
+// doubles per channel
+struct CacheFileHeader {
+  char magic[4];
+  quint32 version;
+  quint64 count;
+  char key[20]; // SHA-1
+  quint32 byteOrder;
+  double extra; // One per-file scalar (profile peak); 0 if unused
+};
+static_assert(sizeof(CacheFileHeader) == 48,
+              "cache arrays must start 8-byte aligned");
+
+// Keyframe arrays in file order
+double Keyframe::*const kKeyframeChannels[] = {
+    &Keyframe::time,     &Keyframe::x,   &Keyframe::y,     &Keyframe::z,
+    &Keyframe::ground_z, &Keyframe::yaw, &Keyframe::pitch, &Keyframe::roll};
+const int kKeyframeChannelCount =
+    sizeof(kKeyframeChannels) / sizeof(kKeyframeChannels[0]);
+
+// A cache file mapped read-only after its header has been validated
+class MappedCacheFile {
+public:
+  MappedCacheFile(const QString &path, const char *magic, quint32 version,
+                  const QByteArray &key, int channels)
+      : mFile(path) {
+    if (key.size() != 20 || !mFile.open(QIODevice::ReadOnly))
+      return;
+    const qint64 size = mFile.size();
+    if (size < static_cast<qint64>(sizeof(CacheFileHeader)))
+      return;
+    mData = mFile.map(0, size);
+    if (!mData)
+      return;
+
+    std::memcpy(&mHeader, mData, sizeof(mHeader));
+    const quint64 maxCount =
+        static_cast<quint64>(size) / (channels * sizeof(double));
+    const bool valid =
+        std::memcmp(mHeader.magic, magic, 4) == 0 &&
+        mHeader.version == version && mHeader.byteOrder == kByteOrderMark &&
+        std::memcmp(mHeader.key, key.constData(), 20) == 0 &&
+        mHeader.count <= maxCount &&
+        size == static_cast<qint64>(sizeof(mHeader) +
+                                    mHeader.count * channels * sizeof(double));
+    if (!valid) {
+      qDebug() << "[FTP] Ignoring stale cache file" << path;
+      mFile.unmap(mData);
+      mData = nullptr;
+    }
+  }
+
+  ~MappedCacheFile() {
+    if (mData)
+      mFile.unmap(mData);
+  }
+
+  bool isValid() const { return mData != nullptr; }
+  size_t count() const { return static_cast<size_t>(mHeader.count); }
+  double extra() const { return mHeader.extra; }
+  const double *channel(int index) const {
+    return reinterpret_cast<const double *>(mData + sizeof(mHeader)) +
+           index * count();
+  }
+
+private:
+  QFile mFile;
+  uchar *mData = nullptr;
+  CacheFileHeader mHeader;
+};
+
+// Writes header and arrays through QSaveFile, so a crash never leaves a
+// partial entry. fillChannel(c, column) fills the count values of channel c.
+template <typename Fill>
+bool writeCacheFile(const QString &path, const char *magic, quint32 version,
+                    const QByteArray &key, double extra, size_t count,
+                    int channels, Fill fillChannel) {
+  if (key.size() != 20 || !QDir().mkpath(QFileInfo(path).path()))
+    return false;
+
+  CacheFileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, magic, 4);
+  header.version = version;
+  header.count = count;
+  std::memcpy(header.key, key.constData(), 20);
+  header.byteOrder = kByteOrderMark;
+  header.extra = extra;
+
+  QSaveFile file(path);
+  if (!file.open(QIODevice::WriteOnly))
+    return false;
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  std::vector<double> column(count);
+  for (int c = 0; c < channels; ++c) {
+    fillChannel(c, column);
+    file.write(reinterpret_cast<const char *>(column.data()),
+               static_cast<qint64>(count * sizeof(double)));
+  }
+
+  if (!file.commit()) {
+    qDebug() << "[FTP] Could not write cache file" << path << ":"
+             << file.errorString();
+    return false;
+  }
+  return true;
+}
+
+QString cacheFilePath(const QString &directory, const QByteArray &key,
+                      const char *suffix) {
+  return QDir(directory).filePath(QString::fromLatin1(key.toHex()) + suffix);
+}
+
+// Keep the newest maxEntries files matching pattern
+void pruneCache(const QString &directory, const QString &pattern,
+                int maxEntries) {
+  const QFileInfoList entries = QDir(directory).entryInfoList(
+      QStringList() << pattern, QDir::Files, QDir::Time);
+  for (int i = maxEntries; i < entries.size(); ++i)
+    QFile::remove(entries[i].absoluteFilePath());
+}
+
+} // namespace
+
+// --- CacheKeyBuilder ---
+
+CacheKeyBuilder &CacheKeyBuilder::add(double value) {
+  mHash.addData(reinterpret_cast<const char *>(&value), sizeof(value));
+  return *this;
+}
+
+CacheKeyBuilder &CacheKeyBuilder::add(qint64 value) {
+  mHash.addData(reinterpret_cast<const char *>(&value), sizeof(value));
+  return *this;
+}
+
+CacheKeyBuilder &CacheKeyBuilder::add(const QString &value) {
+  const QByteArray utf8 = value.toUtf8();
+  add(static_cast<qint64>(utf8.size()));
+  mHash.addData(utf8);
+  return *this;
+}
+
+CacheKeyBuilder &CacheKeyBuilder::add(const double *values, size_t count) {
+  add(static_cast<qint64>(count));
+  mHash.addData(reinterpret_cast<const char *>(values),
+                static_cast<int>(count * sizeof(double)));
+  return *this;
+}
+
+QString sourceFileStamp(const QString &source) {
+  const QFileInfo info(source.section('|', 0, 0));
+  if (!info.isFile())
+    return QString();
+  return QString("%1:%2")
+      .arg(info.lastModified().toMSecsSinceEpoch())
+      .arg(info.size());
+}
+
+// --- KeyframeCache ---
+
+KeyframeCache::KeyframeCache(const QString &directory)
+    : mDirectory(directory) {}
+
+QString KeyframeCache::defaultDirectory(const QString &settingsDir) {
+  return QDir(settingsDir).filePath("cache/flythrough/keyframes");
+}
+
+QString KeyframeCache::filePath(const QByteArray &key) const {
+  return cacheFilePath(mDirectory, key, ".ftpk");
+}
+
+void KeyframeCache::setMaxEntries(int count) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mMaxEntries = qMax(kDefaultCacheEntries, count);
+}
+
+bool KeyframeCache::load(const QByteArray &key,
+                         std::vector<Keyframe> &keyframes) const {
+  // No prune may delete the file between opening and mapping it
+  std::lock_guard<std::mutex> lock(mMutex);
+  MappedCacheFile file(filePath(key), "FTPK", 1, key, kKeyframeChannelCount);
+  if (!file.isValid() || file.count() < 2)
+    return false;
+
+  // Arrays are read straight from the mapping into the keyframes
+  keyframes.resize(file.count());
+  for (int c = 0; c < kKeyframeChannelCount; ++c) {
+    const double *column = file.channel(c);
+    double Keyframe::*member = kKeyframeChannels[c];
+    for (size_t i = 0; i < keyframes.size(); ++i)
+      keyframes[i].*member = column[i];
+  }
+  return true;
+}
+
+bool KeyframeCache::store(const QByteArray &key,
+                          const std::vector<Keyframe> &keyframes) const {
+  if (keyframes.size() < 2)
+    return false;
+
+  // Writing and pruning together, so no other thread's prune removes this
+  // entry before the count includes it
+  std::lock_guard<std::mutex> lock(mMutex);
+  const bool written = writeCacheFile(
+      filePath(key), "FTPK", 1, key, 0.0, keyframes.size(),
+      kKeyframeChannelCount, [&](int c, std::vector<double> &column) {
+        double Keyframe::*member = kKeyframeChannels[c];
+        for (size_t i = 0; i < keyframes.size(); ++i)
+          column[i] = keyframes[i].*member;
+      });
+  if (written)
+    pruneCache(mDirectory, "*.ftpk", mMaxEntries);
+  return written;
+}
+
+// --- ProfileCache ---
+
+void ProfileCache::setProjectHome(const QString &projectHome,
+                                  const QString &settingsDir) {
+  const QFileInfo home(projectHome);
+  if (!projectHome.isEmpty() && home.isDir() && home.isWritable())
+    mDirectory = QDir(projectHome).filePath(".flythrough/profiles");
+  else
+    mDirectory = QDir(settingsDir).filePath("cache/flythrough/profiles");
+}
+
+QString ProfileCache::filePath(const QByteArray &key) const {
+  return cacheFilePath(mDirectory, key, ".ftpp");
+}
+
+void ProfileCache::setMaxEntries(int count) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mMaxEntries = qMax(kDefaultCacheEntries, count);
+}
+
+bool ProfileCache::load(const QByteArray &key,
+                        ElevationProfile &profile) const {
+  if (mDirectory.isEmpty())
+    return false;
+  std::lock_guard<std::mutex> lock(mMutex);
+  MappedCacheFile file(filePath(key), "FTPP", 2, key, 4);
+  if (!file.isValid())
+    return false;
+
+  std::vector<double> *channels[] = {&profile.xs, &profile.ys,
+                                     &profile.distances, &profile.elevations};
+  for (int c = 0; c < 4; ++c)
+    channels[c]->assign(file.channel(c), file.channel(c) + file.count());
+  profile.peak = file.extra();
+  return true;
+}
+
+bool ProfileCache::store(const QByteArray &key,
+                         const ElevationProfile &profile) const {
+  const size_t count = profile.xs.size();
+  if (mDirectory.isEmpty() || profile.ys.size() != count ||
+      profile.distances.size() != count || profile.elevations.size() != count)
+    return false;
+
+  const std::vector<double> *channels[] = {
+      &profile.xs, &profile.ys, &profile.distances, &profile.elevations};
+  std::lock_guard<std::mutex> lock(mMutex);
+  const bool written = writeCacheFile(
+      filePath(key), "FTPP", 2, key, profile.peak, count, 4,
+      [&](int c, std::vector<double> &column) { column = *channels[c]; });
+  if (written)
+    pruneCache(mDirectory, "*.ftpp", mMaxEntries);
+  return written;
+}
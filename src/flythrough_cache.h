@@ -0,0 +1,106 @@
+#ifndef FLYTHROUGH_CACHE_H
+#define FLYTHROUGH_CACHE_H
+
+#include "flythrough_keyframe.h"
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QString>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+// Accumulates everything a cached result depends on into a SHA-1 key.
+// Strings are length-prefixed so adjacent fields can't run together.
+class CacheKeyBuilder {
+public:
+  CacheKeyBuilder &add(double value);
+  CacheKeyBuilder &add(qint64 value);
+  CacheKeyBuilder &add(const QString &value);
+  CacheKeyBuilder &add(const double *values, size_t count);
+
+  QByteArray result() const { return mHash.result(); }
+
+private:
+  QCryptographicHash mHash{QCryptographicHash::Sha1};
+};
+
+// "mtime:size" of the file behind a layer source, or an empty string when
+// the source is not a local file (database, web service). Provider options
+// after '|' are ignored.
+QString sourceFileStamp(const QString &source);
+
+// Cache files share one layout (native byte order, 8-byte aligned so they
+// can be mapped and read in place):
+//   header  magic, format version, element count, SHA-1 key, byte-order
+//           mark, one scalar
+//   arrays  count doubles per channel
+// Files are written through QSaveFile, and each cache directory is pruned
+// to its newest entries: 64, or more while a batch needs them all. Loads,
+// stores and pruning of one cache are serialised, so pool threads can share
+// it.
+
+// Entries a cache directory keeps unless told to keep more
+const int kDefaultCacheEntries = 64;
+
+// Generated keyframes, one .ftpk file per key (magic "FTPK"). Channels are
+// time, x, y, z, ground_z, yaw, pitch, roll.
+class KeyframeCache {
+public:
+  explicit KeyframeCache(const QString &directory);
+
+  // <settingsDir>/cache/flythrough/keyframes, for the QGIS settings dir
+  static QString defaultDirectory(const QString &settingsDir);
+
+  bool load(const QByteArray &key, std::vector<Keyframe> &keyframes) const;
+  bool store(const QByteArray &key,
+             const std::vector<Keyframe> &keyframes) const;
+
+  QString filePath(const QByteArray &key) const;
+
+  // Pruning keeps at least count entries, so a per-feature run over count
+  // paths doesn't evict its own entries. Set back to kDefaultCacheEntries
+  // once the run is done.
+  void setMaxEntries(int count);
+
+private:
+  QString mDirectory;
+  int mMaxEntries = kDefaultCacheEntries;
+  mutable std::mutex mMutex;
+};
+
+// Raw terrain along a path: what keyframe generation reads from the DEM.
+// Independent of speed, pitch, FOV, FPS and vertical exaggeration.
+struct ElevationProfile {
+  std::vector<double> xs, ys;     // Vertices sampled, after resampling
+  std::vector<double> distances;  // Cumulative distance at each vertex
+  std::vector<double> elevations; // Unexaggerated DEM elevation per vertex
+  double peak = std::numeric_limits<double>::quiet_NaN(); // Corridor max
+};
+
+// Elevation profiles, one .ftpp file per key (magic "FTPP"; channels x, y,
+// distances, elevations; the scalar is the peak). Kept next to the project
+// so a project carries its profiles, or in the QGIS profile for unsaved
+// projects.
+class ProfileCache {
+public:
+  // <project dir>/.flythrough/profiles when writable, otherwise
+  // <settingsDir>/cache/flythrough/profiles, for the QGIS settings dir
+  void setProjectHome(const QString &projectHome, const QString &settingsDir);
+
+  bool load(const QByteArray &key, ElevationProfile &profile) const;
+  bool store(const QByteArray &key, const ElevationProfile &profile) const;
+
+  QString filePath(const QByteArray &key) const;
+
+  // Pruning keeps at least count entries, so a per-feature run over count
+  // paths doesn't evict its own entries. Set back to kDefaultCacheEntries
+  // once the run is done.
+  void setMaxEntries(int count);
+
+private:
+  QString mDirectory;
+  int mMaxEntries = kDefaultCacheEntries;
+  mutable std::mutex mMutex;
+};
+
+#endif // FLYTHROUGH_CACHE_H
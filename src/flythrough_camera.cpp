@@ -0,0 +1,108 @@
+#include "flythrough_camera.h"
+#include "flythrough_scene.h"
+#include <QDebug>
+
+CameraDispatch::CameraDispatch(QObject *parent) : QObject(parent) {}
+
+void CameraDispatch::attach(QWidget *canvas) {
+  if (mCanvas == canvas && mProbed)
+    return;
+
+  reset();
+  mCanvas = canvas;
+  if (mCanvas) {
+    connect(mCanvas, &QObject::destroyed, this,
+            &CameraDispatch::onCanvasDestroyed);
+  }
+  probe();
+}
+
+void CameraDispatch::reset() {
+  if (mCanvas)
+    disconnect(mCanvas, nullptr, this, nullptr);
+  mCanvas = nullptr;
+  mController = nullptr;
+  mLookAt = QMetaMethod();
+  mApi = LookAtApi::None;
+  mProbed = false;
+}
+
+void CameraDispatch::onCanvasDestroyed() { reset(); }
+
+void CameraDispatch::probe() {
+  mProbed = true;
+  mController = nullptr;
+  mApi = LookAtApi::None;
+  if (!mCanvas)
+    return;
+
+  // Controller: directly on the canvas, or through its scene
+  QObject *controller = invokeObjectGetter(mCanvas, "cameraController()");
+  if (!controller) {
+    QObject *scene = invokeObjectGetter(mCanvas, "scene()");
+    controller = invokeObjectGetter(scene, "cameraController()");
+  }
+  if (!controller) {
+    for (QObject *child : mCanvas->findChildren<QObject *>()) {
+      if (QString(child->metaObject()->className()) == "QgsCameraController") {
+        controller = child;
+        break;
+      }
+    }
+  }
+  if (!controller) {
+    qDebug() << "[FTP] Camera controller not found";
+    return;
+  }
+
+  const QMetaObject *meta = controller->metaObject();
+  int index = meta->indexOfMethod(
+      "setLookingAtMapPoint(QgsVector3D,double,double,double)");
+  if (index >= 0) {
+    mApi = LookAtApi::MapPoint;
+  } else {
+    index = meta->indexOfMethod(
+        "setLookingAtPoint(QgsVector3D,float,float,float)");
+    if (index >= 0)
+      mApi = LookAtApi::Point;
+  }
+
+  if (mApi == LookAtApi::None) {
+    qDebug() << "[FTP] Camera controller has no usable look-at method";
+    return;
+  }
+
+  mController = controller;
+  mLookAt = meta->method(index);
+  qDebug() << "[FTP] Camera dispatch resolved:"
+           << mLookAt.methodSignature();
+}
+
+bool CameraDispatch::ensureResolved() {
+  if (mController && mApi != LookAtApi::None)
+    return true;
+  // Only re-probe when a previously found controller went away; a canvas
+  // that never had one would otherwise be probed every frame
+  if (!mCanvas || mApi == LookAtApi::None)
+    return false;
+  probe();
+  return mController && mApi != LookAtApi::None;
+}
+
+bool CameraDispatch::setLookingAt(const QgsVector3D &point, double distance,
+                                  double pitch, double yaw) {
+  if (!ensureResolved())
+    return false;
+
+  if (mApi == LookAtApi::MapPoint) {
+    return mLookAt.invoke(mController, Qt::DirectConnection,
+                          Q_ARG(QgsVector3D, point), Q_ARG(double, distance),
+                          Q_ARG(double, pitch), Q_ARG(double, yaw));
+  }
+
+  return mLookAt.invoke(mController, Qt::DirectConnection,
+                        Q_ARG(QgsVector3D, point),
+                        Q_ARG(float, static_cast<float>(distance)),
+                        Q_ARG(float, static_cast<float>(pitch)),
+                        Q_ARG(float, static_cast<float>(yaw)));
+}
@@ -0,0 +1,53 @@
+#ifndef FLYTHROUGH_CAMERA_H
+#define FLYTHROUGH_CAMERA_H
+
+#include <QMetaMethod>
+#include <QObject>
+#include <QPointer>
+#include <QWidget>
+#include <qgsvector3d.h>
+
+// Per-canvas camera dispatch.
+//
+// QgsCameraController is only reached through the meta-object system (see
+// the linking notes in flythrough_core.cpp). Looking up the controller and
+// the look-at method by name is too slow to repeat every frame, so this
+// probes the running QGIS version once per canvas, caches the controller and
+// the resolved QMetaMethod, and drops the cache when the canvas goes away.
+class CameraDispatch : public QObject {
+  Q_OBJECT
+
+public:
+  explicit CameraDispatch(QObject *parent = nullptr);
+
+  void attach(QWidget *canvas);
+  void reset();
+
+  // True when a controller and look-at method are cached. Re-probes if the
+  // controller was destroyed but the canvas is still alive.
+  bool ensureResolved();
+
+  // Orbit the camera around point; distance in map units, angles in degrees
+  bool setLookingAt(const QgsVector3D &point, double distance, double pitch,
+                    double yaw);
+
+private slots:
+  void onCanvasDestroyed();
+
+private:
+  enum class LookAtApi {
+    None,
+    MapPoint, // setLookingAtMapPoint(QgsVector3D,double,double,double)
+    Point     // setLookingAtPoint(QgsVector3D,float,float,float)
+  };
+
+  QPointer<QWidget> mCanvas;
+  QPointer<QObject> mController;
+  QMetaMethod mLookAt;
+  LookAtApi mApi = LookAtApi::None;
+  bool mProbed = false;
+
+  void probe();
+};
+
+#endif // FLYTHROUGH_CAMERA_H
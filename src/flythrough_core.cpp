@@ -1,11 +1,26 @@
 #include "flythrough_core.h"
+#include "flythrough_export.h"
+#include "flythrough_path.h"
+#include "flythrough_playback.h"
+#include "flythrough_prefetch.h"
+#include "flythrough_scene.h"
 #include <QApplication>
 #include <QDebug>
+#include <QDir>
+#include <QDockWidget>
+#include <QFileInfo>
 #include <QMessageBox>
+#include <QSaveFile>
+#include <QSet>
 #include <QThread>
+#include <QThreadPool>
 #include <QTimer>
+#include <QtConcurrent>
 #include <QtMath>
+#include <algorithm>
 #include <cmath>
+#include <limits>
+#include <memory>
 #include <qgisinterface.h>
 // NOTE: Do NOT include qgs3dmapcanvas.h or qgscameracontroller.h here.
 // Those headers would cause linkage against symbols not in QGIS 3.28.3.
@@ -14,6 +29,7 @@
 #include <qgsapplication.h>
 #include <qgscoordinatereferencesystem.h>
 #include <qgscoordinatetransform.h>
+#include <qgscsexception.h>
 // qgsdemterraingenerator.h removed - using dynamic QMetaObject approach
 // to avoid linking against QgsDemTerrainGenerator/QgsTerrainGenerator virtual
 // method symbols that differ between 3.34 headers and user's 3.28.3 DLL.
@@ -26,79 +42,719 @@
 #include <qgsmessagebar.h>
 #include <qgspointxy.h>
 #include <qgsproject.h>
-// qgsrasteridentifyresult.h removed - using provider->sample() instead of
-// identify()
+// qgsrasteridentifyresult.h removed - the DEM is read with block() into a
+// DemGrid instead of per-point identify()/sample()
+#include <qgsrasterblock.h>
+#include <qgsrasterdataprovider.h>
 #include <qgsrasterlayer.h>
 #include <qgsvectorlayer.h>
+#include <qgsvectorlayerfeatureiterator.h>
 // qgswkbtypes.h removed - no longer using QgsWkbTypes enum (removed in 3.34)
 
+// Upper bound for the in-memory DEM window (128 MB of floats). Larger
+// corridors are read at a coarser resolution.
+static const qint64 kMaxDemCells = 32 * 1024 * 1024;
+
+// Per-feature runs read one DEM window per flight being prepared; this caps
+// their sum (about 1 GB of floats with the pyramids), which in turn caps
+// how many flights are prepared at once
+static const qint64 kMaxDemBudgetCells = 4 * kMaxDemCells;
+
+// Densified paths get at most one vertex per DEM cell and at most this
+// many vertices; longer paths get a coarser minimum spacing
+static const double kMaxDensifiedVertices = 500000.0;
+
+// DEM read resolution: about one DEM cell per this many screen pixels at the
+// distance of the look-at point, for a view this wide. Finer detail than
+// that can't be seen from the camera, and coarser reads come from the
+// raster's overviews. Factors are powers of two to line up with overview
+// levels.
+static const double kScreenPixelsPerDemCell = 4.0;
+static const double kAssumedViewWidthPx = 1920.0;
+static const int kMaxDemOverviewFactor = 64;
+
+// Adaptive resampling still places a vertex at least this often (metres),
+// so terrain features narrower than a segment can't hide between samples
+static const double kMaxSampleSpacing = 250.0;
+
+// Preview: how much coarser the 3D view draws the terrain, as a factor on
+// the canvas's screen-space error and a divisor of its map tile size. Only
+// the drawing is coarser; the trajectory is computed from the same DEM
+// window as the full run's, and the two share their stages and caches.
+static const float kPreviewTerrainErrorScale = 4.0f;
+static const int kPreviewTileDivisor = 2;
+
+// Upper bound on waiting for 3D tiles to load. The wait normally ends as
+// soon as the scene goes quiet; this only caps very slow machines.
+static const int kSceneLoadTimeoutMs = 15000;
+
+// Offline render: quiet period after each camera move before a frame counts
+// as loaded, and how long to wait for the engine to hand back an image
+static const int kFrameSettleMs = 60;
+static const int kFrameCaptureTimeoutMs = 5000;
+
+static QgsRectangle pathExtent(const QList<QgsPointXY> &points) {
+  QgsRectangle extent;
+  extent.setMinimal();
+  for (const QgsPointXY &pt : points)
+    extent.combineExtentWith(pt.x(), pt.y());
+  return extent;
+}
+
+static void splitXY(const QList<QgsPointXY> &points, std::vector<double> &xs,
+                    std::vector<double> &ys) {
+  xs.resize(points.size());
+  ys.resize(points.size());
+  for (int i = 0; i < points.size(); ++i) {
+    xs[i] = points[i].x();
+    ys[i] = points[i].y();
+  }
+}
+
+static QList<QgsPointXY> joinXY(const std::vector<double> &xs,
+                                const std::vector<double> &ys) {
+  QList<QgsPointXY> points;
+  points.reserve(static_cast<int>(xs.size()));
+  for (size_t i = 0; i < xs.size(); ++i)
+    points.append(QgsPointXY(xs[i], ys[i]));
+  return points;
+}
+
 FlyThroughCore::FlyThroughCore(QgisInterface *iface, QObject *parent)
-    : QObject(parent), mIface(iface) {}
+    : QObject(parent), mIface(iface),
+      mCameraDispatch(new CameraDispatch(this)),
+      mPrefetcher(new TerrainPrefetcher(this)),
+      mKeyframeCache(KeyframeCache::defaultDirectory(
+          QgsApplication::qgisSettingsDirPath())) {}
+
+FlyThroughCore::~FlyThroughCore() {
+  if (mJobWatcher) {
+    mCancelRequested = true;
+    mJobWatcher->waitForFinished();
+  }
+  close3DCanvas();
+  if (mPlaybackDock) {
+    mIface->removeDockWidget(mPlaybackDock);
+    delete mPlaybackDock;
+  }
+}
 
-FlyThroughCore::~FlyThroughCore() { close3DCanvas(); }
+QgsCoordinateReferenceSystem FlyThroughCore::viewCrsForProject() {
+  // Geographic projects are flown in EPSG:3857
+  QgsCoordinateReferenceSystem projectCRS = QgsProject::instance()->crs();
+  if (projectCRS.isGeographic())
+    return QgsCoordinateReferenceSystem("EPSG:3857");
+  return projectCRS;
+}
 
 bool FlyThroughCore::generateFlythrough(const FlythroughParams &params) {
-  try {
-    // Validate inputs
-    if (!params.demLayer || !params.pathLayer) {
-      QMessageBox::warning(nullptr, "Missing Layers",
-                           "Please select both DEM and path layers.");
-      return false;
-    }
+  // A cancelled job keeps the core busy until its current step returns
+  if (isGenerating()) {
+    QMessageBox::information(
+        nullptr, "Flythrough Busy",
+        mCancelRequested
+            ? "The previous run is still stopping. Try again in a moment."
+            : "A flythrough is already being generated or rendered.");
+    return false;
+  }
 
-    // Extract path vertices
-    QList<QgsPointXY> vertices = extractPathVertices(params.pathLayer);
-    if (vertices.size() < 2) {
-      QMessageBox::warning(nullptr, "Invalid Path",
-                           "Path must have at least 2 vertices.");
+  // Validate inputs
+  if (!params.demLayer || !params.pathLayer) {
+    QMessageBox::warning(nullptr, "Missing Layers",
+                         "Please select both DEM and path layers.");
+    return false;
+  }
+
+  QgsRasterDataProvider *demProvider = params.demLayer->dataProvider();
+  if (!demProvider) {
+    QMessageBox::warning(nullptr, "Invalid DEM",
+                         "The DEM layer has no data provider.");
+    return false;
+  }
+
+  // A new run replaces the flight being played, which also reads mWork
+  stopAnimation();
+  watchLayers(params);
+
+  // Snapshot everything the job reads. Layers and the project must not be
+  // touched off the GUI thread, so the path is read through a feature
+  // source and the DEM through a cloned provider.
+  mPathSelection.clear();
+  mPathFeatureCount = params.pathLayer->featureCount();
+  if (params.selectedOnly) {
+    mPathSelection = params.pathLayer->selectedFeatureIds();
+    if (mPathSelection.isEmpty()) {
+      QMessageBox::warning(nullptr, "No Selection",
+                           "No features are selected in the path layer.");
       return false;
     }
+    mPathFeatureCount = mPathSelection.size();
+  }
 
-    qDebug() << "[FTP] Path has" << vertices.size() << "vertices";
+  mParams = params;
+  if (mParams.preview) {
+    // Nothing that shapes the trajectory changes, so every stage is shared
+    // with the full run; see kPreviewTerrainErrorScale
+    mParams.terrainShading = false;
+    mParams.exportFrames = false;
+  }
+  mPathSource.reset(new QgsVectorLayerFeatureSource(params.pathLayer));
+  mPathLayerId = params.pathLayer->id();
+  mPathLayerSource = params.pathLayer->source();
+  mPathCRS = params.pathLayer->crs();
+  mDemProvider.reset(demProvider->clone());
+  mDemExtent = mDemProvider->extent();
+  mDemWidth = mDemProvider->xSize();
+  mDemHeight = mDemProvider->ySize();
+  mDemSource = params.demLayer->source();
+  mEllipsoid = QgsProject::instance()->ellipsoid();
+  mProfileCache.setProjectHome(QgsProject::instance()->homePath(),
+                               QgsApplication::qgisSettingsDirPath());
+
+  // Transforms and the distance calculator are built once for the run
+  mWork.geo.setup(viewCrsForProject(), params.demLayer->crs(),
+                  QgsProject::instance()->transformContext(), mEllipsoid);
+
+  mCancelRequested = false;
+  mLastProgress = -1;
+  mJobWatcher = new QFutureWatcher<GenerationResult>(this);
+  connect(mJobWatcher, &QFutureWatcher<GenerationResult>::finished, this,
+          &FlyThroughCore::onGenerationFinished);
+  mJobWatcher->setFuture(
+      QtConcurrent::run([this]() { return runGeneration(); }));
+  return true;
+}
 
-    // Setup 3D canvas first (needed for CRS determination)
-    if (!setup3DCanvas(params, vertices.first())) {
-      return false;
+void FlyThroughCore::cancelGeneration() { mCancelRequested = true; }
+
+void FlyThroughCore::watchLayers(const FlythroughParams &params) {
+  if (mWatchedPathLayer.data() != params.pathLayer) {
+    disconnect(mPathLayerWatch);
+    mWatchedPathLayer = params.pathLayer;
+    mPathLayerWatch = connect(params.pathLayer, &QgsMapLayer::dataChanged,
+                              this, [this]() { ++mPathRevision; });
+  }
+  if (mWatchedDemLayer.data() != params.demLayer) {
+    disconnect(mDemLayerWatch);
+    mWatchedDemLayer = params.demLayer;
+    mDemLayerWatch = connect(params.demLayer, &QgsMapLayer::dataChanged,
+                             this, [this]() { ++mDemRevision; });
+  }
+}
+
+bool FlyThroughCore::reportProgress(int percent, const QString &stage) {
+  // Emitted from the worker; the dialog receives it queued on the GUI thread
+  if (mLastProgress.exchange(percent) != percent)
+    emit progressChanged(percent, stage);
+  return !mCancelRequested;
+}
+
+bool FlyThroughCore::stepProgress(const FlightWorkspace &work, int percent,
+                                  const QString &stage) {
+  if (work.reportsProgress)
+    return reportProgress(percent, stage);
+  return !mCancelRequested;
+}
+
+GenerationResult FlyThroughCore::runGeneration() {
+  GenerationResult result;
+  try {
+    std::vector<FeaturePath> paths = extractStage();
+    if (mCancelRequested) {
+      result.cancelled = true;
+      return result;
     }
 
-    // Transform vertices to View CRS
-    QgsCoordinateReferenceSystem viewCRS = mMapSettings3D->crs();
-    QgsCoordinateReferenceSystem pathCRS = params.pathLayer->crs();
+    if (!mParams.perFeature || paths.size() <= 1) {
+      // All features joined into one path, in layer order
+      FeaturePath path;
+      path.name = "flight";
+      for (const FeaturePath &feature : paths)
+        path.vertices.append(feature.vertices);
+      if (path.vertices.size() < 2) {
+        result.error = "Path must have at least 2 vertices.";
+        return result;
+      }
 
-    if (pathCRS != viewCRS) {
-      qDebug() << "[FTP] Transforming path from" << pathCRS.authid() << "to"
-               << viewCRS.authid();
-      QgsCoordinateTransform xform(pathCRS, viewCRS, QgsProject::instance());
-      for (int i = 0; i < vertices.size(); ++i) {
-        vertices[i] = xform.transform(vertices[i]);
+      // Stages of per-feature flights are dropped when flying joined
+      for (const QString &name : mStages.keys()) {
+        if (name != path.name)
+          mStages.remove(name);
       }
+
+      PreparedFlight flight;
+      flight.name = path.name;
+      mWork.demProvider = mDemProvider.get();
+      mWork.reportsProgress = true;
+      if (!prepareFlight(mWork, path.vertices, mStages[path.name], flight,
+                         result.error)) {
+        result.cancelled = mCancelRequested;
+        return result;
+      }
+      result.flights.push_back(std::move(flight));
+      return result;
     }
 
-    // Generate keyframes
-    generateKeyframes(vertices, params);
+    prepareFlights(paths, result);
+  } catch (const std::exception &e) {
+    result.error = QString("An error occurred: %1").arg(e.what());
+  }
+  return result;
+}
+
+std::vector<FlyThroughCore::FeaturePath> FlyThroughCore::extractStage() {
+  // Only a path layer backed by a local file can be reused: the file stamp
+  // catches edits made outside QGIS, which never bump mPathRevision.
+  // Databases and services are read again every run.
+  const QString pathStamp = sourceFileStamp(mPathLayerSource);
+  CacheKeyBuilder key;
+  key.add(mPathLayerId).add(static_cast<qint64>(mPathRevision.load()));
+  key.add(mPathLayerSource).add(pathStamp);
+  key.add(static_cast<qint64>(mParams.selectedOnly));
+  if (mParams.selectedOnly) {
+    QList<QgsFeatureId> ids = mPathSelection.values();
+    std::sort(ids.begin(), ids.end());
+    for (QgsFeatureId id : ids)
+      key.add(static_cast<qint64>(id));
+  }
+  const QByteArray signature = key.result();
+  if (!pathStamp.isEmpty() && signature == mExtractSignature) {
+    qDebug() << "[FTP] Path layer unchanged, reusing"
+             << mExtractedPaths.size() << "extracted paths";
+    reportProgress(30, "Extracting path");
+    return mExtractedPaths;
+  }
+
+  mExtractSignature.clear();
+  std::vector<FeaturePath> paths = extractPaths(mPathSource.get());
+  if (!mCancelRequested) {
+    mExtractedPaths = paths;
+    mExtractSignature = signature;
+  }
+  return paths;
+}
+
+bool FlyThroughCore::prepareFlight(FlightWorkspace &work,
+                                   const QList<QgsPointXY> &vertices,
+                                   FlightStages &stages, PreparedFlight &flight,
+                                   QString &error) {
+  qDebug() << "[FTP]" << flight.name << "has" << vertices.size()
+           << "vertices";
+  flight.startPoint = vertices.first();
+
+  // This run's signature for every stage. The first that differs from the
+  // stored one is dirty, and so is everything after it.
+  QByteArray signatures[FlightStages::StageCount];
+  for (int s = 0; s < FlightStages::StageCount; ++s) {
+    const FlightStages::Stage stage = static_cast<FlightStages::Stage>(s);
+    CacheKeyBuilder key;
+    if (s == 0) {
+      std::vector<double> xs, ys;
+      splitXY(vertices, xs, ys);
+      key.add(xs.data(), xs.size()).add(ys.data(), ys.size());
+    } else {
+      key.add(QString::fromLatin1(signatures[s - 1].toHex()));
+    }
+    addStageInputs(key, stage, work);
+    signatures[s] = key.result();
+  }
+  int dirty = 0;
+  while (dirty < FlightStages::StageCount &&
+         stages.signatures[dirty] == signatures[dirty])
+    ++dirty;
+
+  // The DEM window the Sample stage reads for this path, padded for the
+  // current look-ahead
+  CacheKeyBuilder windowKey;
+  windowKey.add(QString::fromLatin1(signatures[FlightStages::Sample].toHex()));
+  windowKey.add(demMargin());
+  const QByteArray window = windowKey.result();
+
+  if (dirty == FlightStages::StageCount) {
+    qDebug() << "[FTP]" << flight.name << "unchanged, every stage reused";
+  } else {
+    qDebug() << "[FTP]" << flight.name << "rerunning from the"
+             << FlightStages::stageName(
+                    static_cast<FlightStages::Stage>(dirty))
+             << "stage";
+  }
+  // A failed or cancelled run leaves them dirty
+  for (int s = dirty; s < FlightStages::StageCount; ++s)
+    stages.signatures[s].clear();
+
+  // Same path, DEM and settings as an earlier session: load the keyframes
+  // instead of running the expensive stages. The path is still transformed
+  // and smoothed, which is cheap, so the poses can read the DEM window.
+  QByteArray cacheKey;
+  bool keyframesCached = false;
+  if (dirty <= FlightStages::Sample) {
+    // No DEM window from an earlier flight may stand in for this one's
+    work.demPyramid.clear();
+    work.demGrid.clear();
+    work.demWindow.clear();
+
+    // DEM edits are only counted within the session, so keyframes read
+    // from an edited DEM never go to disk, where a later session could
+    // reach the same count
+    if (mParams.useKeyframeCache && mDemRevision == 0) {
+      cacheKey = keyframeCacheKey(signatures[FlightStages::Keyframes]);
+      QElapsedTimer timer;
+      timer.start();
+      if (mKeyframeCache.load(cacheKey, stages.keyframes)) {
+        qDebug() << "[FTP] Loaded" << stages.keyframes.size()
+                 << "cached keyframes in" << timer.elapsed() << "ms";
+        stepProgress(work, 100, "Loaded cached keyframes");
+        cacheKey.clear();
+        keyframesCached = true;
+      }
+    }
+  }
 
-    if (mKeyframes.empty()) {
-      QMessageBox::warning(nullptr, "Error", "Failed to generate keyframes.");
+  if (dirty <= FlightStages::Transform) {
+    runTransformStage(work, vertices, stages);
+    stages.signatures[FlightStages::Transform] =
+        signatures[FlightStages::Transform];
+  }
+  // Whether this path measures planar is decided on every run, reused
+  // stages or not: the workspace may have measured another flight last
+  work.geo.enablePlanarIfUniform(pathExtent(stages.viewVertices));
+  if (dirty <= FlightStages::Smooth) {
+    runSmoothStage(work, stages);
+    stages.signatures[FlightStages::Smooth] = signatures[FlightStages::Smooth];
+  }
+  if (dirty <= FlightStages::Sample && !keyframesCached) {
+    if (!runSampleStage(work, stages))
+      return false;
+    stages.signatures[FlightStages::Sample] = signatures[FlightStages::Sample];
+    if (work.demGrid.isValid())
+      work.demWindow = window;
+  }
+  if (dirty <= FlightStages::Keyframes && !keyframesCached) {
+    if (!runKeyframesStage(work, stages)) {
+      if (!mCancelRequested)
+        error = "Failed to generate keyframes.";
       return false;
     }
+    stages.signatures[FlightStages::Keyframes] =
+        signatures[FlightStages::Keyframes];
+    if (!cacheKey.isEmpty())
+      mKeyframeCache.store(cacheKey, stages.keyframes);
+  }
+  if (dirty <= FlightStages::Poses) {
+    // The poses are baked against the terrain around the look-ahead
+    // targets. Keyframes from the cache, a profile from the profile cache
+    // and stages kept from an earlier run come without that window, so it
+    // is read here the way the Sample stage reads it: the baked views are
+    // the same as a fresh run's.
+    if (work.demWindow != window || !work.demGrid.isValid()) {
+      if (loadDemGrid(work, joinXY(stages.smoothXs, stages.smoothYs),
+                      demMargin()))
+        work.demWindow = window;
+      if (mCancelRequested)
+        return false;
+    }
+    runPosesStage(work, stages);
+    stages.signatures[FlightStages::Poses] = signatures[FlightStages::Poses];
+  }
+
+  flight.keyframes = stages.poses;
+  flight.spline = stages.spline;
+  flight.poses = stages.frames;
+  stepProgress(work, 100, "Done");
+  return true;
+}
+
+void FlyThroughCore::addStageInputs(CacheKeyBuilder &key,
+                                    FlightStages::Stage stage,
+                                    const FlightWorkspace &work) const {
+  switch (stage) {
+  case FlightStages::Transform:
+    key.add(mPathCRS.toWkt()).add(work.geo.viewCrs().toWkt());
+    break;
+  case FlightStages::Smooth:
+    // The ellipsoid converts both tolerances from metres
+    key.add(mEllipsoid);
+    key.add(mParams.simplifyTolerance).add(mParams.smoothingSigma);
+    break;
+  case FlightStages::Sample:
+    addDemIdentity(key);
+    key.add(static_cast<qint64>(mDemRevision.load()));
+    key.add(mParams.samplingTolerance);
+    // Without adaptive sampling only terrain following densifies
+    key.add(static_cast<qint64>(trajectoryParams(mParams).altitudeMode ==
+                                AltitudeMode::TerrainFollow));
+    // Camera height, look-ahead and field of view only matter through the
+    // read resolution they give
+    key.add(static_cast<qint64>(demOverviewFactor(work)));
+    break;
+  case FlightStages::Keyframes:
+    key.add(mParams.altitudeMode).add(mParams.cameraHeight);
+    key.add(mParams.verticalExaggeration).add(mParams.speed);
+    key.add(static_cast<qint64>(mParams.enableBanking));
+    key.add(mParams.bankingFactor);
+    key.add(mParams.followWindow).add(mParams.maxGrade);
+    break;
+  case FlightStages::Poses:
+    key.add(mParams.cameraPitch).add(static_cast<qint64>(mParams.fps));
+    key.add(mParams.lookaheadDistance).add(mParams.cameraHeight);
+    break;
+  case FlightStages::StageCount:
+    break;
+  }
+}
+
+void FlyThroughCore::addDemIdentity(CacheKeyBuilder &key) const {
+  // Source, file stamp when it is a local file, and the raster's footprint
+  // and size
+  key.add(mDemSource).add(sourceFileStamp(mDemSource));
+  key.add(mWork.geo.demCrs().toWkt());
+  key.add(mDemExtent.xMinimum()).add(mDemExtent.yMinimum());
+  key.add(mDemExtent.xMaximum()).add(mDemExtent.yMaximum());
+  key.add(static_cast<qint64>(mDemWidth)).add(static_cast<qint64>(mDemHeight));
+}
+
+const char *FlightStages::stageName(Stage stage) {
+  switch (stage) {
+  case Transform:
+    return "transform";
+  case Smooth:
+    return "smooth";
+  case Sample:
+    return "sample";
+  case Keyframes:
+    return "keyframes";
+  case Poses:
+    return "poses";
+  case StageCount:
+    break;
+  }
+  return "";
+}
+
+void FlyThroughCore::prepareFlights(const std::vector<FeaturePath> &paths,
+                                    GenerationResult &result) {
+  // Each flight reads its own DEM window; the shared workspace keeps none
+  mWork.demPyramid.clear();
+  mWork.demGrid.clear();
+  mWork.demWindow.clear();
+
+  // Every flight's stages exist before the pool starts, so the tasks only
+  // look them up; stages of features no longer flown are dropped
+  QSet<QString> names;
+  for (const FeaturePath &path : paths)
+    names.insert(path.name);
+  for (const QString &name : mStages.keys()) {
+    if (!names.contains(name))
+      mStages.remove(name);
+  }
+  std::vector<FlightStages *> stages(paths.size());
+  for (size_t i = 0; i < paths.size(); ++i)
+    stages[i] = &mStages[paths[i].name];
+
+  const int total = static_cast<int>(paths.size());
+  std::vector<PreparedFlight> flights(paths.size());
+  std::vector<QString> errors(paths.size());
+  std::atomic<int> finished{0};
+
+  // Every flight's cache entries must survive the rest of the batch, but
+  // only this batch: the default limit is restored once the pool is done
+  mKeyframeCache.setMaxEntries(total);
+  mProfileCache.setMaxEntries(total);
+
+  const auto prepareOne = [&](int index) {
+    const FeaturePath &path = paths[index];
+    PreparedFlight &flight = flights[index];
+    flight.name = path.name;
+    if (mCancelRequested || path.vertices.size() < 2)
+      return;
+
+    FlightWorkspace work;
+    work.geo = mWork.geo;
+    work.reportsProgress = false;
+    std::unique_ptr<QgsRasterDataProvider> provider;
+    {
+      std::lock_guard<std::mutex> lock(mProviderMutex);
+      provider.reset(mDemProvider->clone());
+    }
+    work.demProvider = provider.get();
+    try {
+      prepareFlight(work, path.vertices, *stages[index], flight,
+                    errors[index]);
+    } catch (const std::exception &e) {
+      // Exceptions must not leave a pool thread
+      flight.keyframes.clear();
+      errors[index] = QString("An error occurred: %1").arg(e.what());
+    }
 
-    // Setup animation
-    setupAnimation(params);
+    const int done = ++finished;
+    reportProgress(30 + (70 * done) / total,
+                   QString("Prepared %1 of %2 flights").arg(done).arg(total));
+  };
+
+  // A pool of its own, as wide as the DEM budget allows: each flight holds
+  // a window of up to kMaxDemCells while it is prepared
+  const int threads =
+      qBound(1, static_cast<int>(kMaxDemBudgetCells / kMaxDemCells),
+             qMin(QThread::idealThreadCount(), total));
+  qDebug() << "[FTP] Preparing" << total << "flights on" << threads
+           << "threads";
+  reportProgress(30, QString("Preparing %1 flights").arg(total));
+
+  QThreadPool pool;
+  pool.setMaxThreadCount(threads);
+  std::atomic<int> next{0};
+  for (int t = 0; t < threads; ++t) {
+    QtConcurrent::run(&pool, [&]() {
+      for (int index = next++; index < total; index = next++)
+        prepareOne(index);
+    });
+  }
+  pool.waitForDone();
+  mKeyframeCache.setMaxEntries(kDefaultCacheEntries);
+  mProfileCache.setMaxEntries(kDefaultCacheEntries);
 
-    mIface->messageBar()->pushMessage("Flythrough Pro",
-                                      "Animation started – watch the 3D view!",
-                                      Qgis::MessageLevel::Info, 5);
+  if (mCancelRequested) {
+    result.cancelled = true;
+    return;
+  }
 
-    return true;
+  for (size_t i = 0; i < flights.size(); ++i) {
+    if (flights[i].keyframes.empty()) {
+      qDebug() << "[FTP] Skipping" << flights[i].name
+               << (errors[i].isEmpty() ? QString("(fewer than 2 vertices)")
+                                       : errors[i]);
+      ++result.skipped;
+      continue;
+    }
+    result.flights.push_back(std::move(flights[i]));
+  }
+  if (result.flights.empty())
+    result.error = "No feature of the path layer gave a flight.";
+  qDebug() << "[FTP] Prepared" << result.flights.size() << "flights,"
+           << result.skipped << "skipped";
+}
 
-  } catch (const std::exception &e) {
-    QMessageBox::critical(nullptr, "Error",
-                          QString("An error occurred: %1").arg(e.what()));
+QByteArray
+FlyThroughCore::keyframeCacheKey(const QByteArray &keyframesSignature) const {
+  // The Keyframes stage's signature already covers the path, the DEM and
+  // every setting up to that stage, so the disk cache is invalidated by the
+  // same rule as the stages kept in memory. Bump the tag whenever keyframe
+  // generation changes its output.
+  CacheKeyBuilder key;
+  key.add(QString("keyframes-4"));
+  key.add(QString::fromLatin1(keyframesSignature.toHex()));
+  return key.result();
+}
+
+void FlyThroughCore::onGenerationFinished() {
+  GenerationResult result = mJobWatcher->result();
+  mJobWatcher->deleteLater();
+  mJobWatcher = nullptr;
+  mPathSource.reset();
+  mDemProvider.reset();
+
+  if (result.cancelled) {
+    qDebug() << "[FTP] Generation cancelled.";
+    emit generationFinished(false);
+    return;
+  }
+
+  if (!result.error.isEmpty()) {
+    QMessageBox::warning(nullptr, "Error", result.error);
+    emit generationFinished(false);
+    return;
+  }
+
+  // Keyframes only cross back to the GUI thread here, for playback
+  mFlights = std::move(result.flights);
+  mFlightIndex = 0;
+  if (result.skipped > 0) {
+    mIface->messageBar()->pushMessage(
+        "Flythrough Pro",
+        QString("%1 path features skipped: fewer than 2 vertices or no "
+                "keyframes")
+            .arg(result.skipped),
+        Qgis::MessageLevel::Warning, 5);
+  }
+  if (!loadFlight(0)) {
+    QMessageBox::warning(nullptr, "Error",
+                         "Path has no length after processing.");
+    emit generationFinished(false);
+    return;
+  }
+
+  // Setup 3D canvas and animation. Later flights reuse the same canvas and
+  // start with a jump to their first pose.
+  if (!setup3DCanvas(mParams, mFlights.front().startPoint)) {
+    emit generationFinished(false);
+    return;
+  }
+
+  if (mParams.exportFrames) {
+    emit generationFinished(renderFlights(mParams));
+    return;
+  }
+
+  setupAnimation(mParams);
+
+  mIface->messageBar()->pushMessage(
+      "Flythrough Pro",
+      mFlights.size() > 1
+          ? QString("%1 started – %2 flights in sequence")
+                .arg(mParams.preview ? "Preview" : "Animation")
+                .arg(mFlights.size())
+          : QString("%1 started – watch the 3D view!")
+                .arg(mParams.preview ? "Preview" : "Animation"),
+      Qgis::MessageLevel::Info, 5);
+  emit generationFinished(true);
+}
+
+bool FlyThroughCore::loadFlight(size_t index) {
+  if (index >= mFlights.size() || mFlights[index].keyframes.empty())
     return false;
+  mKeyframes = mFlights[index].keyframes;
+  mTotalDuration = mKeyframes.back().time;
+  mSpline = mFlights[index].spline;
+  mPoses = mFlights[index].poses;
+  return mSpline.isValid() && !mPoses.empty();
+}
+
+void FlyThroughCore::playNextFlight() {
+  while (++mFlightIndex < mFlights.size()) {
+    if (loadFlight(mFlightIndex)) {
+      qDebug() << "[FTP] Playing" << mFlights[mFlightIndex].name << "("
+               << mFlightIndex + 1 << "of" << mFlights.size() << ")";
+      setupAnimation(mParams);
+      return;
+    }
+  }
+}
+
+bool FlyThroughCore::renderFlights(const FlythroughParams &params) {
+  // A lone flight goes straight into the export directory, several into one
+  // subfolder each
+  if (mFlights.size() == 1)
+    return renderOffline(params, params.exportDirectory);
+
+  const QDir root(params.exportDirectory);
+  for (size_t i = 0; i < mFlights.size(); ++i) {
+    const PreparedFlight &flight = mFlights[i];
+    if (!loadFlight(i))
+      continue;
+    qDebug() << "[FTP] Rendering" << flight.name << "(" << i + 1 << "of"
+             << mFlights.size() << ")";
+    if (!renderOffline(params, root.filePath(flight.name)))
+      return false;
   }
+  return true;
 }
 
 void FlyThroughCore::stopAnimation() {
+  // Also ends a sequence of flights
+  mFlightIndex = mFlights.size();
+  mPrefetcher->stop();
+  // Paused flights too; one that finished has reported already
+  reportFrameStats();
   if (mAnimTimer) {
     mAnimTimer->stop();
     mAnimTimer->deleteLater();
@@ -147,11 +803,8 @@ bool FlyThroughCore::setup3DCanvas(const FlythroughParams &params,
     return false;
   }
 
-  // Let scene initialize
-  for (int i = 0; i < 20; ++i) {
-    QApplication::processEvents();
-    QThread::msleep(50);
-  }
+  // Let the canvas construct its scene (no tiles to wait for yet)
+  QApplication::processEvents();
 
   // Get settings via dynamic call (Qgs3DMapCanvas::mapSettings() may not be
   // exported in 3.28.3 - access via Qt's meta-object system or property)
@@ -180,18 +833,14 @@ bool FlyThroughCore::setup3DCanvas(const FlythroughParams &params,
   // headers) and 3.28.3 (user DLL) causing 6 unresolved symbol link errors.
   // Terrain still works because:
   //   - findExisting3DCanvas() reuses user's canvas that already has terrain
-  //   - New canvases use flat terrain (DEM used for elevation via sample())
+  //   - New canvases use flat terrain (DEM used for elevation via DemGrid)
   mMapSettings3D->setTerrainVerticalScale(params.verticalExaggeration);
 
-  // CRS handling
+  // CRS handling - must match the CRS the keyframes were generated in
   QgsCoordinateReferenceSystem projectCRS = QgsProject::instance()->crs();
+  mMapSettings3D->setCrs(viewCrsForProject());
   if (projectCRS.isGeographic()) {
-    // Force EPSG:3857 for geographic projects
-    QgsCoordinateReferenceSystem mercator("EPSG:3857");
-    mMapSettings3D->setCrs(mercator);
     qDebug() << "[FTP] Project is Geographic, setting 3D View to EPSG:3857";
-  } else {
-    mMapSettings3D->setCrs(projectCRS);
   }
 
   // Set origin (transform start point if needed)
@@ -204,11 +853,19 @@ bool FlyThroughCore::setup3DCanvas(const FlythroughParams &params,
 
   mMapSettings3D->setOrigin(QgsVector3D(origin.x(), origin.y(), 0));
 
-  // Layers (setExtent removed - not in QGIS 3.28.3 Qgs3DMapSettings API)
-  QList<QgsMapLayer *> layers =
-      QgsProject::instance()->layerTreeRoot()->layerOrder();
-  if (params.overlayLayer && !layers.contains(params.overlayLayer)) {
-    layers.append(params.overlayLayer);
+  // Layers (setExtent removed - not in QGIS 3.28.3 Qgs3DMapSettings API).
+  // A preview draws one layer: the overlay, or else the DEM itself.
+  QList<QgsMapLayer *> layers;
+  if (params.preview) {
+    if (params.overlayLayer)
+      layers.append(params.overlayLayer);
+    else if (params.demLayer)
+      layers.append(params.demLayer);
+  } else {
+    layers = QgsProject::instance()->layerTreeRoot()->layerOrder();
+    if (params.overlayLayer && !layers.contains(params.overlayLayer)) {
+      layers.append(params.overlayLayer);
+    }
   }
   mMapSettings3D->setLayers(layers);
 
@@ -216,17 +873,36 @@ bool FlyThroughCore::setup3DCanvas(const FlythroughParams &params,
   mMapSettings3D->setTerrainShadingEnabled(params.terrainShading);
   mMapSettings3D->setFieldOfView(params.fieldOfView);
 
+  // A preview draws the terrain from coarser, smaller tiles; the next full
+  // run puts the canvas's own detail back
+  if (params.preview) {
+    if (!mTerrainCoarsened) {
+      mSavedTerrainScreenError = mMapSettings3D->maxTerrainScreenError();
+      mSavedMapTileResolution = mMapSettings3D->mapTileResolution();
+      mTerrainCoarsened = true;
+    }
+    mMapSettings3D->setMaxTerrainScreenError(mSavedTerrainScreenError *
+                                             kPreviewTerrainErrorScale);
+    mMapSettings3D->setMapTileResolution(
+        qMax(1, mSavedMapTileResolution / kPreviewTileDivisor));
+  } else if (mTerrainCoarsened) {
+    mMapSettings3D->setMaxTerrainScreenError(mSavedTerrainScreenError);
+    mMapSettings3D->setMapTileResolution(mSavedMapTileResolution);
+    mTerrainCoarsened = false;
+  }
+
   // Show canvas
   mCanvas3D->resize(1280, 720);
   mCanvas3D->show();
 
   qDebug() << "[FTP] 3D Canvas initialized. Origin:" << origin.toString();
 
-  // Let terrain tiles load
-  for (int i = 0; i < 40; ++i) {
-    QApplication::processEvents();
-    QThread::msleep(50);
-  }
+  // Let terrain tiles load; a preview starts moving while they do
+  if (!params.preview)
+    SceneReadiness(mCanvas3D).waitUntilReady(kSceneLoadTimeoutMs);
+
+  // Resolve the camera controller once for this canvas
+  mCameraDispatch->attach(mCanvas3D);
 
   mProjectCRS = mMapSettings3D->crs();
   return true;
@@ -252,12 +928,15 @@ QWidget *FlyThroughCore::findExisting3DCanvas() {
 }
 
 void FlyThroughCore::close3DCanvas() {
+  mPrefetcher->stop();
   if (mAnimTimer) {
     mAnimTimer->stop();
     mAnimTimer->deleteLater();
     mAnimTimer = nullptr;
   }
 
+  mCameraDispatch->reset();
+
   if (mCanvas3D) {
     qDebug() << "[FTP] Closing 3D canvas...";
     mCanvas3D->close();
@@ -270,13 +949,32 @@ void FlyThroughCore::close3DCanvas() {
   }
 }
 
-QList<QgsPointXY> FlyThroughCore::extractPathVertices(QgsVectorLayer *layer) {
-  QList<QgsPointXY> vertices;
-
-  QgsFeatureIterator it = layer->getFeatures();
+std::vector<FlyThroughCore::FeaturePath>
+FlyThroughCore::extractPaths(QgsAbstractFeatureSource *source) {
+  std::vector<FeaturePath> paths;
+  if (!source)
+    return paths;
+
+  QgsFeatureRequest request;
+  request.setNoAttributes();
+  if (mParams.selectedOnly)
+    request.setFilterFids(mPathSelection);
+  QgsFeatureIterator it = source->getFeatures(request);
   QgsFeature feature;
+  long long featureIndex = 0;
 
   while (it.nextFeature(feature)) {
+    ++featureIndex;
+    if (mPathFeatureCount > 0) {
+      const int percent =
+          static_cast<int>(30 * qMin(1.0, double(featureIndex) /
+                                              double(mPathFeatureCount)));
+      if (!reportProgress(percent, "Extracting path"))
+        break;
+    } else if (mCancelRequested) {
+      break;
+    }
+
     QgsGeometry geom = feature.geometry();
     if (geom.isNull() || !geom.get())
       continue;
@@ -292,245 +990,467 @@ QList<QgsPointXY> FlyThroughCore::extractPathVertices(QgsVectorLayer *layer) {
         gtype.startsWith(QLatin1String("MultiPoint"), Qt::CaseInsensitive);
 
     if (isLine || isPoint) {
+      FeaturePath path;
+      path.name = QString("feature_%1").arg(feature.id());
       // vertices() iterator is stable across all QGIS 3.x versions
       for (auto vit = geom.vertices_begin(); vit != geom.vertices_end(); ++vit)
-        vertices.append(QgsPointXY((*vit).x(), (*vit).y()));
+        path.vertices.append(QgsPointXY((*vit).x(), (*vit).y()));
+      paths.push_back(std::move(path));
     }
   }
 
-  return vertices;
+  return paths;
 }
 
-QList<QgsPointXY> FlyThroughCore::densifyPath(const QList<QgsPointXY> &vertices,
-                                              double interval) {
-  if (vertices.size() < 2)
-    return vertices;
-
-  QList<QgsPointXY> dense;
-  dense.append(vertices.first());
-
-  for (int i = 0; i < vertices.size() - 1; ++i) {
-    const QgsPointXY &p1 = vertices[i];
-    const QgsPointXY &p2 = vertices[i + 1];
-
-    double dist = calculateDistance(p1, p2);
-    if (dist <= interval) {
-      dense.append(p2);
-      continue;
-    }
-
-    int numSegments = static_cast<int>(std::ceil(dist / interval));
-    double dx = (p2.x() - p1.x()) / numSegments;
-    double dy = (p2.y() - p1.y()) / numSegments;
-
-    for (int j = 1; j <= numSegments; ++j) {
-      dense.append(QgsPointXY(p1.x() + dx * j, p1.y() + dy * j));
-    }
+void FlyThroughCore::runTransformStage(FlightWorkspace &work,
+                                       const QList<QgsPointXY> &vertices,
+                                       FlightStages &stages) {
+  stepProgress(work, 30, "Transforming path");
+  stages.viewVertices = vertices;
+  const QgsCoordinateReferenceSystem &viewCRS = work.geo.viewCrs();
+  if (mPathCRS != viewCRS) {
+    qDebug() << "[FTP] Transforming path from" << mPathCRS.authid() << "to"
+             << viewCRS.authid();
+    work.geo.toView(mPathCRS, stages.viewVertices);
   }
-
-  return dense;
 }
 
-QList<QgsPointXY> FlyThroughCore::smoothPath(const QList<QgsPointXY> &vertices,
-                                             int iterations) {
-  if (iterations <= 0 || vertices.size() < 3)
-    return vertices;
-
-  QList<QgsPointXY> smoothed = vertices;
-
-  for (int iter = 0; iter < iterations; ++iter) {
-    QList<QgsPointXY> newSmoothed;
-    newSmoothed.append(smoothed.first()); // Keep first
-
-    for (int i = 1; i < smoothed.size() - 1; ++i) {
-      double newX =
-          (smoothed[i - 1].x() + smoothed[i].x() + smoothed[i + 1].x()) / 3.0;
-      double newY =
-          (smoothed[i - 1].y() + smoothed[i].y() + smoothed[i + 1].y()) / 3.0;
-      newSmoothed.append(QgsPointXY(newX, newY));
-    }
-
-    newSmoothed.append(smoothed.last()); // Keep last
-    smoothed = newSmoothed;
+void FlyThroughCore::runSmoothStage(FlightWorkspace &work,
+                                    FlightStages &stages) {
+  std::vector<double> &xs = stages.smoothXs;
+  std::vector<double> &ys = stages.smoothYs;
+  splitXY(stages.viewVertices, xs, ys);
+
+  // Thin out dense recordings so keyframe count follows the shape of the
+  // path rather than the logging rate
+  if (mParams.simplifyTolerance > 0.0) {
+    stepProgress(work, 32, "Simplifying path");
+    const size_t before = xs.size();
+    simplifyPath(xs, ys,
+                 mParams.simplifyTolerance *
+                     work.geo.mapUnitsPerMetre(
+                         pathExtent(stages.viewVertices)));
+    qDebug() << "[FTP] Simplified path from" << before << "to" << xs.size()
+             << "vertices";
   }
 
-  return smoothed;
+  // Smooth path if requested. Works on the coordinate arrays in place; the
+  // sigma is converted from metres to view-CRS units.
+  stepProgress(work, 35, "Smoothing path");
+  if (mParams.smoothingSigma > 0.0) {
+    const double unitsPerMetre =
+        work.geo.mapUnitsPerMetre(pathExtent(joinXY(xs, ys)));
+    smoothPath(xs, ys, mParams.smoothingSigma * unitsPerMetre,
+               work.smoothScratch);
+  }
 }
 
-void FlyThroughCore::generateKeyframes(const QList<QgsPointXY> &inputVertices,
-                                       const FlythroughParams &params) {
-  mKeyframes.clear();
-
-  // Smooth path if requested
-  QList<QgsPointXY> vertices = smoothPath(inputVertices, params.smoothing);
-
-  // Find max elevation for "Above Safe Path" mode
-  double maxElev = -9999.0;
-  QList<QgsPointXY> densePoints = densifyPath(vertices, 2.0);
+bool FlyThroughCore::runSampleStage(FlightWorkspace &work,
+                                    FlightStages &stages) {
+  std::vector<double> xs = stages.smoothXs;
+  std::vector<double> ys = stages.smoothYs;
+
+  // Vertices where the terrain and the turns need them. The samples depend
+  // on the terrain, so the DEM window is read first.
+  const TrajectoryParams trajectory = trajectoryParams(mParams);
+  const double margin = demMargin();
+  const QgsRectangle extent = pathExtent(stages.viewVertices);
+  double length = 0.0;
+  for (size_t i = 1; i < xs.size(); ++i)
+    length += std::hypot(xs[i] - xs[i - 1], ys[i] - ys[i - 1]);
+  const double minSpacing =
+      std::max(demCellSizeInView(work, extent) * demOverviewFactor(work),
+               length / kMaxDensifiedVertices);
+
+  // Same path, DEM file and resampling as before: the cached profile holds
+  // the resampled vertices too, so the DEM isn't read for this stage. The
+  // window around the path is still read if the poses are baked, for the
+  // terrain at the look-ahead targets.
+  const QByteArray profileKey = profileCacheKey(work, xs, ys, minSpacing);
+  if (!profileKey.isEmpty() && mProfileCache.load(profileKey, stages.profile) &&
+      stages.profile.xs.size() >= 2) {
+    qDebug() << "[FTP] Elevation profile loaded from"
+             << mProfileCache.filePath(profileKey);
+    stages.sampleXs = stages.profile.xs;
+    stages.sampleYs = stages.profile.ys;
+    return true;
+  }
 
-  for (const QgsPointXY &pt : densePoints) {
-    double elev = getElevationAtPoint(params.demLayer, pt, mProjectCRS);
-    if (elev > maxElev) {
-      maxElev = elev;
+  if (!stepProgress(work, 40, "Reading DEM"))
+    return false;
+  if (mParams.samplingTolerance > 0.0) {
+    if (loadDemGrid(work, joinXY(xs, ys), margin)) {
+      stepProgress(work, 70, "Resampling path");
+      const double unitsPerMetre = work.geo.mapUnitsPerMetre(extent);
+      AdaptiveSampling sampling;
+      sampling.verticalTolerance = mParams.samplingTolerance;
+      sampling.lateralTolerance = mParams.samplingTolerance * unitsPerMetre;
+      sampling.minSpacing = minSpacing;
+      sampling.maxSpacing =
+          std::max(minSpacing, kMaxSampleSpacing * unitsPerMetre);
+      const HeightFunction height = [&work](double x, double y) {
+        work.geo.viewToDem(x, y);
+        return work.demGrid.sample(x, y,
+                                   std::numeric_limits<double>::quiet_NaN());
+      };
+
+      std::vector<double> sampledXs, sampledYs;
+      const size_t samples = densifyPathAdaptive(xs, ys, height, sampling,
+                                                 sampledXs, sampledYs);
+      qDebug() << "[FTP] Resampled path from" << xs.size() << "to"
+               << sampledXs.size() << "vertices," << samples
+               << "terrain samples";
+      xs.swap(sampledXs);
+      ys.swap(sampledYs);
+    }
+    if (mCancelRequested)
+      return false;
+  } else if (trajectory.altitudeMode == AltitudeMode::TerrainFollow) {
+    // Terrain following takes its clearance from the profile, so the
+    // profile must see the terrain between vertices too
+    if (minSpacing > 0.0) {
+      std::vector<double> denseXs, denseYs;
+      densifyPath(xs, ys, minSpacing, denseXs, denseYs);
+      qDebug() << "[FTP] Densified path from" << xs.size() << "to"
+               << denseXs.size() << "vertices for terrain following";
+      xs.swap(denseXs);
+      ys.swap(denseYs);
     }
   }
 
-  if (maxElev == -9999.0) {
-    maxElev = 0.0;
-  }
+  stages.profile = elevationProfile(work, joinXY(xs, ys), xs, ys, margin);
+  if (mCancelRequested)
+    return false;
+  // A DEM that couldn't be read gives an all-zero profile; don't keep it
+  if (!profileKey.isEmpty() && work.demGrid.isValid())
+    mProfileCache.store(profileKey, stages.profile);
+  stages.sampleXs.swap(xs);
+  stages.sampleYs.swap(ys);
+  return true;
+}
 
-  double maxElevScaled = maxElev * params.verticalExaggeration;
+bool FlyThroughCore::runKeyframesStage(FlightWorkspace &work,
+                                       FlightStages &stages) {
+  const TrajectoryParams trajectory = trajectoryParams(mParams);
+  const ElevationProfile &profile = stages.profile;
+  const double maxElev = std::isnan(profile.peak) ? 0.0 : profile.peak;
   qDebug() << "[FTP] Path Max Elevation:" << maxElev
-           << "Scaled:" << maxElevScaled;
+           << "Scaled:" << maxElev * mParams.verticalExaggeration;
 
-  // Calculate fixed Z based on altitude mode
-  double autoFixedZ = 0.0;
-  double userFixedAMSL = 0.0;
+  if (trajectory.altitudeMode == AltitudeMode::FixedAmsl &&
+      mParams.cameraHeight < maxElev) {
+    qDebug() << "[FTP] WARNING: User AMSL lower than terrain peak!";
+  }
 
-  if (params.altitudeMode.contains("Safe Path")) {
-    autoFixedZ = (maxElev + params.cameraHeight) * params.verticalExaggeration;
-    qDebug() << "[FTP] Mode 'Safe Path': Fixed Z =" << autoFixedZ;
-  } else if (params.altitudeMode.contains("Fixed")) {
-    userFixedAMSL = params.cameraHeight * params.verticalExaggeration;
-    qDebug() << "[FTP] Mode 'Fixed AMSL': Z =" << userFixedAMSL;
+  std::vector<Keyframe> &keyframes = stages.keyframes;
+  keyframes = ::generateKeyframes(
+      stages.sampleXs.data(), stages.sampleYs.data(),
+      profile.distances.data(), profile.elevations.data(),
+      stages.sampleXs.size(), profile.peak, trajectory,
+      [this, &work](double fraction) {
+        return stepProgress(work, 70 + static_cast<int>(30 * fraction),
+                            "Generating keyframes");
+      });
+  if (mCancelRequested)
+    keyframes.clear();
+  if (keyframes.empty())
+    return false;
 
-    if (userFixedAMSL < maxElevScaled) {
-      qDebug() << "[FTP] WARNING: User AMSL lower than terrain peak!";
-    }
+  const Keyframe &first = keyframes.front();
+  const Keyframe &last = keyframes.back();
+  qDebug() << QString("[FTP] Keyframes: start=(%1, %2) z=%3, end=(%4, %5) "
+                      "z=%6")
+                  .arg(first.x, 0, 'f', 1)
+                  .arg(first.y, 0, 'f', 1)
+                  .arg(first.z, 0, 'f', 1)
+                  .arg(last.x, 0, 'f', 1)
+                  .arg(last.y, 0, 'f', 1)
+                  .arg(last.z, 0, 'f', 1);
+  qDebug() << "[FTP] Generated" << keyframes.size()
+           << "keyframes, duration:" << last.time << "s";
+  return true;
+}
+
+void FlyThroughCore::runPosesStage(FlightWorkspace &work,
+                                   FlightStages &stages) {
+  // The pitch is the one camera setting the keyframes carry; it is applied
+  // here so that changing it leaves the keyframes alone
+  stages.poses = stages.keyframes;
+  for (Keyframe &kf : stages.poses)
+    kf.pitch = mParams.cameraPitch;
+  stages.spline.build(stages.poses);
+
+  // Every frame's view is worked out here, off the GUI thread, so that a
+  // playback tick only looks one up. The terrain at the look-at points
+  // comes from the DEM window prepareFlight read. Nodata, points off the
+  // window and a DEM that can't be read are left NaN for bakePoses, which
+  // uses the spline's ground_z there, as flythrough_bake does. The DEM
+  // holds unexaggerated heights while the keyframes are in scene units, so
+  // the samples are scaled the way flythrough_bake scales them.
+  TerrainBatchSampler terrain;
+  if (work.demGrid.isValid()) {
+    const double scale = mParams.verticalExaggeration;
+    terrain = [this, &work, scale](const double *xs, const double *ys,
+                                   double *zs, size_t count) {
+      const std::vector<double> elevations = sampleElevations(
+          work, std::vector<double>(xs, xs + count),
+          std::vector<double>(ys, ys + count),
+          std::numeric_limits<double>::quiet_NaN());
+      for (size_t i = 0; i < count; ++i)
+        zs[i] = elevations[i] * scale;
+    };
   }
+  QElapsedTimer timer;
+  timer.start();
+  bakePoses(stages.spline, qMax(1, mParams.fps), mParams.cameraHeight,
+            mParams.lookaheadDistance, terrain, stages.frames);
+  qDebug() << "[FTP] Baked" << stages.frames.size() << "camera poses in"
+           << timer.elapsed() << "ms";
+}
 
-  // Generate keyframes
-  double currentTime = 0.0;
-  double previousBearing = 0.0;
+TrajectoryParams
+FlyThroughCore::trajectoryParams(const FlythroughParams &params) {
+  TrajectoryParams trajectory;
+  if (params.altitudeMode.contains("Safe Path"))
+    trajectory.altitudeMode = AltitudeMode::SafePath;
+  else if (params.altitudeMode.contains("Fixed"))
+    trajectory.altitudeMode = AltitudeMode::FixedAmsl;
+  else if (params.altitudeMode.contains("Terrain Following"))
+    trajectory.altitudeMode = AltitudeMode::TerrainFollow;
+  else
+    trajectory.altitudeMode = AltitudeMode::AboveTerrain;
+  trajectory.cameraHeight = params.cameraHeight;
+  trajectory.cameraPitch = params.cameraPitch;
+  trajectory.verticalExaggeration = params.verticalExaggeration;
+  trajectory.speed = params.speed;
+  trajectory.enableBanking = params.enableBanking;
+  trajectory.bankingFactor = params.bankingFactor;
+  trajectory.followWindow = params.followWindow;
+  trajectory.maxClimbGrade = params.maxGrade;
+  trajectory.maxDescentGrade = params.maxGrade;
+  return trajectory;
+}
 
-  for (int i = 0; i < vertices.size(); ++i) {
-    const QgsPointXY &point = vertices[i];
+double FlyThroughCore::demCellSizeMetres(const FlightWorkspace &work) const {
+  if (mDemWidth <= 0 || mDemHeight <= 0)
+    return 0.0;
+  const double cell = std::min(mDemExtent.width() / mDemWidth,
+                               mDemExtent.height() / mDemHeight);
+  // Good enough for sampling intervals and read resolutions: degrees at the
+  // equator for geographic DEMs, metres for projected ones
+  return work.geo.demCrs().isGeographic() ? cell * 111320.0 : cell;
+}
 
-    // Get elevation
-    double elevation = getElevationAtPoint(params.demLayer, point, mProjectCRS);
-    double scaledElevation = elevation * params.verticalExaggeration;
+double FlyThroughCore::demCellSizeInView(const FlightWorkspace &work,
+                                         const QgsRectangle &area) const {
+  if (mDemWidth <= 0 || mDemHeight <= 0)
+    return 0.0;
+  if (!work.geo.needsDemTransform())
+    return std::min(mDemExtent.width() / mDemWidth,
+                    mDemExtent.height() / mDemHeight);
+  return demCellSizeMetres(work) * work.geo.mapUnitsPerMetre(area);
+}
 
-    // Calculate altitude
-    double targetZ = 0.0;
-    if (params.altitudeMode.contains("Safe Path")) {
-      targetZ = autoFixedZ;
-    } else if (params.altitudeMode.contains("Fixed")) {
-      targetZ = userFixedAMSL;
-    } else {
-      targetZ =
-          scaledElevation + (params.cameraHeight * params.verticalExaggeration);
-    }
+int FlyThroughCore::demOverviewFactor(const FlightWorkspace &work) const {
+  // A fixed AMSL altitude says nothing about the height above the terrain
+  // until the DEM has been read
+  if (trajectoryParams(mParams).altitudeMode == AltitudeMode::FixedAmsl)
+    return 1;
+  const double native = demCellSizeMetres(work);
+  if (!(native > 0.0))
+    return 1;
+
+  // Ground covered by one screen pixel at the look-at point. The camera
+  // height is the clearance, the lowest the camera gets above the terrain.
+  const double distance =
+      std::hypot(mParams.cameraHeight, mParams.lookaheadDistance);
+  const double pixel = 2.0 * distance *
+                       std::tan(qDegreesToRadians(mParams.fieldOfView) / 2.0) /
+                       kAssumedViewWidthPx;
+  const double target = kScreenPixelsPerDemCell * pixel;
+
+  int factor = 1;
+  while (factor < kMaxDemOverviewFactor && native * factor * 2 <= target)
+    factor *= 2;
+  return factor;
+}
 
-    double cameraZ = targetZ;
+QByteArray FlyThroughCore::profileCacheKey(const FlightWorkspace &work,
+                                           const std::vector<double> &xs,
+                                           const std::vector<double> &ys,
+                                           double minSpacing) const {
+  // Only file-backed DEMs are cached: their stamp tells us when they change
+  const QString demStamp = sourceFileStamp(mDemSource);
+  if (demStamp.isEmpty())
+    return QByteArray();
+
+  CacheKeyBuilder key;
+  key.add(QString("profile-2"));
+  key.add(xs.data(), xs.size()).add(ys.data(), ys.size());
+  key.add(work.geo.viewCrs().toWkt()).add(mEllipsoid);
+  key.add(mDemSource).add(demStamp).add(work.geo.demCrs().toWkt());
+  key.add(static_cast<qint64>(demOverviewFactor(work)));
+  // Resampling: its tolerance, its finest spacing (DEM cells), and whether
+  // terrain following densifies the path when it is off
+  key.add(mParams.samplingTolerance).add(minSpacing);
+  key.add(static_cast<qint64>(trajectoryParams(mParams).altitudeMode ==
+                              AltitudeMode::TerrainFollow));
+  return key.result();
+}
 
-    // Calculate yaw (heading)
-    double yaw = 0.0;
-    if (i < vertices.size() - 1) {
-      yaw = calculateBearing(vertices[i], vertices[i + 1]);
-    } else {
-      yaw = previousBearing;
-    }
+ElevationProfile
+FlyThroughCore::elevationProfile(FlightWorkspace &work,
+                                 const QList<QgsPointXY> &vertices,
+                                 std::vector<double> &xs,
+                                 std::vector<double> &ys, double margin) {
+  ElevationProfile profile;
+
+  // Read the DEM once for the whole corridor (padded for the look-ahead
+  // target), unless resampling already did; every elevation below comes
+  // from memory.
+  if (!work.demGrid.isValid() && !loadDemGrid(work, vertices, margin)) {
+    qDebug() << "[FTP] WARNING: Could not read DEM window, elevations will "
+                "default to 0";
+  }
+  if (mCancelRequested)
+    return profile;
+
+  profile.xs = xs;
+  profile.ys = ys;
+  profile.elevations = sampleElevations(work, xs, ys);
+
+  profile.distances.resize(vertices.size());
+  profile.distances[0] = 0.0;
+  for (int i = 1; i < vertices.size(); ++i)
+    profile.distances[i] = profile.distances[i - 1] +
+                           work.geo.distance(vertices[i - 1], vertices[i]);
+
+  // Max elevation for "Above Safe Path" mode. The pyramid query covers
+  // every DEM cell within one cell diagonal of each segment, so narrow peaks
+  // between vertices are caught and the cost doesn't grow with path length.
+  if (work.demPyramid.isValid()) {
+    std::vector<double> demXs = xs;
+    std::vector<double> demYs = ys;
+    work.geo.viewToDem(demXs, demYs);
+    const double radius =
+        std::hypot(work.demGrid.cellSizeX(), work.demGrid.cellSizeY());
+    profile.peak = work.demPyramid.pathMax(demXs.data(), demYs.data(),
+                                           demXs.size(), radius);
+  }
+  return profile;
+}
 
-    // Calculate banking (roll)
-    double roll = 0.0;
-    if (params.enableBanking && i > 0 && i < vertices.size() - 1) {
-      double bearingIn = calculateBearing(vertices[i - 1], vertices[i]);
-      double bearingOut = calculateBearing(vertices[i], vertices[i + 1]);
+bool FlyThroughCore::loadDemGrid(FlightWorkspace &work,
+                                 const QList<QgsPointXY> &vertices,
+                                 double margin) {
+  work.demPyramid.clear();
+  work.demGrid.clear();
+  work.demWindow.clear();
+  QgsRasterDataProvider *provider = work.demProvider;
+  if (!provider || vertices.isEmpty())
+    return false;
 
-      double turnAngle = bearingOut - bearingIn;
-      while (turnAngle > 180.0)
-        turnAngle -= 360.0;
-      while (turnAngle < -180.0)
-        turnAngle += 360.0;
+  // Path corridor in the view CRS
+  QgsRectangle corridor = pathExtent(vertices);
+  corridor.grow(margin);
 
-      roll = -turnAngle * params.bankingFactor;
-      roll = qMax(-45.0, qMin(45.0, roll));
+  if (work.geo.needsDemTransform()) {
+    try {
+      corridor = work.geo.viewToDemTransform().transformBoundingBox(corridor);
+    } catch (const QgsCsException &) {
+      return false;
     }
+  }
 
-    // Create keyframe
-    Keyframe kf;
-    kf.time = currentTime;
-    kf.x = point.x();
-    kf.y = point.y();
-    kf.z = cameraZ;
-    kf.ground_z = scaledElevation;
-    kf.yaw = yaw;
-    kf.pitch = params.cameraPitch;
-    kf.roll = roll;
-
-    mKeyframes.push_back(kf);
-
-    if (i == 0 || i == vertices.size() - 1) {
-      qDebug()
-          << QString(
-                 "[FTP] Keyframe[%1]: x=%2, y=%3, elev=%4, cam_z=%5, yaw=%6")
-                 .arg(i)
-                 .arg(point.x(), 0, 'f', 1)
-                 .arg(point.y(), 0, 'f', 1)
-                 .arg(elevation, 0, 'f', 1)
-                 .arg(cameraZ, 0, 'f', 1)
-                 .arg(yaw, 0, 'f', 1);
-    }
+  const QgsRectangle demExtent = provider->extent();
+  corridor = corridor.intersect(demExtent);
+  if (corridor.isEmpty() || provider->xSize() <= 0 || provider->ySize() <= 0)
+    return false;
 
-    // Update time
-    if (i < vertices.size() - 1) {
-      double segmentDistance = calculateDistance(vertices[i], vertices[i + 1]);
-      double segmentDuration = segmentDistance / params.speed;
-      currentTime += segmentDuration;
-    }
+  double cellX = demExtent.width() / provider->xSize();
+  double cellY = demExtent.height() / provider->ySize();
+  if (cellX <= 0.0 || cellY <= 0.0)
+    return false;
 
-    previousBearing = yaw;
+  // Full resolution only where the camera flies low enough to need it
+  const int overview = demOverviewFactor(work);
+  if (overview > 1) {
+    cellX *= overview;
+    cellY *= overview;
+    qDebug() << "[FTP] Reading DEM at 1/" << overview
+             << "of its resolution for the camera height";
   }
 
-  if (!mKeyframes.empty()) {
-    mTotalDuration = mKeyframes.back().time;
+  // Snap the window to the raster's own pixel grid so cells are copied
+  // rather than resampled
+  const double xMin =
+      demExtent.xMinimum() +
+      std::floor((corridor.xMinimum() - demExtent.xMinimum()) / cellX) * cellX;
+  const double yMax =
+      demExtent.yMaximum() -
+      std::floor((demExtent.yMaximum() - corridor.yMaximum()) / cellY) * cellY;
+  double spanX = corridor.xMaximum() - xMin;
+  double spanY = yMax - corridor.yMinimum();
+
+  qint64 cells = static_cast<qint64>(std::ceil(spanX / cellX)) *
+                 static_cast<qint64>(std::ceil(spanY / cellY));
+  if (cells > kMaxDemCells) {
+    const double factor = std::sqrt(static_cast<double>(cells) / kMaxDemCells);
+    cellX *= factor;
+    cellY *= factor;
+    qDebug() << "[FTP] DEM corridor too large for native resolution,"
+             << "reading at" << cellX << "x" << cellY << "map units per cell";
   }
 
-  qDebug() << "[FTP] Generated" << mKeyframes.size()
-           << "keyframes, duration:" << mTotalDuration << "s";
-}
-
-double FlyThroughCore::getElevationAtPoint(
-    QgsRasterLayer *dem, const QgsPointXY &point,
-    const QgsCoordinateReferenceSystem &sourceCRS) {
-  if (!dem)
-    return 0.0;
+  const int width = qMax(2, static_cast<int>(std::ceil(spanX / cellX)));
+  const int height = qMax(2, static_cast<int>(std::ceil(spanY / cellY)));
+  const QgsRectangle window(xMin, yMax - height * cellY, xMin + width * cellX,
+                            yMax);
 
-  QgsCoordinateReferenceSystem demCRS = dem->crs();
-  QgsPointXY samplePoint = point;
+  std::unique_ptr<QgsRasterBlock> block(
+      provider->block(1, window, width, height));
+  if (!block || !block->isValid())
+    return false;
 
-  // Transform if needed
-  if (sourceCRS != demCRS) {
-    QgsCoordinateTransform ct(sourceCRS, demCRS, QgsProject::instance());
-    try {
-      samplePoint = ct.transform(point);
-    } catch (...) {
-      return 0.0;
+  work.demGrid.reset(xMin, yMax, cellX, cellY, width, height);
+  float *out = work.demGrid.data();
+  for (int row = 0; row < height; ++row) {
+    if (!stepProgress(work, 40 + (30 * row) / height, "Reading DEM")) {
+      work.demGrid.clear();
+      return false;
+    }
+    for (int col = 0; col < width; ++col) {
+      bool isNoData = false;
+      const double v = block->valueAndNoData(row, col, isNoData);
+      *out++ = (isNoData || std::isnan(v))
+                   ? std::numeric_limits<float>::quiet_NaN()
+                   : static_cast<float>(v);
     }
   }
 
-  // Check extent
-  if (!dem->extent().contains(samplePoint)) {
-    return 0.0;
-  }
-
-  // Sample raster
-  QgsRasterDataProvider *provider = dem->dataProvider();
-  if (!provider)
-    return 0.0;
+  work.demPyramid.build(work.demGrid);
 
-  // Use sample() instead of identify() - stable API across all QGIS versions
-  // (identify() parameter type changed between 3.28 and 3.34)
-  bool sampleOk = false;
-  double val = provider->sample(samplePoint, 1, &sampleOk);
-  if (sampleOk && !std::isnan(val))
-    return val;
+  qDebug() << "[FTP] DEM window loaded:" << width << "x" << height
+           << "cells," << work.demPyramid.levelCount() << "pyramid levels";
+  return true;
+}
 
-  return 0.0;
+std::vector<double>
+FlyThroughCore::sampleElevations(const FlightWorkspace &work,
+                                 const std::vector<double> &xs,
+                                 const std::vector<double> &ys,
+                                 double fallback) const {
+  if (!work.geo.needsDemTransform())
+    return work.demGrid.sampleElevations(xs, ys, fallback);
+
+  std::vector<double> demXs = xs;
+  std::vector<double> demYs = ys;
+  work.geo.viewToDem(demXs, demYs);
+  return work.demGrid.sampleElevations(demXs, demYs, fallback);
 }
 
 void FlyThroughCore::setupAnimation(const FlythroughParams &params) {
-  if (mKeyframes.empty()) {
+  if (!mSpline.isValid()) {
     qDebug() << "[FTP] No keyframes to animate!";
     return;
   }
@@ -542,225 +1462,391 @@ void FlyThroughCore::setupAnimation(const FlythroughParams &params) {
   }
 
   // Initialize animation state
-  mAnimIndex = 0;
-  mAnimElapsed = 0.0;
-  mAnimIntervalMs = 1000 / params.fps;
-  mAnimDt = mAnimIntervalMs / 1000.0;
-
-  qDebug() << "[FTP] Total keyframes:" << mKeyframes.size();
+  mTimeline.reset(mSpline);
+  mLastTickNs = 0;
+  mAnimFps = qMax(1, params.fps);
+  mAnimIntervalMs = qMax(1, qRound(1000.0 / mAnimFps));
+  mLastFrame = -1;
+  mRenderedFrames = 0;
+  mDroppedFrames = 0;
+  mFrameStats.reset(mAnimIntervalMs / 1000.0);
+
+  qDebug() << "[FTP] Total keyframes:" << mKeyframes.size()
+           << "Spline length:" << mSpline.length();
   qDebug() << "[FTP] Total duration:" << mTotalDuration << "s";
   qDebug() << "[FTP] FPS:" << params.fps << "Interval:" << mAnimIntervalMs
            << "ms";
 
-  // Move to first keyframe
-  const Keyframe &kf0 = mKeyframes[0];
-  const Keyframe &kf1 = (mKeyframes.size() > 1) ? mKeyframes[1] : kf0;
+  QgsRectangle extent;
+  extent.setMinimal();
+  for (const Keyframe &kf : mKeyframes)
+    extent.combineExtentWith(kf.x, kf.y);
+  mUnitsPerMetre = mWork.geo.mapUnitsPerMetre(extent);
 
-  moveCamera(kf0.x, kf0.y, kf0.ground_z, kf0.yaw, kf0.pitch, kf1.x, kf1.y,
-             kf1.ground_z, kf0.z);
+  // Start reading ahead before the first view loads, so the tiles just
+  // beyond it are on their way while the pre-roll waits
+  startPrefetch(params, 0.0);
 
-  // Let tiles load
-  for (int i = 0; i < 60; ++i) {
-    QApplication::processEvents();
-    QThread::msleep(50);
-  }
+  // Move to the start of the path
+  applyPoseAt(0.0);
 
-  // Re-position after loading
-  moveCamera(kf0.x, kf0.y, kf0.ground_z, kf0.yaw, kf0.pitch, kf1.x, kf1.y,
-             kf1.ground_z, kf0.z);
+  // Let tiles for the first view load, then re-position. A preview skips
+  // the pre-roll and lets tiles stream in during the flight.
+  if (!params.preview) {
+    SceneReadiness(mCanvas3D).waitUntilReady(kSceneLoadTimeoutMs);
+    applyPoseAt(0.0);
+  }
   QApplication::processEvents();
 
   // Create timer
   mAnimTimer = new QTimer(this);
+  mAnimTimer->setTimerType(Qt::PreciseTimer);
   mAnimTimer->setInterval(mAnimIntervalMs);
   connect(mAnimTimer, &QTimer::timeout, this,
           &FlyThroughCore::advanceAnimation);
+  mAnimClock.start();
   mAnimTimer->start();
 
   qDebug() << "[FTP] Animation timer started.";
+  showPlaybackControls();
+  emit playbackStateChanged();
 }
 
-void FlyThroughCore::advanceAnimation() {
-  if (mKeyframes.empty() || mAnimIndex >= (int)mKeyframes.size() - 1) {
-    if (mAnimTimer) {
-      mAnimTimer->stop();
-      qDebug() << "[FTP] Animation finished.";
-    }
+void FlyThroughCore::startPrefetch(const FlythroughParams &params,
+                                   double time) {
+  mPrefetcher->stop();
+  if (params.prefetchSeconds <= 0.0 || mKeyframes.empty())
     return;
+  mPrefetcher->setPlaybackTime(time);
+
+  // Tiles as wide as the look-ahead, fetched for the ground the camera
+  // looks at: about one look-ahead distance around it
+  const double reach = qMax(mLookaheadDist, mCameraHeight) * mUnitsPerMetre;
+
+  TerrainPrefetcher::Settings settings;
+  settings.horizonSeconds = params.prefetchSeconds;
+  settings.tileSize = reach;
+  settings.margin = reach;
+
+  QList<QgsMapLayer *> layers;
+  if (mMapSettings3D)
+    layers = mMapSettings3D->layers();
+  mPrefetcher->start(mKeyframes, settings,
+                     mDemLayer ? mDemLayer->dataProvider() : nullptr,
+                     mWork.geo.needsDemTransform()
+                         ? mWork.geo.viewToDemTransform()
+                         : QgsCoordinateTransform(),
+                     layers, mWork.geo.viewCrs());
+}
+
+void FlyThroughCore::finishAnimation() {
+  if (mAnimTimer)
+    mAnimTimer->stop();
+  mTimeline.setPaused(true);
+  mPrefetcher->stop();
+  emit playbackStateChanged();
+
+  const double wallSeconds = mAnimClock.isValid()
+                                 ? mAnimClock.nsecsElapsed() * 1e-9
+                                 : mTotalDuration;
+  qDebug() << "[FTP] Animation finished." << mRenderedFrames
+           << "frames rendered," << mDroppedFrames << "dropped, took"
+           << wallSeconds << "s for" << mTotalDuration << "s of flight";
+
+  reportFrameStats();
+
+  if (mIface && mIface->messageBar()) {
+    mIface->messageBar()->pushMessage(
+        "Flythrough Pro",
+        QString("Flight finished: %1 frames, %2 dropped")
+            .arg(mRenderedFrames)
+            .arg(mDroppedFrames),
+        Qgis::MessageLevel::Info, 5);
   }
 
-  const Keyframe &kfA = mKeyframes[mAnimIndex];
-  const Keyframe &kfB = mKeyframes[mAnimIndex + 1];
-  bool hasNext = (mAnimIndex + 2) < (int)mKeyframes.size();
-  const Keyframe &kfC = hasNext ? mKeyframes[mAnimIndex + 2] : kfB;
+  // Next flight of a per-feature run, once this tick has unwound
+  if (mFlightIndex + 1 < mFlights.size())
+    QTimer::singleShot(0, this, [this]() { playNextFlight(); });
+}
 
-  double segDuration = kfB.time - kfA.time;
-  if (segDuration <= 0)
-    segDuration = 0.001;
+void FlyThroughCore::reportFrameStats() {
+  if (mFrameStats.frames() == 0)
+    return;
+  // Each recorded frame is reported once: a stop after the flight finished,
+  // or a replay, starts from nothing
+  const FrameStats stats = mFrameStats;
+  mFrameStats.reset(mAnimIntervalMs / 1000.0);
+
+  qDebug() << "[FTP] Frame timing:";
+  const QStringList lines =
+      QString::fromStdString(stats.summary()).split('\n');
+  for (const QString &line : lines) {
+    if (!line.isEmpty())
+      qDebug().noquote() << "[FTP]  " << line;
+  }
 
-  double localT = (mAnimElapsed - kfA.time) / segDuration;
-  localT = qMax(0.0, qMin(1.0, localT));
+  if (!mParams.saveFrameStats)
+    return;
+  const QString path = QDir(QgsApplication::qgisSettingsDirPath())
+                           .filePath("flythrough/frame_stats.json");
+  QDir().mkpath(QFileInfo(path).path());
+  QSaveFile file(path);
+  if (file.open(QIODevice::WriteOnly)) {
+    file.write(QByteArray::fromStdString(stats.toJson()));
+    if (file.commit()) {
+      qDebug() << "[FTP] Frame timing written to" << path;
+      return;
+    }
+  }
+  qDebug() << "[FTP] Could not write frame timing to" << path << ":"
+           << file.errorString();
+}
 
-  // Smoothstep interpolation
-  double t = localT * localT * (3.0 - 2.0 * localT);
+bool FlyThroughCore::renderOffline(const FlythroughParams &params,
+                                   const QString &directory) {
+  if (!mSpline.isValid() || !mCanvas3D)
+    return false;
 
-  // Interpolate position
-  double x = kfA.x + (kfB.x - kfA.x) * t;
-  double y = kfA.y + (kfB.y - kfA.y) * t;
-  double groundZ = kfA.ground_z + (kfB.ground_z - kfA.ground_z) * t;
-  double interpZ = kfA.z + (kfB.z - kfA.z) * t;
+  if (directory.isEmpty() || !QDir().mkpath(directory)) {
+    QMessageBox::warning(
+        mIface->mainWindow(), "Export Failed",
+        QString("Cannot create output directory:\n%1").arg(directory));
+    return false;
+  }
 
-  // Interpolate angles
-  double yaw = lerpAngle(kfA.yaw, kfB.yaw, t);
-  double pitch = kfA.pitch + (kfB.pitch - kfA.pitch) * t;
+  stopAnimation();
+
+  // Frame i shows the flight at exactly i / fps, however long it takes to
+  // render, so the sequence plays back smoothly at that rate
+  const int fps = qMax(1, params.fps);
+  const int frameCount =
+      static_cast<int>(std::floor(mTotalDuration * fps)) + 1;
+
+  mRendering = true;
+  mCancelRequested = false;
+  mLastProgress = -1;
+
+  qDebug() << "[FTP] Offline render:" << frameCount << "frames at" << fps
+           << "fps to" << directory << "as"
+           << params.exportFormat;
+
+  SceneReadiness readiness(mCanvas3D);
+  FrameCapture capture(mCanvas3D);
+  FrameWriter writer(directory, params.exportFormat);
+  writer.start();
+  startPrefetch(params, 0.0);
+
+  QElapsedTimer clock;
+  clock.start();
+  QString error;
+  int rendered = 0;
+  int unsettled = 0;
+
+  for (int i = 0; i < frameCount; ++i) {
+    if (!reportProgress((100 * i) / frameCount,
+                        QString("Rendering frame %1 of %2")
+                            .arg(i + 1)
+                            .arg(frameCount)))
+      break;
+
+    const double time = qMin(mTotalDuration, static_cast<double>(i) / fps);
+    mPrefetcher->setPlaybackTime(time);
+    applyPoseAt(time);
+
+    // The first frame loads a whole view; later ones only the new edge
+    if (!readiness.waitUntilReady(kSceneLoadTimeoutMs,
+                                  i == 0 ? 250 : kFrameSettleMs))
+      ++unsettled;
+
+    const QImage image = capture.capture(kFrameCaptureTimeoutMs);
+    if (image.isNull()) {
+      error = QString("Could not capture frame %1.").arg(i);
+      break;
+    }
 
-  // Look-ahead target: smooth pan to kfC in last 20%
-  double targetX, targetY, targetGz;
-  if (hasNext && t > 0.8) {
-    double blend = (t - 0.8) / 0.2;
-    targetX = kfB.x + (kfC.x - kfB.x) * blend;
-    targetY = kfB.y + (kfC.y - kfB.y) * blend;
-    targetGz = kfB.ground_z + (kfC.ground_z - kfB.ground_z) * blend;
-  } else {
-    targetX = kfB.x;
-    targetY = kfB.y;
-    targetGz = kfB.ground_z;
+    // Hands the frame to the writer thread; only blocks if it falls behind
+    writer.enqueue(i, image);
+    error = writer.errorString();
+    if (!error.isEmpty())
+      break;
+    ++rendered;
   }
 
-  moveCamera(x, y, groundZ, yaw, pitch, targetX, targetY, targetGz, interpZ);
-  QApplication::processEvents();
+  mPrefetcher->stop();
+  writer.finish();
+  if (error.isEmpty())
+    error = writer.errorString();
+  mRendering = false;
+
+  const bool cancelled = mCancelRequested;
+  qDebug() << "[FTP] Offline render" << (cancelled ? "cancelled" : "done")
+           << "-" << writer.framesWritten() << "frames written," << unsettled
+           << "captured before the scene settled, took"
+           << clock.elapsed() / 1000.0 << "s";
 
-  mAnimElapsed += mAnimDt;
-  if (mAnimElapsed >= kfB.time) {
-    mAnimIndex++;
+  if (!error.isEmpty()) {
+    QMessageBox::warning(mIface->mainWindow(), "Export Failed", error);
+    return false;
   }
+  if (cancelled || rendered < frameCount)
+    return false;
+
+  reportProgress(100, "Done");
+  mIface->messageBar()->pushMessage(
+      "Flythrough Pro",
+      QString("Rendered %1 frames to %2")
+          .arg(writer.framesWritten())
+          .arg(QDir::toNativeSeparators(directory)),
+      Qgis::MessageLevel::Success, 10);
+  return true;
 }
 
-void FlyThroughCore::moveCamera(double x, double y, double groundZ, double yaw,
-                                double pitchParam, double lookX, double lookY,
-                                double lookGz, double absoluteZ) {
-  if (!mCanvas3D)
+void FlyThroughCore::advanceAnimation() {
+  if (!mSpline.isValid()) {
+    finishAnimation();
     return;
+  }
 
-  // Get camera controller via dynamic method call (avoids linking against
-  // Qgs3DMapCanvas::cameraController() which was not exported in QGIS 3.28.3)
-  QObject *cameraCtrl = nullptr;
-  QMetaObject::invokeMethod(mCanvas3D, "cameraController", Qt::DirectConnection,
-                            Q_RETURN_ARG(QObject *, cameraCtrl));
-  if (!cameraCtrl) {
-    // Try via scene
-    QObject *scene = nullptr;
-    QMetaObject::invokeMethod(mCanvas3D, "scene", Qt::DirectConnection,
-                              Q_RETURN_ARG(QObject *, scene));
-    if (scene) {
-      QMetaObject::invokeMethod(scene, "cameraController", Qt::DirectConnection,
-                                Q_RETURN_ARG(QObject *, cameraCtrl));
-    }
+  mFrameStats.beginFrame();
+
+  // Playback moves by the monotonic clock rather than counting ticks, so
+  // a late tick skips ahead instead of stretching the flight
+  const qint64 now = mAnimClock.nsecsElapsed();
+  const bool lastFrame = !mTimeline.advance((now - mLastTickNs) * 1e-9);
+  mLastTickNs = now;
+  const double time = mTimeline.time();
+
+  // Drops count ticks the wall clock says were due, whatever the rate
+  const qint64 frame = static_cast<qint64>(now * 1e-9 * mAnimFps);
+  qint64 dropped = 0;
+  if (mLastFrame >= 0 && frame > mLastFrame + 1)
+    dropped = frame - mLastFrame - 1;
+  mDroppedFrames += dropped;
+  mLastFrame = frame;
+  ++mRenderedFrames;
+
+  mPrefetcher->setPlaybackTime(time);
+  applyPoseAt(time);
+  {
+    FrameStats::Scope scope(mFrameStats, FrameStats::Events);
+    QApplication::processEvents();
+  }
+  mFrameStats.endFrame(dropped);
+  emit playbackPositionChanged(time);
+
+  // Running backwards, the start is only somewhere to stop
+  if (lastFrame) {
+    if (mTimeline.isReversed())
+      pausePlayback();
+    else
+      finishAnimation();
   }
-  if (!cameraCtrl)
+}
+
+void FlyThroughCore::pausePlayback() {
+  if (!mAnimTimer || !mAnimTimer->isActive())
     return;
+  mAnimTimer->stop();
+  mTimeline.setPaused(true);
+  emit playbackStateChanged();
+}
 
-  // Calculate look-ahead vector
-  double camHeight = mCameraHeight;
-  double lookAhead = mLookaheadDist;
+void FlyThroughCore::resumePlayback() {
+  if (!mAnimTimer || mAnimTimer->isActive() || !mSpline.isValid())
+    return;
+  // From the end it runs towards, play the flight again
+  if (mTimeline.atEnd())
+    seekPlayback(mTimeline.isReversed() ? mTimeline.duration() : 0.0);
+  mTimeline.setPaused(false);
+  // Stopped when the flight finished, or idle with nothing left to request
+  if (!mPrefetcher->isActive())
+    startPrefetch(mParams, mTimeline.time());
+
+  // The pause is neither a late tick nor dropped frames
+  mLastTickNs = 0;
+  mLastFrame = -1;
+  mFrameStats.restartTicks();
+  mAnimClock.start();
+  mAnimTimer->start();
+  emit playbackStateChanged();
+}
 
-  double dx = lookX - x;
-  double dy = lookY - y;
-  double rawDist = std::sqrt(dx * dx + dy * dy);
+bool FlyThroughCore::isPlaybackPaused() const {
+  return !mAnimTimer || !mAnimTimer->isActive();
+}
 
-  double dxScaled = dx;
-  double dyScaled = dy;
-  double aheadGz = lookGz;
+void FlyThroughCore::setPlaybackReversed(bool reversed) {
+  mTimeline.setReversed(reversed);
+  emit playbackStateChanged();
+}
 
-  if (rawDist > 1.0) {
-    double scale = qMin(1.0, lookAhead / rawDist);
-    dxScaled = dx * scale;
-    dyScaled = dy * scale;
-    aheadGz = groundZ + (lookGz - groundZ) * scale;
-  } else {
-    // Fallback to yaw
-    double rad = qDegreesToRadians(yaw);
-    dxScaled = lookAhead * std::sin(rad);
-    dyScaled = lookAhead * std::cos(rad);
-    aheadGz = groundZ;
-  }
-
-  double finalX = x + dxScaled;
-  double finalY = y + dyScaled;
-
-  // Sample actual terrain at look-at point
-  if (mDemLayer) {
-    double sampledZ =
-        getElevationAtPoint(mDemLayer, QgsPointXY(finalX, finalY), mProjectCRS);
-    if (sampledZ > aheadGz) {
-      aheadGz = sampledZ;
-    }
-  }
+void FlyThroughCore::setPlaybackRate(double rate) {
+  mTimeline.setRate(rate);
+  emit playbackStateChanged();
+}
 
-  double camZ = absoluteZ;
-
-  // Calculate vertical offset from pitch
-  double horizM = std::sqrt(dxScaled * dxScaled + dyScaled * dyScaled);
-  double pitchRad = qDegreesToRadians(pitchParam);
-  double verticalOffset = horizM * std::tan(pitchRad);
-  double finalZ = camZ + verticalOffset;
-
-  // Prevent looking underground
-  if (finalZ < aheadGz) {
-    double vertDiff = camZ - aheadGz;
-    if (vertDiff > 0 && qAbs(pitchParam) > 1.0) {
-      double reqHorizM =
-          vertDiff / std::tan(qDegreesToRadians(qAbs(pitchParam)));
-      if (horizM > 0.1) {
-        double scaleDown = reqHorizM / horizM;
-        if (scaleDown < 1.0) {
-          dxScaled *= scaleDown;
-          dyScaled *= scaleDown;
-          finalX = x + dxScaled;
-          finalY = y + dyScaled;
-          finalZ = aheadGz;
-          horizM = reqHorizM;
-        }
-      }
-    }
-  }
+void FlyThroughCore::seekPlayback(double time) {
+  if (!mSpline.isValid())
+    return;
+  const double previous = mTimeline.time();
+  mTimeline.seek(time);
+  // The prefetcher has skipped the tiles behind it
+  if (mTimeline.time() < previous)
+    startPrefetch(mParams, mTimeline.time());
+  mPrefetcher->setPlaybackTime(mTimeline.time());
+  applyPoseAt(mTimeline.time());
+  emit playbackPositionChanged(mTimeline.time());
+}
 
-  // Safety check
-  if (camZ < groundZ + 1.0) {
-    camZ = groundZ + 10.0;
-  }
+void FlyThroughCore::seekPlaybackDistance(double metres) {
+  seekPlayback(mTimeline.timeAtDistance(metres * mUnitsPerMetre));
+}
 
-  // Calculate camera parameters
-  double vert = camZ - finalZ;
-  double dist = std::sqrt(horizM * horizM + vert * vert);
-  if (dist < 1.0)
-    dist = camHeight;
+double FlyThroughCore::playbackDistance() const {
+  return mUnitsPerMetre > 0.0 ? mTimeline.distance() / mUnitsPerMetre : 0.0;
+}
 
-  double orbPitch =
-      (horizM < 0.001) ? 0.0 : qRadiansToDegrees(std::atan2(vert, horizM));
-  orbPitch = qMax(0.0, qMin(180.0, orbPitch));
+double FlyThroughCore::playbackLength() const {
+  return mUnitsPerMetre > 0.0 ? mTimeline.length() / mUnitsPerMetre : 0.0;
+}
 
-  double bear = qRadiansToDegrees(std::atan2(dxScaled, dyScaled));
-  double orbYaw = fmod(360.0 - bear, 360.0);
+void FlyThroughCore::showPlaybackControls() {
+  if (!mIface)
+    return;
+  if (!mPlaybackDock) {
+    mPlaybackDock =
+        new QDockWidget("Flythrough Playback", mIface->mainWindow());
+    mPlaybackDock->setObjectName("FlythroughPlaybackDock");
+    mPlaybackDock->setWidget(new PlaybackControls(this, mPlaybackDock));
+    mIface->addDockWidget(Qt::BottomDockWidgetArea, mPlaybackDock);
+  }
+  mPlaybackDock->show();
+}
 
-  QgsVector3D mapPt(finalX, finalY, finalZ);
+void FlyThroughCore::applyPoseAt(double time) {
+  // The views were baked with the flight; nothing is worked out per frame
+  OrbitView view;
+  {
+    FrameStats::Scope scope(mFrameStats, FrameStats::Pose);
+    view = mPoses.at(time);
+  }
+  moveCamera(view);
+}
 
-  // Set camera using version-compatible API via dynamic dispatch
-  int methodIdx = cameraCtrl->metaObject()->indexOfMethod(
-      "setLookingAtMapPoint(QgsVector3D,double,double,double)");
-  if (methodIdx >= 0) {
-    QMetaObject::invokeMethod(cameraCtrl, "setLookingAtMapPoint",
-                              Qt::DirectConnection, Q_ARG(QgsVector3D, mapPt),
-                              Q_ARG(double, dist), Q_ARG(double, orbPitch),
-                              Q_ARG(double, orbYaw));
-  } else {
-    // Fallback: use setCameraPose via dynamic call
-    // QgsCameraPose is a simple struct - set via property or individual methods
-    // Try "setViewFromTop" as ultimate fallback
-    QMetaObject::invokeMethod(
-        cameraCtrl, "setLookingAtPoint", Qt::DirectConnection,
-        Q_ARG(QgsVector3D, mapPt), Q_ARG(float, (float)dist),
-        Q_ARG(float, (float)orbPitch), Q_ARG(float, (float)orbYaw));
+void FlyThroughCore::moveCamera(const OrbitView &view) {
+  if (!mCanvas3D)
+    return;
+
+  // Controller and look-at method were resolved once in setup3DCanvas
+  if (!mCameraDispatch->ensureResolved())
+    return;
+
+  // Set camera using the pre-resolved, version-compatible look-at method
+  {
+    FrameStats::Scope scope(mFrameStats, FrameStats::Dispatch);
+    mCameraDispatch->setLookingAt(
+        QgsVector3D(view.lookX, view.lookY, view.lookZ), view.distance,
+        view.pitch, view.yaw);
   }
 
   // Debug first few frames
@@ -768,40 +1854,15 @@ void FlyThroughCore::moveCamera(double x, double y, double groundZ, double yaw,
     mDbgCount++;
     qDebug()
         << QString(
-               "[FTP] CAM #%1: pos=(%2,%3,%4) look=(%5,%6,%7) dist=%8 pitch=%9")
+               "[FTP] CAM #%1: look=(%2,%3,%4) camZ=%5 dist=%6 pitch=%7 "
+               "yaw=%8")
                .arg(mDbgCount)
-               .arg(x, 0, 'f', 1)
-               .arg(y, 0, 'f', 1)
-               .arg(camZ, 0, 'f', 0)
-               .arg(finalX, 0, 'f', 1)
-               .arg(finalY, 0, 'f', 1)
-               .arg(finalZ, 0, 'f', 0)
-               .arg(dist, 0, 'f', 0)
-               .arg(orbPitch, 0, 'f', 1);
-  }
-}
-
-double FlyThroughCore::calculateBearing(const QgsPointXY &p1,
-                                        const QgsPointXY &p2) const {
-  double dx = p2.x() - p1.x();
-  double dy = p2.y() - p1.y();
-  double bearing = qRadiansToDegrees(std::atan2(dx, dy));
-  return fmod(bearing + 360.0, 360.0);
-}
-
-double FlyThroughCore::calculateDistance(const QgsPointXY &p1,
-                                         const QgsPointXY &p2) const {
-  QgsDistanceArea da;
-  da.setSourceCrs(mProjectCRS, QgsProject::instance()->transformContext());
-  da.setEllipsoid(QgsProject::instance()->ellipsoid());
-  return da.measureLine(p1, p2);
-}
-
-double FlyThroughCore::lerpAngle(double a, double b, double t) const {
-  double diff = b - a;
-  while (diff > 180.0)
-    diff -= 360.0;
-  while (diff < -180.0)
-    diff += 360.0;
-  return fmod(a + diff * t, 360.0);
+               .arg(view.lookX, 0, 'f', 1)
+               .arg(view.lookY, 0, 'f', 1)
+               .arg(view.lookZ, 0, 'f', 0)
+               .arg(view.cameraZ, 0, 'f', 0)
+               .arg(view.distance, 0, 'f', 0)
+               .arg(view.pitch, 0, 'f', 1)
+               .arg(view.yaw, 0, 'f', 1);
+  }
 }
@@ -1,18 +1,34 @@
 #ifndef FLYTHROUGH_CORE_H
 #define FLYTHROUGH_CORE_H
 
+#include "flythrough_cache.h"
+#include "flythrough_camera.h"
+#include "flythrough_dem.h"
+#include "flythrough_geo.h"
+#include "flythrough_keyframe.h"
+#include "flythrough_spline.h"
+#include "flythrough_stats.h"
+#include "flythrough_timeline.h"
+#include "flythrough_trajectory.h"
+#include <QElapsedTimer>
+#include <QFutureWatcher>
 #include <QMap>
 #include <QObject>
+#include <QPointer>
 #include <QTimer>
 #include <QWidget>
 #include <qgis.h>
 #include <qgscoordinatereferencesystem.h>
+#include <qgsfeatureid.h>
 #include <qgsgeometry.h>
 #include <qgsmaplayer.h>
 #include <qgspointxy.h>
 #include <qgsraster.h>
 #include <qgsrectangle.h>
 #include <qgsvector3d.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 // Forward declarations - Do NOT include qgs3dmapcanvas.h or
@@ -20,36 +36,133 @@
 // QGIS 3.28.3
 class QgsVectorLayer;
 class QgsRasterLayer;
+class QgsRasterDataProvider;
+class QgsAbstractFeatureSource;
 class Qgs3DMapSettings;
 class QgisInterface;
-
-struct Keyframe {
-  double time;     // Seconds from start
-  double x, y;     // Map coordinates (View CRS)
-  double z;        // Absolute camera altitude
-  double ground_z; // Terrain elevation at this point
-  double yaw;      // Heading (0-360°)
-  double pitch;    // Look angle (-90 to 90°)
-  double roll;     // Banking angle (±45°)
-};
+class QDockWidget;
+class TerrainPrefetcher;
 
 struct FlythroughParams {
   QgsVectorLayer *pathLayer = nullptr;
   QgsRasterLayer *demLayer = nullptr;
   QgsMapLayer *overlayLayer = nullptr;
 
-  QString altitudeMode = "Above Safe Path"; // or "Fixed Altitude (AMSL)"
-  double cameraHeight = 200.0;              // meters
-  double cameraPitch = 65.0;                // degrees (positive = down)
-  double fieldOfView = 45.0;                // degrees
+  // "Above Safe Path", "Fixed Altitude (AMSL)" or "Terrain Following"
+  QString altitudeMode = "Above Safe Path";
+  double cameraHeight = 200.0; // meters
+  double cameraPitch = 65.0;   // degrees (positive = down)
+  double fieldOfView = 45.0;   // degrees
   double verticalExaggeration = 1.0;
-  double speed = 50.0; // m/s
-  int smoothing = 0;   // iterations
+  double speed = 50.0;            // m/s
+  double smoothingSigma = 0.0;    // meters, 0 = no smoothing
+  double simplifyTolerance = 0.0; // meters, 0 keeps every vertex
+  // Error budget for adaptive resampling against the DEM, meters. 0 keeps
+  // the path's own vertices (densified per DEM cell for terrain following).
+  double samplingTolerance = 2.0;
   bool enableBanking = true;
   double bankingFactor = 0.5;
   bool terrainShading = true;
   double lookaheadDistance = 1000.0; // meters
   int fps = 30;
+
+  // Terrain Following: terrain window behind and ahead of the camera, and
+  // the steepest climb or descent (metres per metre)
+  double followWindow = 500.0; // meters
+  double maxGrade = 0.25;
+
+  // Reuse keyframes generated earlier for the same path, DEM and settings
+  bool useKeyframeCache = true;
+
+  // Fly every feature of the path layer as a flight of its own, one after
+  // the other, instead of joining all features into one path.
+  // selectedOnly restricts either mode to the layer's selected features.
+  bool perFeature = false;
+  bool selectedOnly = false;
+
+  // Offline render: step the timeline at exactly 1/fps and write every frame
+  // to exportDirectory instead of playing back in real time
+  bool exportFrames = false;
+  QString exportDirectory;
+  QString exportFormat = "PNG"; // or "RAW"
+
+  // Write the playback frame timing histograms as JSON when the flight ends
+  bool saveFrameStats = false;
+
+  // Read DEM blocks and render the scene's layers this many seconds of
+  // flight ahead of the camera, 0 = off
+  double prefetchSeconds = 8.0;
+
+  // Fast preview: the full run's trajectory, computed the same way and
+  // shared with it through the stage and disk caches, so a later full run
+  // starts at once; only the overlay (or the DEM) drawn, over coarser
+  // terrain tiles, shading off, and no waiting for tiles before the camera
+  // moves. Never renders frames to disk.
+  bool preview = false;
+};
+
+// Keyframes for one path, ready to play or render
+struct PreparedFlight {
+  QString name; // Also the frame subfolder when several flights are exported
+  std::vector<Keyframe> keyframes;
+  CameraSpline spline; // Playback path through keyframes
+  BakedPoses poses;    // Camera view for every frame along spline
+  QgsPointXY startPoint;
+};
+
+// Output of the background generation job, handed to the GUI thread
+struct GenerationResult {
+  bool cancelled = false;
+  QString error;                       // Empty on success
+  std::vector<PreparedFlight> flights; // In layer order
+  int skipped = 0;                     // Features that gave no flight
+};
+
+// Everything preparing one flight writes to, apart from the caches. A
+// per-feature run prepares several flights at once, each on a pool thread
+// with its own workspace and its own clone of the DEM provider.
+struct FlightWorkspace {
+  GeoContext geo;
+  DemGrid demGrid;
+  DemPyramid demPyramid; // Points into demGrid, so workspaces aren't copied
+  QByteArray demWindow;  // What demGrid was read for; empty if unknown
+  QgsRasterDataProvider *demProvider = nullptr; // Not owned
+  std::vector<double> smoothScratch;            // Reused by smoothing
+  bool reportsProgress = true; // Only a lone flight drives the progress bar
+
+  FlightWorkspace() = default;
+  FlightWorkspace(const FlightWorkspace &) = delete;
+  FlightWorkspace &operator=(const FlightWorkspace &) = delete;
+};
+
+// What each stage of preparing one flight produced, kept between runs so
+// that a parameter change reruns only the stages that read it. Stages run
+// in order, each from the output of the one before. A stage's signature
+// hashes the previous stage's signature and the inputs it reads itself
+// (FlyThroughCore::addStageInputs), so a changed input dirties its stage
+// and everything after it, and nothing before.
+struct FlightStages {
+  enum Stage {
+    Transform, // Path into the view CRS
+    Smooth,    // Simplified and smoothed
+    Sample,    // DEM read, resampled against it, elevation profile
+    Keyframes, // Altitudes, banking and times
+    Poses,     // Camera pitch, the playback spline and per-frame views
+    StageCount
+  };
+
+  QByteArray signatures[StageCount]; // Empty until the stage has run
+
+  QList<QgsPointXY> viewVertices;
+  std::vector<double> smoothXs, smoothYs;
+  std::vector<double> sampleXs, sampleYs;
+  ElevationProfile profile;
+  std::vector<Keyframe> keyframes;
+  std::vector<Keyframe> poses; // keyframes with the camera pitch
+  CameraSpline spline;
+  BakedPoses frames;
+
+  static const char *stageName(Stage stage);
 };
 
 class FlyThroughCore : public QObject {
@@ -59,34 +172,136 @@ public:
   explicit FlyThroughCore(QgisInterface *iface, QObject *parent = nullptr);
   ~FlyThroughCore();
 
-  // Main generation function
+  // Main generation function. Path extraction, transformation, smoothing
+  // and keyframe generation run on a worker thread; this returns as soon as
+  // the job is started. generationFinished() fires on the GUI thread once
+  // playback has started (or the offline render has completed) or the job
+  // failed / was cancelled.
   bool generateFlythrough(const FlythroughParams &params);
+  bool isGenerating() const { return mJobWatcher != nullptr || mRendering; }
+  void cancelGeneration();
 
   // Stop animation
   void stopAnimation();
 
+  // Playback control of the flight being played. Nothing is regenerated:
+  // seeking only moves along the keyframes already generated. Pausing
+  // keeps the flight; after stopAnimation() there is nothing to resume.
+  void pausePlayback();
+  void resumePlayback();
+  bool isPlaybackPaused() const;
+  void setPlaybackReversed(bool reversed);
+  bool isPlaybackReversed() const { return mTimeline.isReversed(); }
+  // 0.25x to 8x
+  void setPlaybackRate(double rate);
+  double playbackRate() const { return mTimeline.rate(); }
+  // Seconds from the start of the flight
+  void seekPlayback(double time);
+  double playbackTime() const { return mTimeline.time(); }
+  double playbackDuration() const { return mTimeline.duration(); }
+  // Metres along the path, converted at the scale of the flight's extent
+  void seekPlaybackDistance(double metres);
+  double playbackDistance() const;
+  double playbackLength() const;
+
+signals:
+  void progressChanged(int percent, const QString &stage);
+  void generationFinished(bool success);
+  // Every frame drawn and every seek
+  void playbackPositionChanged(double time);
+  // Pause, direction, rate or a new flight
+  void playbackStateChanged();
+
 private:
+  struct FeaturePath {
+    QString name;
+    QList<QgsPointXY> vertices; // Path CRS
+  };
+
   QgisInterface *mIface;
   // Use QWidget* instead of Qgs3DMapCanvas* to avoid linking against
   // Qgs3DMapCanvas methods not exported in QGIS 3.28.3
   QWidget *mCanvas3D = nullptr;
   Qgs3DMapSettings *mMapSettings3D = nullptr;
+  // The canvas's own terrain detail while a preview draws it coarser
+  bool mTerrainCoarsened = false;
+  float mSavedTerrainScreenError = 0.0f;
+  int mSavedMapTileResolution = 0;
+  CameraDispatch *mCameraDispatch = nullptr;
+  TerrainPrefetcher *mPrefetcher = nullptr; // Warms caches along the path
   QgsRasterLayer *mDemLayer = nullptr;
   QgsCoordinateReferenceSystem mProjectCRS;
+  // Single-flight preparation; its DEM window also serves the terrain check
+  // during playback. Per-feature runs leave it without a grid.
+  FlightWorkspace mWork;
 
+  // Generation job. Everything it needs from layers and the project is
+  // captured on the GUI thread before it starts; until it finishes the GUI
+  // thread only receives progress signals.
+  FlythroughParams mParams;
+  std::unique_ptr<QgsAbstractFeatureSource> mPathSource;
+  std::unique_ptr<QgsRasterDataProvider> mDemProvider;
+  QString mPathLayerId;
+  QString mPathLayerSource;
+  QgsCoordinateReferenceSystem mPathCRS;
+  QgsFeatureIds mPathSelection; // Used when mParams.selectedOnly
+  long long mPathFeatureCount = 0;
+  std::mutex mProviderMutex; // Serialises cloning mDemProvider on workers
+  QgsRectangle mDemExtent;
+  int mDemWidth = 0;
+  int mDemHeight = 0;
+  QString mDemSource;
+  QString mEllipsoid;
+  KeyframeCache mKeyframeCache;
+  ProfileCache mProfileCache;
+
+  // Staged preparation, kept between runs. Extraction is skipped while the
+  // path layer, its selection and its data are unchanged; every flight
+  // keeps its later stages under its name. Only the generation job reads
+  // or writes these. Edits to either layer in QGIS bump its revision; edits
+  // to the path file outside QGIS change its file stamp.
+  QByteArray mExtractSignature;
+  std::vector<FeaturePath> mExtractedPaths;
+  QMap<QString, FlightStages> mStages;
+  QPointer<QgsMapLayer> mWatchedPathLayer;
+  QPointer<QgsMapLayer> mWatchedDemLayer;
+  QMetaObject::Connection mPathLayerWatch;
+  QMetaObject::Connection mDemLayerWatch;
+  std::atomic<int> mPathRevision{0};
+  std::atomic<int> mDemRevision{0};
+
+  QFutureWatcher<GenerationResult> *mJobWatcher = nullptr;
+  std::atomic<bool> mCancelRequested{false};
+  std::atomic<int> mLastProgress{-1};
+  bool mRendering = false;
+
+  // Prepared flights, played in sequence or rendered one after the other;
+  // mKeyframes and mSpline hold the current one
+  std::vector<PreparedFlight> mFlights;
+  size_t mFlightIndex = 0;
   std::vector<Keyframe> mKeyframes;
+  CameraSpline mSpline; // Playback path through mKeyframes
+  BakedPoses mPoses;    // Views along mSpline, one per frame
   double mTotalDuration = 0.0;
   double mCameraHeight = 200.0;
   double mLookaheadDist = 1000.0;
   double mPitchAngle = -65.0;
   double mVerticalScale = 1.0;
 
-  // Animation state
+  // Animation state. The timeline moves by the time mAnimClock has run
+  // since the previous tick; the timer only decides when to draw.
   QTimer *mAnimTimer = nullptr;
-  int mAnimIndex = 0;
-  double mAnimElapsed = 0.0;
-  double mAnimDt = 0.0;
+  QElapsedTimer mAnimClock; // Restarted when playback resumes
+  qint64 mLastTickNs = 0;
+  PlaybackTimeline mTimeline;
+  double mUnitsPerMetre = 1.0; // View CRS, over the current flight
+  QPointer<QDockWidget> mPlaybackDock;
+  int mAnimFps = 30;
   int mAnimIntervalMs = 33;
+  qint64 mLastFrame = -1;
+  qint64 mRenderedFrames = 0;
+  qint64 mDroppedFrames = 0;
+  FrameStats mFrameStats; // Per-phase timing of every playback frame
   int mDbgCount = 0;
 
   // Methods
@@ -95,28 +310,103 @@ private:
   QWidget *findExisting3DCanvas();
   void close3DCanvas();
 
-  QList<QgsPointXY> extractPathVertices(QgsVectorLayer *layer);
-  QList<QgsPointXY> densifyPath(const QList<QgsPointXY> &vertices,
-                                double interval);
-  QList<QgsPointXY> smoothPath(const QList<QgsPointXY> &vertices,
-                               int iterations);
+  static QgsCoordinateReferenceSystem viewCrsForProject();
+  GenerationResult runGeneration();
+  // Key of a flight's keyframes in mKeyframeCache, from the signature of
+  // its Keyframes stage
+  QByteArray keyframeCacheKey(const QByteArray &keyframesSignature) const;
+  // Thread-safe; emits only when the percentage changes
+  bool reportProgress(int percent, const QString &stage);
+  // reportProgress() for a flight's own stages; workspaces that don't drive
+  // the progress bar only check for cancellation
+  bool stepProgress(const FlightWorkspace &work, int percent,
+                    const QString &stage);
 
-  void generateKeyframes(const QList<QgsPointXY> &vertices,
-                         const FlythroughParams &params);
-  double getElevationAtPoint(QgsRasterLayer *dem, const QgsPointXY &point,
-                             const QgsCoordinateReferenceSystem &sourceCRS);
+  // One path per line or point feature, parts of multi-part features joined
+  std::vector<FeaturePath> extractPaths(QgsAbstractFeatureSource *source);
 
-  void setupAnimation(const FlythroughParams &params);
-  void moveCamera(double x, double y, double groundZ, double yaw,
-                  double pitchParam, double lookX, double lookY, double lookGz,
-                  double absoluteZ);
+  // Watches both layers for edits that make their stages stale
+  void watchLayers(const FlythroughParams &params);
+  // Paths of the layer, re-read only when the extract signature changes
+  std::vector<FeaturePath> extractStage();
 
-  // Math helpers
-  double calculateBearing(const QgsPointXY &p1, const QgsPointXY &p2) const;
-  double calculateDistance(const QgsPointXY &p1, const QgsPointXY &p2) const;
-  double lerpAngle(double a, double b, double t) const;
+  // Runs the stages of one path that are dirty (or loads cached keyframes)
+  // and fills flight from the outcome. Returns false on error (in error) or
+  // cancellation.
+  bool prepareFlight(FlightWorkspace &work, const QList<QgsPointXY> &vertices,
+                     FlightStages &stages, PreparedFlight &flight,
+                     QString &error);
+  // prepareFlight() for every path on the global thread pool
+  void prepareFlights(const std::vector<FeaturePath> &paths,
+                      GenerationResult &result);
+
+  // The inputs each stage reads, besides the previous stage's output: the
+  // FlythroughParams fields and the layer state it depends on
+  void addStageInputs(CacheKeyBuilder &key, FlightStages::Stage stage,
+                      const FlightWorkspace &work) const;
+  // DEM source, file stamp, CRS, footprint and size
+  void addDemIdentity(CacheKeyBuilder &key) const;
+  void runTransformStage(FlightWorkspace &work,
+                         const QList<QgsPointXY> &vertices,
+                         FlightStages &stages);
+  void runSmoothStage(FlightWorkspace &work, FlightStages &stages);
+  bool runSampleStage(FlightWorkspace &work, FlightStages &stages);
+  bool runKeyframesStage(FlightWorkspace &work, FlightStages &stages);
+  void runPosesStage(FlightWorkspace &work, FlightStages &stages);
+  static TrajectoryParams trajectoryParams(const FlythroughParams &params);
+  // Native DEM cell size in metres, and in view-CRS units around area
+  double demCellSizeMetres(const FlightWorkspace &work) const;
+  double demCellSizeInView(const FlightWorkspace &work,
+                           const QgsRectangle &area) const;
+  // Power-of-two coarsening of the DEM read for the camera height and
+  // field of view; 1 reads at full resolution
+  int demOverviewFactor(const FlightWorkspace &work) const;
+  // Key of the profile for the smoothed path xs, ys in mProfileCache: the
+  // path, the DEM file and everything that decides where the path is
+  // resampled. Empty when the DEM isn't a local file.
+  QByteArray profileCacheKey(const FlightWorkspace &work,
+                             const std::vector<double> &xs,
+                             const std::vector<double> &ys,
+                             double minSpacing) const;
+  // Raw elevations, distances and peak at the vertices xs, ys, read from
+  // the DEM window (which is loaded if resampling hasn't already)
+  ElevationProfile elevationProfile(FlightWorkspace &work,
+                                    const QList<QgsPointXY> &vertices,
+                                    std::vector<double> &xs,
+                                    std::vector<double> &ys, double margin);
+  // Corridor padding of the DEM window, so it covers the look-ahead target
+  double demMargin() const { return mParams.lookaheadDistance + 100.0; }
+  // DEM sampling: the corridor around the path is read once into the
+  // workspace's grid, then all lookups are served from memory. Points are in
+  // the view CRS.
+  bool loadDemGrid(FlightWorkspace &work, const QList<QgsPointXY> &vertices,
+                   double margin);
+  // fallback is returned for points off the grid or over nodata
+  std::vector<double> sampleElevations(const FlightWorkspace &work,
+                                       const std::vector<double> &xs,
+                                       const std::vector<double> &ys,
+                                       double fallback = 0.0) const;
+
+  // Makes flight index current (keyframes, spline and poses); false if it
+  // has no length
+  bool loadFlight(size_t index);
+  void playNextFlight();
+  bool renderFlights(const FlythroughParams &params);
+
+  void setupAnimation(const FlythroughParams &params);
+  // Starts mPrefetcher along mKeyframes from time on, unless params turn
+  // it off
+  void startPrefetch(const FlythroughParams &params, double time);
+  void showPlaybackControls();
+  void applyPoseAt(double time);
+  void finishAnimation();
+  // Logs mFrameStats and, if requested, writes them as JSON
+  void reportFrameStats();
+  bool renderOffline(const FlythroughParams &params, const QString &directory);
+  void moveCamera(const OrbitView &view);
 
 private slots:
+  void onGenerationFinished();
   void advanceAnimation();
 };
 
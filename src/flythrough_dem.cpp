@@ -0,0 +1,343 @@
+#include "flythrough_dem.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+void DemGrid::reset(double xMin, double yMax, double cellSizeX,
+                    double cellSizeY, int width, int height) {
+  mXMin = xMin;
+  mYMax = yMax;
+  mCellX = cellSizeX;
+  mCellY = cellSizeY;
+  mInvCellX = 1.0 / cellSizeX;
+  mInvCellY = 1.0 / cellSizeY;
+  mWidth = width;
+  mHeight = height;
+  mCells.assign(static_cast<size_t>(width) * height,
+                std::numeric_limits<float>::quiet_NaN());
+}
+
+void DemGrid::clear() {
+  mWidth = 0;
+  mHeight = 0;
+  mCells.clear();
+  mCells.shrink_to_fit();
+}
+
+double DemGrid::sample(double x, double y, double fallback) const {
+  double z = fallback;
+  sampleElevations(&x, &y, &z, 1, fallback);
+  return z;
+}
+
+void DemGrid::sampleElevations(const double *xs, const double *ys, double *zs,
+                               size_t count, double fallback) const {
+  if (!isValid()) {
+    std::fill(zs, zs + count, fallback);
+    return;
+  }
+
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  const double x0 = mXMin;
+  const double x1 = xMax();
+  const double y0 = yMin();
+  const double y1 = mYMax;
+  const double maxFx = mWidth - 1;
+  const double maxFy = mHeight - 1;
+  const int lastCol = mWidth - 2;
+  const int lastRow = mHeight - 2;
+  const float *cells = mCells.data();
+  const size_t stride = static_cast<size_t>(mWidth);
+
+  // Pass 1: plain bilinear. NaN in any corner (or outside the window)
+  // propagates into the result and is resolved in pass 2.
+  for (size_t i = 0; i < count; ++i) {
+    const double x = xs[i];
+    const double y = ys[i];
+    const bool inside = x >= x0 && x <= x1 && y >= y0 && y <= y1;
+
+    // Points outside (NaN and infinities included) read cell (0, 0): the
+    // clamp below lets NaN through and casting it to int is undefined
+    double fx = inside ? (x - x0) * mInvCellX - 0.5 : 0.0;
+    double fy = inside ? (y1 - y) * mInvCellY - 0.5 : 0.0;
+    fx = std::min(std::max(fx, 0.0), maxFx);
+    fy = std::min(std::max(fy, 0.0), maxFy);
+    const int c = std::min(static_cast<int>(fx), lastCol);
+    const int r = std::min(static_cast<int>(fy), lastRow);
+    const double tx = fx - c;
+    const double ty = fy - r;
+
+    const float *row0 = cells + static_cast<size_t>(r) * stride + c;
+    const float *row1 = row0 + stride;
+    const double top = row0[0] + (row0[1] - row0[0]) * tx;
+    const double bottom = row1[0] + (row1[1] - row1[0]) * tx;
+    const double z = top + (bottom - top) * ty;
+
+    zs[i] = inside ? z : nan;
+  }
+
+  // Pass 2: only points near nodata or outside the window get here.
+  for (size_t i = 0; i < count; ++i) {
+    if (std::isnan(zs[i]))
+      zs[i] = sampleSlow(xs[i], ys[i], fallback);
+  }
+}
+
+std::vector<double> DemGrid::sampleElevations(const std::vector<double> &xs,
+                                              const std::vector<double> &ys,
+                                              double fallback) const {
+  const size_t count = std::min(xs.size(), ys.size());
+  std::vector<double> zs(count);
+  sampleElevations(xs.data(), ys.data(), zs.data(), count, fallback);
+  return zs;
+}
+
+double DemGrid::sampleSlow(double x, double y, double fallback) const {
+  if (!(x >= mXMin && x <= xMax() && y >= yMin() && y <= mYMax))
+    return fallback;
+
+  double fx = (x - mXMin) * mInvCellX - 0.5;
+  double fy = (mYMax - y) * mInvCellY - 0.5;
+  fx = std::min(std::max(fx, 0.0), static_cast<double>(mWidth - 1));
+  fy = std::min(std::max(fy, 0.0), static_cast<double>(mHeight - 1));
+  const int c = std::min(static_cast<int>(fx), mWidth - 2);
+  const int r = std::min(static_cast<int>(fy), mHeight - 2);
+  const double tx = fx - c;
+  const double ty = fy - r;
+
+  const float v[4] = {cell(c, r), cell(c + 1, r), cell(c, r + 1),
+                      cell(c + 1, r + 1)};
+  const double w[4] = {(1.0 - tx) * (1.0 - ty), tx * (1.0 - ty),
+                       (1.0 - tx) * ty, tx * ty};
+
+  // Renormalise over the corners that carry data
+  double sum = 0.0;
+  double wsum = 0.0;
+  for (int k = 0; k < 4; ++k) {
+    if (!std::isnan(v[k])) {
+      sum += v[k] * w[k];
+      wsum += w[k];
+    }
+  }
+  if (wsum <= 1e-12)
+    return fallback;
+  return sum / wsum;
+}
+
+// --- DemPyramid ---
+
+void DemPyramid::build(const DemGrid &grid) {
+  clear();
+  if (!grid.isValid())
+    return;
+  mGrid = &grid;
+
+  int srcWidth = grid.width();
+  int srcHeight = grid.height();
+  const float *srcMin = grid.data();
+  const float *srcMax = grid.data();
+
+  while (srcWidth > 1 || srcHeight > 1) {
+    Level level;
+    level.width = (srcWidth + 1) / 2;
+    level.height = (srcHeight + 1) / 2;
+    const size_t size = static_cast<size_t>(level.width) * level.height;
+    level.minZ.assign(size, std::numeric_limits<float>::quiet_NaN());
+    level.maxZ.assign(size, std::numeric_limits<float>::quiet_NaN());
+
+    for (int r = 0; r < srcHeight; ++r) {
+      const size_t srcRow = static_cast<size_t>(r) * srcWidth;
+      const size_t dstRow = static_cast<size_t>(r / 2) * level.width;
+      for (int c = 0; c < srcWidth; ++c) {
+        // fmin/fmax return the non-NaN operand, so nodata drops out
+        float &lo = level.minZ[dstRow + c / 2];
+        float &hi = level.maxZ[dstRow + c / 2];
+        lo = std::fmin(lo, srcMin[srcRow + c]);
+        hi = std::fmax(hi, srcMax[srcRow + c]);
+      }
+    }
+
+    mLevels.push_back(std::move(level));
+    const Level &built = mLevels.back();
+    srcWidth = built.width;
+    srcHeight = built.height;
+    srcMin = built.minZ.data();
+    srcMax = built.maxZ.data();
+  }
+}
+
+void DemPyramid::clear() {
+  mGrid = nullptr;
+  mLevels.clear();
+}
+
+int DemPyramid::levelWidth(int level) const {
+  return level == 0 ? mGrid->width() : mLevels[level - 1].width;
+}
+
+int DemPyramid::levelHeight(int level) const {
+  return level == 0 ? mGrid->height() : mLevels[level - 1].height;
+}
+
+float DemPyramid::tileMin(int level, int col, int row) const {
+  if (level == 0)
+    return mGrid->cell(col, row);
+  const Level &l = mLevels[level - 1];
+  return l.minZ[static_cast<size_t>(row) * l.width + col];
+}
+
+float DemPyramid::tileMax(int level, int col, int row) const {
+  if (level == 0)
+    return mGrid->cell(col, row);
+  const Level &l = mLevels[level - 1];
+  return l.maxZ[static_cast<size_t>(row) * l.width + col];
+}
+
+double DemPyramid::segmentMax(double x0, double y0, double x1, double y1,
+                              double radius, double floor) const {
+  std::vector<int> stack;
+  return segmentMax(x0, y0, x1, y1, radius, floor, stack);
+}
+
+double DemPyramid::pathMax(const double *xs, const double *ys, size_t count,
+                           double radius) const {
+  const double none = -std::numeric_limits<double>::infinity();
+  double best = none;
+  std::vector<int> stack;
+  if (count == 1)
+    best = segmentMax(xs[0], ys[0], xs[0], ys[0], radius, best, stack);
+  for (size_t i = 0; i + 1 < count; ++i) {
+    if (std::isnan(xs[i]) || std::isnan(xs[i + 1]))
+      continue;
+    best = segmentMax(xs[i], ys[i], xs[i + 1], ys[i + 1], radius, best, stack);
+  }
+  return best == none ? std::numeric_limits<double>::quiet_NaN() : best;
+}
+
+double DemPyramid::segmentMax(double x0, double y0, double x1, double y1,
+                              double radius, double floor,
+                              std::vector<int> &stack) const {
+  if (!isValid())
+    return floor;
+
+  const double gx0 = mGrid->xMin() + 0.5 * mGrid->cellSizeX();
+  const double gy0 = mGrid->yMax() - 0.5 * mGrid->cellSizeY();
+  const double cx = mGrid->cellSizeX();
+  const double cy = mGrid->cellSizeY();
+  const double dx = x1 - x0;
+  const double dy = y1 - y0;
+  const double len2 = dx * dx + dy * dy;
+  const double r2 = radius * radius;
+
+  // Does the segment pass within radius of the box spanned by the cell
+  // centres of [c0,c1] x [r0,r1]? Slab test against the box grown by
+  // radius: conservative at the corners, exact enough to prune.
+  auto touches = [&](int c0, int c1, int r0, int r1) {
+    const double bx0 = gx0 + c0 * cx - radius;
+    const double bx1 = gx0 + c1 * cx + radius;
+    const double by0 = gy0 - r1 * cy - radius;
+    const double by1 = gy0 - r0 * cy + radius;
+    double tMin = 0.0;
+    double tMax = 1.0;
+    const double o[2] = {x0, y0};
+    const double d[2] = {dx, dy};
+    const double lo[2] = {bx0, by0};
+    const double hi[2] = {bx1, by1};
+    for (int axis = 0; axis < 2; ++axis) {
+      if (std::fabs(d[axis]) < 1e-12) {
+        if (o[axis] < lo[axis] || o[axis] > hi[axis])
+          return false;
+        continue;
+      }
+      double t0 = (lo[axis] - o[axis]) / d[axis];
+      double t1 = (hi[axis] - o[axis]) / d[axis];
+      if (t0 > t1)
+        std::swap(t0, t1);
+      tMin = std::max(tMin, t0);
+      tMax = std::min(tMax, t1);
+      if (tMin > tMax)
+        return false;
+    }
+    return true;
+  };
+
+  // Exact point-to-segment test for a single cell centre
+  auto within = [&](int c, int r) {
+    const double px = gx0 + c * cx - x0;
+    const double py = gy0 - r * cy - y0;
+    double t = len2 > 0.0 ? (px * dx + py * dy) / len2 : 0.0;
+    t = std::min(std::max(t, 0.0), 1.0);
+    const double ex = px - t * dx;
+    const double ey = py - t * dy;
+    return ex * ex + ey * ey <= r2;
+  };
+
+  double best = floor;
+  const int top = levelCount() - 1;
+  stack.clear();
+  for (int r = 0; r < levelHeight(top); ++r) {
+    for (int c = 0; c < levelWidth(top); ++c) {
+      stack.push_back(top);
+      stack.push_back(c);
+      stack.push_back(r);
+    }
+  }
+
+  while (!stack.empty()) {
+    const int row = stack.back();
+    stack.pop_back();
+    const int col = stack.back();
+    stack.pop_back();
+    const int level = stack.back();
+    stack.pop_back();
+
+    const float hi = tileMax(level, col, row);
+    if (std::isnan(hi) || hi <= best)
+      continue;
+
+    if (level == 0) {
+      if (within(col, row))
+        best = hi;
+      continue;
+    }
+
+    const int span = 1 << level;
+    const int c0 = col * span;
+    const int r0 = row * span;
+    const int c1 = std::min(c0 + span, mGrid->width()) - 1;
+    const int r1 = std::min(r0 + span, mGrid->height()) - 1;
+    if (!touches(c0, c1, r0, r1))
+      continue;
+
+    // Push children lowest-max first so the highest is explored next and
+    // tightens the bound early
+    struct Child {
+      int col;
+      int row;
+      float max;
+    };
+    const int child = level - 1;
+    Child kids[4];
+    int kidCount = 0;
+    for (int kr = row * 2; kr <= std::min(row * 2 + 1, levelHeight(child) - 1);
+         ++kr) {
+      for (int kc = col * 2;
+           kc <= std::min(col * 2 + 1, levelWidth(child) - 1); ++kc) {
+        const float kidMax = tileMax(child, kc, kr);
+        if (!std::isnan(kidMax) && kidMax > best)
+          kids[kidCount++] = {kc, kr, kidMax};
+      }
+    }
+    for (int i = 1; i < kidCount; ++i) {
+      for (int j = i; j > 0 && kids[j - 1].max > kids[j].max; --j)
+        std::swap(kids[j - 1], kids[j]);
+    }
+    for (int k = 0; k < kidCount; ++k) {
+      stack.push_back(child);
+      stack.push_back(kids[k].col);
+      stack.push_back(kids[k].row);
+    }
+  }
+
+  return best;
+}
@@ -0,0 +1,114 @@
+#ifndef FLYTHROUGH_DEM_H
+#define FLYTHROUGH_DEM_H
+
+#include <cstddef>
+#include <vector>
+
+// In-memory elevation window read once from the DEM provider.
+//
+// Cells are stored row-major starting at the top (north) edge, the same
+// layout QgsRasterBlock uses, so a provider block can be copied straight in.
+// Nodata cells are stored as NaN. All coordinates are in the DEM's CRS.
+//
+// Deliberately free of Qt/QGIS types: the grid is filled by the caller and
+// only does arithmetic on a contiguous float buffer.
+class DemGrid {
+public:
+  DemGrid() = default;
+
+  // Allocate a width x height grid whose top-left corner is (xMin, yMax).
+  // All cells start as nodata.
+  void reset(double xMin, double yMax, double cellSizeX, double cellSizeY,
+             int width, int height);
+  void clear();
+
+  bool isValid() const { return mWidth >= 2 && mHeight >= 2; }
+  int width() const { return mWidth; }
+  int height() const { return mHeight; }
+  double xMin() const { return mXMin; }
+  double yMax() const { return mYMax; }
+  double xMax() const { return mXMin + mWidth * mCellX; }
+  double yMin() const { return mYMax - mHeight * mCellY; }
+  double cellSizeX() const { return mCellX; }
+  double cellSizeY() const { return mCellY; }
+
+  float *data() { return mCells.data(); }
+  const float *data() const { return mCells.data(); }
+  float cell(int col, int row) const {
+    return mCells[static_cast<size_t>(row) * mWidth + col];
+  }
+
+  // Bilinear elevation at (x, y). Corners that are nodata are dropped and
+  // the remaining weights renormalised; returns fallback when the point is
+  // outside the window or all four corners are nodata.
+  double sample(double x, double y, double fallback = 0.0) const;
+
+  // Batch version of sample(). The main loop is branch-free so the compiler
+  // can vectorise it; points touching nodata are patched up afterwards.
+  void sampleElevations(const double *xs, const double *ys, double *zs,
+                        size_t count, double fallback = 0.0) const;
+  std::vector<double> sampleElevations(const std::vector<double> &xs,
+                                       const std::vector<double> &ys,
+                                       double fallback = 0.0) const;
+
+private:
+  double mXMin = 0.0;
+  double mYMax = 0.0;
+  double mCellX = 1.0;
+  double mCellY = 1.0;
+  double mInvCellX = 1.0;
+  double mInvCellY = 1.0;
+  int mWidth = 0;
+  int mHeight = 0;
+  std::vector<float> mCells;
+
+  double sampleSlow(double x, double y, double fallback) const;
+};
+
+// Min/max mip pyramid over a DemGrid.
+//
+// Level 1 stores the min and max of each 2x2 block of grid cells, level 2 of
+// each 2x2 block of level 1, and so on up to a single tile. Corridor queries
+// descend from the top and skip any tile whose max cannot beat the best value
+// found so far, so a segment costs O(log n) tiles instead of one sample per
+// metre. Nodata cells are ignored; an all-nodata tile holds NaN.
+class DemPyramid {
+public:
+  void build(const DemGrid &grid);
+  void clear();
+  bool isValid() const { return mGrid && !mLevels.empty(); }
+  int levelCount() const { return static_cast<int>(mLevels.size()) + 1; }
+
+  // Highest cell whose centre lies within radius of segment (x0,y0)-(x1,y1),
+  // or floor if nothing higher is found. With radius >= one cell diagonal
+  // this covers every cell bilinear sampling along the segment can touch.
+  double segmentMax(double x0, double y0, double x1, double y1, double radius,
+                    double floor) const;
+
+  // segmentMax() over a polyline; NaN when no cell is in the corridor
+  double pathMax(const double *xs, const double *ys, size_t count,
+                 double radius) const;
+
+  // Min/max over the block of cells covered by tile (col, row) of level
+  // (level 0 = the grid itself)
+  float tileMin(int level, int col, int row) const;
+  float tileMax(int level, int col, int row) const;
+
+private:
+  struct Level {
+    int width = 0;
+    int height = 0;
+    std::vector<float> minZ;
+    std::vector<float> maxZ;
+  };
+
+  const DemGrid *mGrid = nullptr;
+  std::vector<Level> mLevels; // mLevels[0] is pyramid level 1
+
+  int levelWidth(int level) const;
+  int levelHeight(int level) const;
+  double segmentMax(double x0, double y0, double x1, double y1, double radius,
+                    double floor, std::vector<int> &stack) const;
+};
+
+#endif // FLYTHROUGH_DEM_H
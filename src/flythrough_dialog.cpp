@@ -3,11 +3,14 @@
 #include <QCheckBox>
 #include <QComboBox>
 #include <QDoubleSpinBox>
+#include <QFileDialog>
 #include <QFormLayout>
 #include <QGroupBox>
 #include <QHBoxLayout>
 #include <QLabel>
+#include <QLineEdit>
 #include <QMessageBox>
+#include <QProgressBar>
 #include <QPushButton>
 #include <QSpinBox>
 #include <QVBoxLayout>
@@ -19,9 +22,16 @@
 #include <qgsrasterlayer.h>
 #include <qgsvectorlayer.h>
 
-FlyThroughDialog::FlyThroughDialog(QgisInterface *iface, QWidget *parent)
-    : QDialog(parent), mIface(iface) {
+FlyThroughDialog::FlyThroughDialog(QgisInterface *iface, FlyThroughCore *core,
+                                   QWidget *parent)
+    : QDialog(parent), mIface(iface), mCore(core) {
   setupUi();
+  if (mCore) {
+    connect(mCore, &FlyThroughCore::progressChanged, this,
+            &FlyThroughDialog::onProgressChanged);
+    connect(mCore, &FlyThroughCore::generationFinished, this,
+            &FlyThroughDialog::onGenerationFinished);
+  }
 }
 
 FlyThroughDialog::~FlyThroughDialog() {}
@@ -47,6 +57,17 @@ void FlyThroughDialog::setupUi() {
   // User should select a vector layer for the path.
   basicLayout->addRow("Path Layer:", mPathLayerCombo);
 
+  mPathModeCombo = new QComboBox(this);
+  mPathModeCombo->addItem("Join All Features");
+  mPathModeCombo->addItem("One Flight per Feature");
+  mPathModeCombo->setToolTip(
+      "One flight per feature prepares the flights in parallel and plays "
+      "(or renders) them one after the other");
+  basicLayout->addRow("Path Features:", mPathModeCombo);
+
+  mSelectedOnlyCheck = new QCheckBox("Selected Features Only", this);
+  basicLayout->addRow(mSelectedOnlyCheck);
+
   mOverlayLayerCombo = new QgsMapLayerComboBox(this);
   mOverlayLayerCombo->setAllowEmptyLayer(true);
   basicLayout->addRow("Overlay (optional):", mOverlayLayerCombo);
@@ -54,6 +75,7 @@ void FlyThroughDialog::setupUi() {
   mAltitudeModeCombo = new QComboBox(this);
   mAltitudeModeCombo->addItem("Above Safe Path");
   mAltitudeModeCombo->addItem("Fixed Altitude (AMSL)");
+  mAltitudeModeCombo->addItem("Terrain Following");
   basicLayout->addRow("Altitude Mode:", mAltitudeModeCombo);
 
   mCameraHeightSpin = new QDoubleSpinBox(this);
@@ -62,6 +84,33 @@ void FlyThroughDialog::setupUi() {
   mCameraHeightSpin->setSuffix(" m");
   basicLayout->addRow("Camera Height:", mCameraHeightSpin);
 
+  mFollowWindowSpin = new QDoubleSpinBox(this);
+  mFollowWindowSpin->setRange(0.0, 20000.0);
+  mFollowWindowSpin->setValue(500.0);
+  mFollowWindowSpin->setSuffix(" m");
+  mFollowWindowSpin->setToolTip(
+      "Terrain Following: the camera keeps its height above the highest "
+      "terrain this far behind and ahead of it");
+  basicLayout->addRow("Terrain Window:", mFollowWindowSpin);
+
+  mMaxGradeSpin = new QDoubleSpinBox(this);
+  mMaxGradeSpin->setRange(0.0, 100.0);
+  mMaxGradeSpin->setValue(25.0);
+  mMaxGradeSpin->setSuffix(" %");
+  mMaxGradeSpin->setToolTip("Terrain Following: steepest climb or descent, "
+                            "as a grade along the path. 0 = unlimited.");
+  basicLayout->addRow("Max Climb/Descent:", mMaxGradeSpin);
+
+  auto updateFollowControls = [this](int index) {
+    const bool follow = index == 2;
+    mFollowWindowSpin->setEnabled(follow);
+    mMaxGradeSpin->setEnabled(follow);
+  };
+  connect(mAltitudeModeCombo,
+          QOverload<int>::of(&QComboBox::currentIndexChanged), this,
+          updateFollowControls);
+  updateFollowControls(mAltitudeModeCombo->currentIndex());
+
   mCameraPitchSpin = new QDoubleSpinBox(this);
   mCameraPitchSpin->setRange(-90.0, 90.0);
   mCameraPitchSpin->setValue(65.0);
@@ -93,11 +142,39 @@ void FlyThroughDialog::setupUi() {
   mSpeedSpin->setSuffix(" m/s");
   animLayout->addRow("Speed:", mSpeedSpin);
 
-  mSmoothingSpin = new QSpinBox(this);
-  mSmoothingSpin->setRange(0, 10);
-  mSmoothingSpin->setValue(0);
+  mSmoothingSpin = new QDoubleSpinBox(this);
+  mSmoothingSpin->setRange(0.0, 1000.0);
+  mSmoothingSpin->setValue(0.0);
+  mSmoothingSpin->setSingleStep(5.0);
+  mSmoothingSpin->setSuffix(" m");
+  mSmoothingSpin->setSpecialValueText("Off");
+  mSmoothingSpin->setToolTip("Gaussian smoothing radius (sigma) along the "
+                             "path");
   animLayout->addRow("Path Smoothing:", mSmoothingSpin);
 
+  mSimplifySpin = new QDoubleSpinBox(this);
+  mSimplifySpin->setRange(0.0, 100.0);
+  mSimplifySpin->setValue(0.0);
+  mSimplifySpin->setSingleStep(0.5);
+  mSimplifySpin->setSuffix(" m");
+  mSimplifySpin->setSpecialValueText("Off");
+  mSimplifySpin->setToolTip(
+      "Drop vertices while the path stays within this distance of the "
+      "original. Use for dense GPS or LiDAR tracks.");
+  animLayout->addRow("Path Simplification:", mSimplifySpin);
+
+  mSamplingSpin = new QDoubleSpinBox(this);
+  mSamplingSpin->setRange(0.0, 100.0);
+  mSamplingSpin->setValue(2.0);
+  mSamplingSpin->setSingleStep(0.5);
+  mSamplingSpin->setSuffix(" m");
+  mSamplingSpin->setSpecialValueText("Off");
+  mSamplingSpin->setToolTip(
+      "Add path vertices where the terrain or a turn departs more than this "
+      "from a straight line: dense over ridges and in bends, sparse over "
+      "flat straight runs");
+  animLayout->addRow("Terrain Sampling:", mSamplingSpin);
+
   mBankingCheck = new QCheckBox("Enable Camera Banking", this);
   mBankingCheck->setChecked(true);
   animLayout->addRow(mBankingCheck);
@@ -119,6 +196,13 @@ void FlyThroughDialog::setupUi() {
   mFpsSpin->setValue(30);
   animLayout->addRow("FPS:", mFpsSpin);
 
+  mKeyframeCacheCheck = new QCheckBox("Reuse Cached Keyframes", this);
+  mKeyframeCacheCheck->setChecked(true);
+  mKeyframeCacheCheck->setToolTip(
+      "Load keyframes saved by an earlier run with the same path, DEM and "
+      "settings instead of generating them again");
+  animLayout->addRow(mKeyframeCacheCheck);
+
   animGroup->setLayout(animLayout);
   mainLayout->addWidget(animGroup);
 
@@ -130,36 +214,110 @@ void FlyThroughDialog::setupUi() {
   mTerrainShadingCheck->setChecked(true);
   renderLayout->addRow(mTerrainShadingCheck);
 
-  mExportVideoCheck = new QCheckBox("Export Video (DISABLED)", this);
-  mExportVideoCheck->setEnabled(false);
-  mExportVideoCheck->setToolTip("Video export not implemented in this version");
-  renderLayout->addRow(mExportVideoCheck);
+  mPrefetchSpin = new QDoubleSpinBox(this);
+  mPrefetchSpin->setRange(0.0, 60.0);
+  mPrefetchSpin->setValue(8.0);
+  mPrefetchSpin->setSuffix(" s");
+  mPrefetchSpin->setSpecialValueText("Off");
+  mPrefetchSpin->setToolTip(
+      "Read the DEM and draw the map layers along the path this far ahead "
+      "of the camera, so terrain is cached before it comes into view");
+  renderLayout->addRow("Prefetch Ahead:", mPrefetchSpin);
+
+  mExportFramesCheck = new QCheckBox("Render Frames to Disk (offline)", this);
+  mExportFramesCheck->setToolTip(
+      "Step the flight at exactly 1/FPS per frame, wait for each frame's "
+      "terrain to load and save it as a numbered image sequence");
+  renderLayout->addRow(mExportFramesCheck);
+
+  QHBoxLayout *exportDirLayout = new QHBoxLayout();
+  mExportDirEdit = new QLineEdit(this);
+  exportDirLayout->addWidget(mExportDirEdit);
+  mExportBrowseBtn = new QPushButton("Browse...", this);
+  connect(mExportBrowseBtn, &QPushButton::clicked, this,
+          &FlyThroughDialog::onBrowseExportDir);
+  exportDirLayout->addWidget(mExportBrowseBtn);
+  renderLayout->addRow("Output Folder:", exportDirLayout);
+
+  mExportFormatCombo = new QComboBox(this);
+  mExportFormatCombo->addItem("PNG");
+  mExportFormatCombo->addItem("RAW");
+  mExportFormatCombo->setToolTip(
+      "RAW writes uncompressed RGBA8888 frames (sizes in info.txt), which is "
+      "faster to write than PNG");
+  renderLayout->addRow("Frame Format:", mExportFormatCombo);
+
+  auto updateExportControls = [this](bool enabled) {
+    mExportDirEdit->setEnabled(enabled);
+    mExportBrowseBtn->setEnabled(enabled);
+    mExportFormatCombo->setEnabled(enabled);
+  };
+  connect(mExportFramesCheck, &QCheckBox::toggled, this, updateExportControls);
+  updateExportControls(false);
+
+  mFrameStatsCheck = new QCheckBox("Save Frame Timing Report", this);
+  mFrameStatsCheck->setToolTip(
+      "After playback, write per-phase frame timing histograms to "
+      "flythrough/frame_stats.json in the QGIS profile folder. A summary "
+      "is always logged.");
+  renderLayout->addRow(mFrameStatsCheck);
 
   renderGroup->setLayout(renderLayout);
   mainLayout->addWidget(renderGroup);
 
+  // --- Progress ---
+  mStatusLabel = new QLabel(this);
+  mainLayout->addWidget(mStatusLabel);
+
+  mProgressBar = new QProgressBar(this);
+  mProgressBar->setRange(0, 100);
+  mProgressBar->setValue(0);
+  mProgressBar->setVisible(false);
+  mainLayout->addWidget(mProgressBar);
+
   // --- Buttons ---
   QHBoxLayout *btnLayout = new QHBoxLayout();
   btnLayout->addStretch();
 
-  QPushButton *generateBtn = new QPushButton("Generate Flythrough", this);
-  generateBtn->setDefault(true);
-  connect(generateBtn, &QPushButton::clicked, this,
+  mPreviewBtn = new QPushButton("Preview", this);
+  mPreviewBtn->setToolTip(
+      "Fly a quick approximation of the flight: coarse terrain, one layer, "
+      "no shading and no waiting for tiles to load");
+  connect(mPreviewBtn, &QPushButton::clicked, this,
+          &FlyThroughDialog::onPreviewClicked);
+  btnLayout->addWidget(mPreviewBtn);
+
+  mGenerateBtn = new QPushButton("Generate Flythrough", this);
+  mGenerateBtn->setDefault(true);
+  connect(mGenerateBtn, &QPushButton::clicked, this,
           &FlyThroughDialog::onGenerateClicked);
-  btnLayout->addWidget(generateBtn);
+  btnLayout->addWidget(mGenerateBtn);
+
+  mCancelBtn = new QPushButton("Cancel", this);
+  mCancelBtn->setEnabled(false);
+  connect(mCancelBtn, &QPushButton::clicked, this,
+          &FlyThroughDialog::onCancelClicked);
+  btnLayout->addWidget(mCancelBtn);
 
   QPushButton *closeBtn = new QPushButton("Close", this);
-  connect(closeBtn, &QPushButton::clicked, this, &QDialog::accept);
+  connect(closeBtn, &QPushButton::clicked, this, &QDialog::reject);
   btnLayout->addWidget(closeBtn);
 
   mainLayout->addLayout(btnLayout);
 }
 
-void FlyThroughDialog::onPreviewClicked() {
-  onGenerateClicked(); // Same as generate for now
+void FlyThroughDialog::onBrowseExportDir() {
+  const QString dir = QFileDialog::getExistingDirectory(
+      this, "Frame Output Folder", mExportDirEdit->text());
+  if (!dir.isEmpty())
+    mExportDirEdit->setText(dir);
 }
 
-void FlyThroughDialog::onGenerateClicked() {
+void FlyThroughDialog::onPreviewClicked() { startRun(true); }
+
+void FlyThroughDialog::onGenerateClicked() { startRun(false); }
+
+void FlyThroughDialog::startRun(bool preview) {
   // Validate inputs
   if (!mDemLayerCombo->currentLayer() || !mPathLayerCombo->currentLayer()) {
     QMessageBox::warning(this, "Missing Layers",
@@ -167,6 +325,13 @@ void FlyThroughDialog::onGenerateClicked() {
     return;
   }
 
+  if (!preview && mExportFramesCheck->isChecked() &&
+      mExportDirEdit->text().trimmed().isEmpty()) {
+    QMessageBox::warning(this, "Missing Output Folder",
+                         "Please choose a folder for the rendered frames.");
+    return;
+  }
+
   // Build parameters
   FlythroughParams params;
   params.pathLayer =
@@ -176,22 +341,76 @@ void FlyThroughDialog::onGenerateClicked() {
   params.overlayLayer = mOverlayLayerCombo->currentLayer();
   params.altitudeMode = mAltitudeModeCombo->currentText();
   params.cameraHeight = mCameraHeightSpin->value();
+  params.followWindow = mFollowWindowSpin->value();
+  params.maxGrade = mMaxGradeSpin->value() / 100.0;
   params.cameraPitch = mCameraPitchSpin->value();
   params.fieldOfView = mFovSpin->value();
   params.verticalExaggeration = mVerticalExagSpin->value();
   params.speed = mSpeedSpin->value();
-  params.smoothing = mSmoothingSpin->value();
+  params.smoothingSigma = mSmoothingSpin->value();
+  params.simplifyTolerance = mSimplifySpin->value();
+  params.samplingTolerance = mSamplingSpin->value();
   params.enableBanking = mBankingCheck->isChecked();
   params.bankingFactor = mBankingFactorSpin->value();
   params.terrainShading = mTerrainShadingCheck->isChecked();
+  params.prefetchSeconds = mPrefetchSpin->value();
   params.lookaheadDistance = mLookaheadSpin->value();
   params.fps = mFpsSpin->value();
+  params.useKeyframeCache = mKeyframeCacheCheck->isChecked();
+  params.perFeature = mPathModeCombo->currentIndex() == 1;
+  params.selectedOnly = mSelectedOnlyCheck->isChecked();
+  params.exportFrames = mExportFramesCheck->isChecked();
+  params.exportDirectory = mExportDirEdit->text().trimmed();
+  params.exportFormat = mExportFormatCombo->currentText();
+  params.saveFrameStats = mFrameStatsCheck->isChecked();
+  params.preview = preview;
+
+  // Generation runs in the background; the dialog stays open to show
+  // progress until playback starts
+  if (!mCore || !mCore->generateFlythrough(params))
+    return;
+  setRunning(true);
+}
+
+void FlyThroughDialog::onCancelClicked() {
+  if (mCore && mCore->isGenerating()) {
+    mStatusLabel->setText("Cancelling...");
+    mCore->cancelGeneration();
+  }
+}
 
-  // Create and run core logic
-  FlyThroughCore *core = new FlyThroughCore(mIface);
-  if (core->generateFlythrough(params)) {
-    // Success - close dialog
+void FlyThroughDialog::onProgressChanged(int percent, const QString &stage) {
+  mProgressBar->setValue(percent);
+  mStatusLabel->setText(stage);
+}
+
+void FlyThroughDialog::onGenerationFinished(bool success) {
+  if (success) {
+    // Playback goes on in the 3D view
     accept();
+    return;
+  }
+
+  setRunning(false);
+  mStatusLabel->setText("Generation stopped.");
+}
+
+void FlyThroughDialog::reject() {
+  // The job winds down in the background
+  if (mCore && mCore->isGenerating()) {
+    disconnect(mCore, nullptr, this, nullptr);
+    mCore->cancelGeneration();
+  }
+  QDialog::reject();
+}
+
+void FlyThroughDialog::setRunning(bool running) {
+  mGenerateBtn->setEnabled(!running);
+  mPreviewBtn->setEnabled(!running);
+  mCancelBtn->setEnabled(running);
+  mProgressBar->setVisible(running);
+  if (running) {
+    mProgressBar->setValue(0);
+    mStatusLabel->setText("Starting...");
   }
-  // Core manages its own lifecycle (deletes when animation stops)
 }
@@ -5,41 +5,79 @@
 #include <QComboBox>
 #include <QDialog>
 #include <QDoubleSpinBox>
+#include <QLabel>
+#include <QLineEdit>
+#include <QPointer>
+#include <QProgressBar>
+#include <QPushButton>
 #include <qgisinterface.h>
 #include <qgsmaplayercombobox.h>
 
+class FlyThroughCore;
+
 class FlyThroughDialog : public QDialog {
   Q_OBJECT
 
 public:
-  explicit FlyThroughDialog(QgisInterface *iface, QWidget *parent = nullptr);
+  // core is the plugin's, kept between runs so unchanged stages are reused
+  FlyThroughDialog(QgisInterface *iface, FlyThroughCore *core,
+                   QWidget *parent = nullptr);
   ~FlyThroughDialog();
 
+public slots:
+  void reject() override;
+
 private slots:
   void onGenerateClicked();
   void onPreviewClicked();
+  void onBrowseExportDir();
+  void onCancelClicked();
+  void onProgressChanged(int percent, const QString &stage);
+  void onGenerationFinished(bool success);
 
 private:
   QgisInterface *mIface = nullptr;
+  QPointer<FlyThroughCore> mCore;
   void setupUi();
+  void setRunning(bool running);
+  // Generate and play (or render) the flight; preview trades drawing
+  // detail for a fast start
+  void startRun(bool preview);
 
   // UI Elements (matching Python dialog)
   QgsMapLayerComboBox *mDemLayerCombo = nullptr;
   QgsMapLayerComboBox *mPathLayerCombo = nullptr;
+  QComboBox *mPathModeCombo = nullptr;
+  QCheckBox *mSelectedOnlyCheck = nullptr;
   QgsMapLayerComboBox *mOverlayLayerCombo = nullptr;
   QComboBox *mAltitudeModeCombo = nullptr;
   QDoubleSpinBox *mCameraHeightSpin = nullptr;
+  QDoubleSpinBox *mFollowWindowSpin = nullptr;
+  QDoubleSpinBox *mMaxGradeSpin = nullptr;
   QDoubleSpinBox *mCameraPitchSpin = nullptr;
   QDoubleSpinBox *mFovSpin = nullptr;
   QDoubleSpinBox *mVerticalExagSpin = nullptr;
   QDoubleSpinBox *mSpeedSpin = nullptr;
-  QSpinBox *mSmoothingSpin = nullptr;
+  QDoubleSpinBox *mSmoothingSpin = nullptr;
+  QDoubleSpinBox *mSimplifySpin = nullptr;
+  QDoubleSpinBox *mSamplingSpin = nullptr;
   QDoubleSpinBox *mBankingFactorSpin = nullptr;
   QDoubleSpinBox *mLookaheadSpin = nullptr;
   QSpinBox *mFpsSpin = nullptr;
   QCheckBox *mBankingCheck = nullptr;
   QCheckBox *mTerrainShadingCheck = nullptr;
-  QCheckBox *mExportVideoCheck = nullptr;
+  QCheckBox *mKeyframeCacheCheck = nullptr;
+  QCheckBox *mExportFramesCheck = nullptr;
+  QLineEdit *mExportDirEdit = nullptr;
+  QPushButton *mExportBrowseBtn = nullptr;
+  QComboBox *mExportFormatCombo = nullptr;
+  QCheckBox *mFrameStatsCheck = nullptr;
+  QDoubleSpinBox *mPrefetchSpin = nullptr;
+  QProgressBar *mProgressBar = nullptr;
+  QLabel *mStatusLabel = nullptr;
+  QPushButton *mPreviewBtn = nullptr;
+  QPushButton *mGenerateBtn = nullptr;
+  QPushButton *mCancelBtn = nullptr;
 };
 
 #endif // FLYTHROUGH_DIALOG_H
@@ -0,0 +1,194 @@
+#include "flythrough_export.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QGuiApplication>
+#include <QMetaMethod>
+#include <QMutexLocker>
+#include <QPixmap>
+#include <QScreen>
+#include <QTimer>
+#include <QWindow>
+
+// --- FrameCapture ---
+
+FrameCapture::FrameCapture(QWidget *canvas, QObject *parent)
+    : QObject(parent), mCanvas(canvas) {
+  if (!canvas)
+    return;
+
+  // The engine is created as a child of the canvas
+  for (QObject *child : canvas->findChildren<QObject *>()) {
+    if (!child->inherits("QgsAbstract3DEngine"))
+      continue;
+
+    const QMetaObject *meta = child->metaObject();
+    const int request = meta->indexOfMethod("requestCaptureImage()");
+    const int signal = meta->indexOfSignal("imageCaptured(QImage)");
+    if (request < 0 || signal < 0)
+      continue;
+
+    connect(child, meta->method(signal), this,
+            metaObject()->method(
+                metaObject()->indexOfSlot("onImageCaptured(QImage)")));
+    mEngine = child;
+    break;
+  }
+
+  qDebug() << "[FTP] Frame capture via"
+           << (mEngine ? "3D engine" : "screen grab");
+}
+
+QImage FrameCapture::capture(int timeoutMs) {
+  if (!mCanvas)
+    return QImage();
+  if (!mEngine)
+    return grabFromScreen();
+
+  mCaptured = QImage();
+  QTimer timeout;
+  timeout.setSingleShot(true);
+  connect(&timeout, &QTimer::timeout, &mLoop, &QEventLoop::quit);
+  timeout.start(timeoutMs);
+
+  QMetaObject::invokeMethod(mEngine, "requestCaptureImage",
+                            Qt::DirectConnection);
+  if (mCaptured.isNull())
+    mLoop.exec();
+
+  return mCaptured;
+}
+
+void FrameCapture::onImageCaptured(const QImage &image) {
+  mCaptured = image;
+  mLoop.quit();
+}
+
+QImage FrameCapture::grabFromScreen() const {
+  QWindow *window = mCanvas->window()->windowHandle();
+  QScreen *screen =
+      window ? window->screen() : QGuiApplication::primaryScreen();
+  if (!screen)
+    return QImage();
+
+  const QPoint origin =
+      mCanvas->mapToGlobal(QPoint(0, 0)) - screen->geometry().topLeft();
+  return screen
+      ->grabWindow(0, origin.x(), origin.y(), mCanvas->width(),
+                   mCanvas->height())
+      .toImage();
+}
+
+// --- FrameWriter ---
+
+FrameWriter::FrameWriter(const QString &directory, const QString &format,
+                         int maxQueued, QObject *parent)
+    : QThread(parent), mDirectory(directory), mFormat(format.toUpper()),
+      mMaxQueued(qMax(1, maxQueued)) {}
+
+FrameWriter::~FrameWriter() { finish(); }
+
+void FrameWriter::enqueue(int index, const QImage &image) {
+  QMutexLocker locker(&mMutex);
+  while (mQueue.size() >= mMaxQueued && mError.isEmpty())
+    mNotFull.wait(&mMutex);
+  if (!mError.isEmpty())
+    return; // Writer gave up; caller checks errorString()
+
+  PendingFrame frame;
+  frame.index = index;
+  frame.image = image;
+  mQueue.enqueue(frame);
+  mNotEmpty.wakeOne();
+}
+
+void FrameWriter::finish() {
+  {
+    QMutexLocker locker(&mMutex);
+    mClosing = true;
+    mNotEmpty.wakeAll();
+  }
+  if (isRunning())
+    wait();
+}
+
+int FrameWriter::framesWritten() const {
+  QMutexLocker locker(&mMutex);
+  return mWritten;
+}
+
+QString FrameWriter::errorString() const {
+  QMutexLocker locker(&mMutex);
+  return mError;
+}
+
+void FrameWriter::run() {
+  for (;;) {
+    PendingFrame frame;
+    {
+      QMutexLocker locker(&mMutex);
+      while (mQueue.isEmpty() && !mClosing)
+        mNotEmpty.wait(&mMutex);
+      if (mQueue.isEmpty())
+        return; // Closing and drained
+      frame = mQueue.dequeue();
+      mNotFull.wakeOne();
+    }
+
+    QString error;
+    const bool ok = writeFrame(frame, error);
+
+    QMutexLocker locker(&mMutex);
+    if (!ok) {
+      mError = error;
+      mQueue.clear();
+      mNotFull.wakeAll();
+      return;
+    }
+    ++mWritten;
+  }
+}
+
+bool FrameWriter::writeFrame(const PendingFrame &frame, QString &error) {
+  const QString base =
+      QDir(mDirectory)
+          .filePath(QString("frame_%1").arg(frame.index, 6, 10, QChar('0')));
+
+  if (mFormat == "RAW") {
+    const QImage rgba = frame.image.convertToFormat(QImage::Format_RGBA8888);
+
+    if (!mInfoWritten) {
+      QFile info(QDir(mDirectory).filePath("info.txt"));
+      if (info.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        info.write(QString("format=rgba8888\nwidth=%1\nheight=%2\n")
+                       .arg(rgba.width())
+                       .arg(rgba.height())
+                       .toUtf8());
+      }
+      mInfoWritten = true;
+    }
+
+    QFile file(base + ".rgba");
+    if (!file.open(QIODevice::WriteOnly)) {
+      error = QString("Cannot write %1").arg(file.fileName());
+      return false;
+    }
+    // Rows may be padded in memory; write them tightly packed
+    const int rowBytes = rgba.width() * 4;
+    for (int y = 0; y < rgba.height(); ++y) {
+      if (file.write(reinterpret_cast<const char *>(rgba.constScanLine(y)),
+                     rowBytes) != rowBytes) {
+        error = QString("Cannot write %1").arg(file.fileName());
+        return false;
+      }
+    }
+    return true;
+  }
+
+  const QString path = base + ".png";
+  if (!frame.image.save(path, "PNG")) {
+    error = QString("Cannot write %1").arg(path);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,91 @@
+#ifndef FLYTHROUGH_EXPORT_H
+#define FLYTHROUGH_EXPORT_H
+
+#include <QEventLoop>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QPointer>
+#include <QQueue>
+#include <QThread>
+#include <QWaitCondition>
+#include <QWidget>
+
+// Grabs the current contents of a 3D map canvas.
+//
+// Prefers the 3D engine's own capture (requestCaptureImage() ->
+// imageCaptured(QImage)), reached through the meta-object system like the
+// rest of the 3D API. Falls back to grabbing the canvas area from the
+// screen when the engine doesn't expose it.
+class FrameCapture : public QObject {
+  Q_OBJECT
+
+public:
+  explicit FrameCapture(QWidget *canvas, QObject *parent = nullptr);
+
+  bool usesEngineCapture() const { return !mEngine.isNull(); }
+
+  // Null image on failure or timeout
+  QImage capture(int timeoutMs);
+
+private slots:
+  void onImageCaptured(const QImage &image);
+
+private:
+  QPointer<QWidget> mCanvas;
+  QPointer<QObject> mEngine;
+  QEventLoop mLoop;
+  QImage mCaptured;
+
+  QImage grabFromScreen() const;
+};
+
+// Writes captured frames as a numbered image sequence on its own thread,
+// so encoding and disk I/O overlap with rendering the next frame.
+//
+// The queue is bounded: enqueue() blocks while maxQueued frames are still
+// waiting, which keeps memory flat when the disk is slower than the render.
+class FrameWriter : public QThread {
+  Q_OBJECT
+
+public:
+  // format is "PNG" (frame_000000.png) or "RAW" (frame_000000.rgba, tightly
+  // packed RGBA8888 rows, with dimensions in info.txt)
+  FrameWriter(const QString &directory, const QString &format,
+              int maxQueued = 8, QObject *parent = nullptr);
+  ~FrameWriter() override;
+
+  void enqueue(int index, const QImage &image);
+
+  // Write out everything queued and stop the thread
+  void finish();
+
+  int framesWritten() const;
+  QString errorString() const;
+
+protected:
+  void run() override;
+
+private:
+  struct PendingFrame {
+    int index = 0;
+    QImage image;
+  };
+
+  QString mDirectory;
+  QString mFormat;
+  int mMaxQueued = 8;
+
+  mutable QMutex mMutex;
+  QWaitCondition mNotEmpty;
+  QWaitCondition mNotFull;
+  QQueue<PendingFrame> mQueue;
+  bool mClosing = false;
+  bool mInfoWritten = false;
+  int mWritten = 0;
+  QString mError;
+
+  bool writeFrame(const PendingFrame &frame, QString &error);
+};
+
+#endif // FLYTHROUGH_EXPORT_H
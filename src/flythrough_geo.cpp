@@ -0,0 +1,170 @@
+#include "flythrough_geo.h"
+#include <QDebug>
+#include <QVector>
+#include <QtGlobal>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <qgscsexception.h>
+
+void GeoContext::setup(const QgsCoordinateReferenceSystem &viewCrs,
+                       const QgsCoordinateReferenceSystem &demCrs,
+                       const QgsCoordinateTransformContext &transformContext,
+                       const QString &ellipsoid) {
+  mViewCrs = viewCrs;
+  mDemCrs = demCrs;
+  mTransformContext = transformContext;
+
+  mNeedsDemTransform = demCrs.isValid() && viewCrs != demCrs;
+  if (mNeedsDemTransform)
+    mViewToDem = QgsCoordinateTransform(viewCrs, demCrs, transformContext);
+  else
+    mViewToDem = QgsCoordinateTransform();
+
+  // Ellipsoid lookup happens here, once per run
+  mDistanceArea = QgsDistanceArea();
+  mDistanceArea.setSourceCrs(viewCrs, transformContext);
+  mDistanceArea.setEllipsoid(ellipsoid);
+
+  mPlanar = false;
+  mPlanarScale = 1.0;
+}
+
+void GeoContext::enablePlanarIfUniform(const QgsRectangle &workArea) {
+  mPlanar = false;
+  mPlanarScale = 1.0;
+  if (mViewCrs.isGeographic() || workArea.isNull())
+    return;
+
+  // Compare ellipsoidal and planar lengths of the work area's edges. A
+  // conformal projection with a small footprint (UTM zone, national grid)
+  // passes; Web Mercator over a large latitude range does not.
+  const QgsPointXY bl(workArea.xMinimum(), workArea.yMinimum());
+  const QgsPointXY br(workArea.xMaximum(), workArea.yMinimum());
+  const QgsPointXY tl(workArea.xMinimum(), workArea.yMaximum());
+  const QgsPointXY tr(workArea.xMaximum(), workArea.yMaximum());
+  const QgsPointXY edges[4][2] = {{bl, br}, {tl, tr}, {bl, tl}, {br, tr}};
+
+  double minScale = std::numeric_limits<double>::max();
+  double maxScale = 0.0;
+  double sumScale = 0.0;
+  int count = 0;
+  for (const auto &edge : edges) {
+    const double planar = std::sqrt(edge[0].sqrDist(edge[1]));
+    if (planar < 1e-6)
+      continue;
+    const double scale = mDistanceArea.measureLine(edge[0], edge[1]) / planar;
+    if (!std::isfinite(scale) || scale <= 0.0)
+      return;
+    minScale = qMin(minScale, scale);
+    maxScale = qMax(maxScale, scale);
+    sumScale += scale;
+    ++count;
+  }
+
+  if (count == 0) {
+    // Degenerate area (single point): scale is irrelevant
+    mPlanar = true;
+    return;
+  }
+
+  if (maxScale / minScale - 1.0 < 1e-3) {
+    mPlanar = true;
+    mPlanarScale = sumScale / count;
+    qDebug() << "[FTP] Using planar distances, scale" << mPlanarScale;
+  }
+}
+
+void GeoContext::toView(const QgsCoordinateReferenceSystem &sourceCrs,
+                        QList<QgsPointXY> &points) const {
+  if (!sourceCrs.isValid() || sourceCrs == mViewCrs || points.isEmpty())
+    return;
+
+  QgsCoordinateTransform ct(sourceCrs, mViewCrs, mTransformContext);
+  std::vector<double> xs(points.size());
+  std::vector<double> ys(points.size());
+  for (int i = 0; i < points.size(); ++i) {
+    xs[i] = points[i].x();
+    ys[i] = points[i].y();
+  }
+  transformBatch(ct, xs.data(), ys.data(), points.size());
+  for (int i = 0; i < points.size(); ++i)
+    points[i].set(xs[i], ys[i]);
+}
+
+void GeoContext::viewToDem(std::vector<double> &xs,
+                           std::vector<double> &ys) const {
+  if (!mNeedsDemTransform)
+    return;
+  transformBatch(mViewToDem, xs.data(), ys.data(),
+                 static_cast<int>(qMin(xs.size(), ys.size())));
+}
+
+bool GeoContext::viewToDem(double &x, double &y) const {
+  if (!mNeedsDemTransform)
+    return true;
+  double z = 0.0;
+  try {
+    mViewToDem.transformInPlace(x, y, z);
+  } catch (const QgsCsException &) {
+    x = y = std::numeric_limits<double>::quiet_NaN();
+    return false;
+  }
+  return true;
+}
+
+double GeoContext::distance(const QgsPointXY &p1, const QgsPointXY &p2) const {
+  if (mPlanar)
+    return std::sqrt(p1.sqrDist(p2)) * mPlanarScale;
+  return mDistanceArea.measureLine(p1, p2);
+}
+
+double GeoContext::mapUnitsPerMetre(const QgsRectangle &area) const {
+  if (mPlanar && mPlanarScale > 0.0)
+    return 1.0 / mPlanarScale;
+  if (area.isNull())
+    return 1.0;
+
+  // Measure a short east-west step at the centre of the area
+  const QgsPointXY centre = area.center();
+  const double step = qMax(1.0, qMax(area.width(), area.height()) * 0.01);
+  const double metres = mDistanceArea.measureLine(
+      centre, QgsPointXY(centre.x() + step, centre.y()));
+  if (!std::isfinite(metres) || metres <= 0.0)
+    return 1.0;
+  return step / metres;
+}
+
+void GeoContext::transformBatch(const QgsCoordinateTransform &ct, double *xs,
+                                double *ys, int count) {
+  if (count <= 0)
+    return;
+
+  QVector<double> x(count);
+  QVector<double> y(count);
+  QVector<double> z(count, 0.0);
+  std::copy(xs, xs + count, x.begin());
+  std::copy(ys, ys + count, y.begin());
+
+  try {
+    ct.transformInPlace(x, y, z);
+  } catch (const QgsCsException &) {
+    // One bad point fails the whole batch; redo point by point so only the
+    // offending points are lost
+    for (int i = 0; i < count; ++i) {
+      double px = xs[i];
+      double py = ys[i];
+      double pz = 0.0;
+      try {
+        ct.transformInPlace(px, py, pz);
+      } catch (const QgsCsException &) {
+        px = py = std::numeric_limits<double>::quiet_NaN();
+      }
+      x[i] = px;
+      y[i] = py;
+    }
+  }
+
+  std::copy(x.constBegin(), x.constEnd(), xs);
+  std::copy(y.constBegin(), y.constEnd(), ys);
+}
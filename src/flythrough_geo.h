@@ -0,0 +1,70 @@
+#ifndef FLYTHROUGH_GEO_H
+#define FLYTHROUGH_GEO_H
+
+#include <QList>
+#include <QString>
+#include <qgscoordinatereferencesystem.h>
+#include <qgscoordinatetransform.h>
+#include <qgscoordinatetransformcontext.h>
+#include <qgsdistancearea.h>
+#include <qgspointxy.h>
+#include <qgsrectangle.h>
+#include <vector>
+
+// Per-run transform and measurement context.
+//
+// Built once per flythrough: owns the view->DEM transform and a configured
+// QgsDistanceArea so neither is reconstructed per point or per segment.
+// Point arrays are transformed in batches with transformInPlace().
+class GeoContext {
+public:
+  void setup(const QgsCoordinateReferenceSystem &viewCrs,
+             const QgsCoordinateReferenceSystem &demCrs,
+             const QgsCoordinateTransformContext &transformContext,
+             const QString &ellipsoid);
+
+  // Switch to planar measurement when the view CRS is projected and its
+  // scale is uniform across workArea (within 0.1%). One factor then
+  // converts map units to the ellipsoidal distance everywhere on the path.
+  void enablePlanarIfUniform(const QgsRectangle &workArea);
+
+  const QgsCoordinateReferenceSystem &viewCrs() const { return mViewCrs; }
+  const QgsCoordinateReferenceSystem &demCrs() const { return mDemCrs; }
+  bool needsDemTransform() const { return mNeedsDemTransform; }
+  const QgsCoordinateTransform &viewToDemTransform() const {
+    return mViewToDem;
+  }
+  bool isPlanar() const { return mPlanar; }
+
+  // Transform arbitrary-CRS points into the view CRS in one batch
+  void toView(const QgsCoordinateReferenceSystem &sourceCrs,
+              QList<QgsPointXY> &points) const;
+
+  // View -> DEM CRS, in place. Points that fail to transform become NaN.
+  void viewToDem(std::vector<double> &xs, std::vector<double> &ys) const;
+  bool viewToDem(double &x, double &y) const;
+
+  // Distance between two view-CRS points, in the units QgsDistanceArea
+  // reports for the project ellipsoid
+  double distance(const QgsPointXY &p1, const QgsPointXY &p2) const;
+
+  // View-CRS map units per metre of ground distance around the centre of
+  // area, for converting metre tolerances. 1 if it can't be measured.
+  double mapUnitsPerMetre(const QgsRectangle &area) const;
+
+private:
+  QgsCoordinateReferenceSystem mViewCrs;
+  QgsCoordinateReferenceSystem mDemCrs;
+  QgsCoordinateTransformContext mTransformContext;
+  QgsCoordinateTransform mViewToDem;
+  bool mNeedsDemTransform = false;
+
+  QgsDistanceArea mDistanceArea;
+  bool mPlanar = false;
+  double mPlanarScale = 1.0;
+
+  static void transformBatch(const QgsCoordinateTransform &ct, double *xs,
+                             double *ys, int count);
+};
+
+#endif // FLYTHROUGH_GEO_H
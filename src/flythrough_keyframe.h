@@ -0,0 +1,16 @@
+#ifndef FLYTHROUGH_KEYFRAME_H
+#define FLYTHROUGH_KEYFRAME_H
+
+// Camera state at one path vertex. Plain data with no Qt/QGIS types so the
+// path and spline code can use it without pulling in the plugin headers.
+struct Keyframe {
+  double time;     // Seconds from start
+  double x, y;     // Map coordinates (View CRS)
+  double z;        // Absolute camera altitude
+  double ground_z; // Terrain elevation at this point
+  double yaw;      // Heading (0-360°)
+  double pitch;    // Look angle (-90 to 90°)
+  double roll;     // Banking angle (±45°)
+};
+
+#endif // FLYTHROUGH_KEYFRAME_H
@@ -0,0 +1,350 @@
+#include "flythrough_path.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+
+namespace {
+
+// Distance from (px, py) to the segment a-b
+double segmentDistance(double px, double py, double ax, double ay, double bx,
+                       double by) {
+  const double dx = bx - ax;
+  const double dy = by - ay;
+  const double lengthSq = dx * dx + dy * dy;
+  double t = 0.0;
+  if (lengthSq > 0.0)
+    t = std::min(1.0, std::max(0.0, ((px - ax) * dx + (py - ay) * dy) /
+                                        lengthSq));
+  return std::hypot(px - (ax + t * dx), py - (ay + t * dy));
+}
+
+struct HeapEntry {
+  double cost;
+  size_t index;
+  unsigned version; // Stale once the vertex's cost has been recomputed
+
+  bool operator>(const HeapEntry &other) const { return cost > other.cost; }
+};
+
+// Box radius of smoothPath(), in samples of the uniformly resampled path.
+// Four keeps the three boxes close to a Gaussian at 4.5 samples per sigma.
+const size_t kSmoothRadius = 4;
+
+// Most samples smoothPath() resamples to; a sigma too small for that is
+// left alone, as it would barely move the path
+const double kMaxSmoothVertices = 4.0 * 1024 * 1024;
+
+// One box filter of the given radius over values, in place. padded and
+// prefix are scratch space of at least n + 2 * radius + 1 values each.
+void boxFilter(double *values, size_t n, size_t radius, double *padded,
+               double *prefix) {
+  // Offset by the first value to keep the prefix sums small
+  const double origin = values[0];
+  const double first = 0.0;
+  const double last = values[n - 1] - origin;
+
+  // Point reflection about each end point
+  for (size_t k = 0; k < radius; ++k)
+    padded[k] = 2.0 * first - (values[radius - k] - origin);
+  for (size_t i = 0; i < n; ++i)
+    padded[radius + i] = values[i] - origin;
+  for (size_t k = 1; k <= radius; ++k)
+    padded[radius + n - 1 + k] = 2.0 * last - (values[n - 1 - k] - origin);
+
+  const size_t paddedCount = n + 2 * radius;
+  prefix[0] = 0.0;
+  for (size_t i = 0; i < paddedCount; ++i)
+    prefix[i + 1] = prefix[i] + padded[i];
+
+  // Window sums from the prefix; no loop-carried dependency
+  const size_t width = 2 * radius + 1;
+  const double scale = 1.0 / width;
+  for (size_t i = 0; i < n; ++i)
+    values[i] = origin + (prefix[i + width] - prefix[i]) * scale;
+}
+
+} // namespace
+
+size_t simplifyPath(std::vector<double> &xs, std::vector<double> &ys,
+                    double tolerance) {
+  const size_t n = xs.size();
+  if (n < 3 || !(tolerance > 0.0))
+    return n;
+
+  // Doubly linked list over the surviving vertices. error[i] bounds how far
+  // the original vertices from i to next[i] lie from that segment.
+  std::vector<size_t> prev(n), next(n);
+  std::vector<double> error(n, 0.0);
+  std::vector<unsigned> version(n, 0);
+  std::vector<bool> removed(n, false);
+  for (size_t i = 0; i < n; ++i) {
+    prev[i] = i - 1; // Wraps for i == 0; never read for the end points
+    next[i] = i + 1;
+  }
+
+  // Bound on the deviation once vertex i is dropped: every original vertex
+  // lay within the larger of its two segments' bounds of them, and those
+  // segments lie within i's distance of the chord that replaces them
+  const auto cost = [&](size_t i) {
+    const size_t p = prev[i];
+    const size_t q = next[i];
+    const double d = segmentDistance(xs[i], ys[i], xs[p], ys[p], xs[q], ys[q]);
+    // NaN distances, from NaN coordinates, keep the vertex
+    if (std::isnan(d))
+      return std::numeric_limits<double>::infinity();
+    return std::max(error[p], error[i]) + d;
+  };
+
+  std::vector<HeapEntry> storage;
+  storage.reserve(n);
+  for (size_t i = 1; i + 1 < n; ++i)
+    storage.push_back({cost(i), i, 0});
+  std::priority_queue<HeapEntry, std::vector<HeapEntry>,
+                      std::greater<HeapEntry>>
+      heap(std::greater<HeapEntry>(), std::move(storage));
+
+  while (!heap.empty()) {
+    const HeapEntry top = heap.top();
+    if (top.cost > tolerance)
+      break;
+    heap.pop();
+    if (removed[top.index] || top.version != version[top.index])
+      continue;
+
+    const size_t i = top.index;
+    const size_t p = prev[i];
+    const size_t q = next[i];
+    removed[i] = true;
+    next[p] = q;
+    prev[q] = p;
+    error[p] = top.cost;
+
+    if (p > 0)
+      heap.push({cost(p), p, ++version[p]});
+    if (q + 1 < n)
+      heap.push({cost(q), q, ++version[q]});
+  }
+
+  size_t count = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (removed[i])
+      continue;
+    xs[count] = xs[i];
+    ys[count] = ys[i];
+    ++count;
+  }
+  xs.resize(count);
+  ys.resize(count);
+  return count;
+}
+
+void smoothPath(std::vector<double> &xs, std::vector<double> &ys,
+                double sigma, std::vector<double> &scratch) {
+  const size_t n = xs.size();
+  if (n < 2 || !(sigma > 0.0))
+    return;
+
+  double length = 0.0;
+  for (size_t i = 1; i < n; ++i)
+    length += std::hypot(xs[i] - xs[i - 1], ys[i] - ys[i - 1]);
+  if (!(length > 0.0))
+    return;
+
+  // Three boxes of 2r + 1 samples h apart have variance
+  // 3 * ((2r + 1)^2 - 1) / 12 * h^2 = r * (r + 1) * h^2 = sigma^2, so the
+  // spacing is chosen for the radius rather than the radius rounded
+  const size_t radius = kSmoothRadius;
+  const double spacing =
+      sigma / std::sqrt(static_cast<double>(radius * (radius + 1)));
+  const double steps = std::ceil(length / spacing);
+  if (!(steps <= kMaxSmoothVertices))
+    return;
+  // Reflection needs radius < count
+  const size_t segments = std::max(static_cast<size_t>(steps), radius);
+  const size_t count = segments + 1;
+  const double step = length / segments;
+
+  const size_t paddedCount = count + 2 * radius;
+  scratch.resize(2 * count + 2 * paddedCount + 1);
+  double *uniformXs = scratch.data();
+  double *uniformYs = uniformXs + count;
+  double *padded = uniformYs + count;
+  double *prefix = padded + paddedCount;
+
+  // Resample at uniform arc length, walking the segments once
+  size_t seg = 1;
+  double segStart = 0.0;
+  double segLength = std::hypot(xs[1] - xs[0], ys[1] - ys[0]);
+  for (size_t k = 0; k < count; ++k) {
+    const double s = k == segments ? length : k * step;
+    while (seg + 1 < n && segStart + segLength < s) {
+      segStart += segLength;
+      ++seg;
+      segLength = std::hypot(xs[seg] - xs[seg - 1], ys[seg] - ys[seg - 1]);
+    }
+    const double t =
+        segLength > 0.0
+            ? std::min(1.0, std::max(0.0, (s - segStart) / segLength))
+            : 1.0;
+    uniformXs[k] = xs[seg - 1] + t * (xs[seg] - xs[seg - 1]);
+    uniformYs[k] = ys[seg - 1] + t * (ys[seg] - ys[seg - 1]);
+  }
+  uniformXs[count - 1] = xs[n - 1];
+  uniformYs[count - 1] = ys[n - 1];
+
+  for (int pass = 0; pass < 3; ++pass) {
+    boxFilter(uniformXs, count, radius, padded, prefix);
+    boxFilter(uniformYs, count, radius, padded, prefix);
+  }
+  xs.assign(uniformXs, uniformXs + count);
+  ys.assign(uniformYs, uniformYs + count);
+}
+
+void densifyPath(const std::vector<double> &xs, const std::vector<double> &ys,
+                 double interval, std::vector<double> &outXs,
+                 std::vector<double> &outYs) {
+  outXs.clear();
+  outYs.clear();
+  const size_t n = xs.size();
+  if (n == 0)
+    return;
+  if (n < 2 || !(interval > 0.0)) {
+    outXs = xs;
+    outYs = ys;
+    return;
+  }
+
+  // Size the output exactly so it is allocated once
+  auto stepsTo = [&](size_t i) {
+    const double dist = std::hypot(xs[i] - xs[i - 1], ys[i] - ys[i - 1]);
+    return std::max<size_t>(1, static_cast<size_t>(std::ceil(dist / interval)));
+  };
+  size_t total = 1;
+  for (size_t i = 1; i < n; ++i)
+    total += stepsTo(i);
+  outXs.reserve(total);
+  outYs.reserve(total);
+
+  outXs.push_back(xs[0]);
+  outYs.push_back(ys[0]);
+  for (size_t i = 1; i < n; ++i) {
+    const size_t steps = stepsTo(i);
+    const double dx = (xs[i] - xs[i - 1]) / steps;
+    const double dy = (ys[i] - ys[i - 1]) / steps;
+    for (size_t j = 1; j < steps; ++j) {
+      outXs.push_back(xs[i - 1] + dx * j);
+      outYs.push_back(ys[i - 1] + dy * j);
+    }
+    outXs.push_back(xs[i]);
+    outYs.push_back(ys[i]);
+  }
+}
+
+namespace {
+
+// Deepest a segment is bisected, whatever minSpacing says. Keeps a zero,
+// negative or NaN minSpacing from recursing until the midpoint stops moving.
+const int kMaxSplitDepth = 20;
+
+// Recursive bisection of one segment for densifyPathAdaptive()
+struct AdaptiveSplitter {
+  const HeightFunction &height;
+  const AdaptiveSampling &sampling;
+  std::vector<double> &outXs;
+  std::vector<double> &outYs;
+  double x0 = 0.0, y0 = 0.0, dx = 0.0, dy = 0.0, length = 0.0;
+  double turnStart = 0.0, turnEnd = 0.0; // Turn angles (radians) at the ends
+  double minSpan = 0.0; // Sub-segments shorter than this are not split
+  size_t samples = 0;
+
+  // Appends the vertices strictly inside (t0, t1), in order
+  void split(double t0, double h0, double t1, double h1) {
+    const double span = (t1 - t0) * length;
+    // NaN spans, from NaN coordinates, stop here too
+    if (!(span >= minSpan) || span <= 0.0)
+      return;
+
+    const double t = 0.5 * (t0 + t1);
+    const double x = x0 + dx * t;
+    const double y = y0 + dy * t;
+    const double h = height(x, y);
+    ++samples;
+
+    bool needed = span > sampling.maxSpacing;
+    // A centripetal curve through a corner of angle a cuts it by roughly
+    // span * a / 8 on the adjacent sub-segments
+    if (!needed && t0 == 0.0)
+      needed = span * turnStart > 8.0 * sampling.lateralTolerance;
+    if (!needed && t1 == 1.0)
+      needed = span * turnEnd > 8.0 * sampling.lateralTolerance;
+    if (!needed && !std::isnan(h) && !std::isnan(h0) && !std::isnan(h1))
+      needed = std::fabs(h - 0.5 * (h0 + h1)) > sampling.verticalTolerance;
+    if (!needed)
+      return;
+
+    split(t0, h0, t, h);
+    outXs.push_back(x);
+    outYs.push_back(y);
+    split(t, h, t1, h1);
+  }
+};
+
+// Turn angle at vertex i in radians (0 = straight on, pi = reversal)
+double turnAngle(const std::vector<double> &xs, const std::vector<double> &ys,
+                 size_t i) {
+  if (i == 0 || i + 1 >= xs.size())
+    return 0.0;
+  const double ax = xs[i] - xs[i - 1], ay = ys[i] - ys[i - 1];
+  const double bx = xs[i + 1] - xs[i], by = ys[i + 1] - ys[i];
+  return std::fabs(std::atan2(ax * by - ay * bx, ax * bx + ay * by));
+}
+
+} // namespace
+
+size_t densifyPathAdaptive(const std::vector<double> &xs,
+                           const std::vector<double> &ys,
+                           const HeightFunction &height,
+                           const AdaptiveSampling &sampling,
+                           std::vector<double> &outXs,
+                           std::vector<double> &outYs) {
+  outXs.clear();
+  outYs.clear();
+  const size_t n = xs.size();
+  if (n < 2 || !height) {
+    outXs = xs;
+    outYs = ys;
+    return 0;
+  }
+  outXs.reserve(n);
+  outYs.reserve(n);
+
+  // NaN and non-positive spacings fall back to the depth limit alone
+  const double minSpacing =
+      sampling.minSpacing > 0.0 ? sampling.minSpacing : 0.0;
+  AdaptiveSplitter splitter{height, sampling, outXs, outYs};
+  double hStart = height(xs[0], ys[0]);
+  splitter.samples = 1;
+  outXs.push_back(xs[0]);
+  outYs.push_back(ys[0]);
+  for (size_t i = 1; i < n; ++i) {
+    const double hEnd = height(xs[i], ys[i]);
+    ++splitter.samples;
+    splitter.x0 = xs[i - 1];
+    splitter.y0 = ys[i - 1];
+    splitter.dx = xs[i] - xs[i - 1];
+    splitter.dy = ys[i] - ys[i - 1];
+    splitter.length = std::hypot(splitter.dx, splitter.dy);
+    const double depthLimit = std::ldexp(splitter.length, -kMaxSplitDepth);
+    splitter.minSpan = 2.0 * std::max(minSpacing, depthLimit);
+    splitter.turnStart = turnAngle(xs, ys, i - 1);
+    splitter.turnEnd = turnAngle(xs, ys, i);
+    splitter.split(0.0, hStart, 1.0, hEnd);
+    outXs.push_back(xs[i]);
+    outYs.push_back(ys[i]);
+    hStart = hEnd;
+  }
+  return splitter.samples;
+}
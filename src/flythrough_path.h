@@ -0,0 +1,77 @@
+#ifndef FLYTHROUGH_PATH_H
+#define FLYTHROUGH_PATH_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// Path operations on contiguous coordinate arrays.
+//
+// Like DemGrid, these are free of Qt/QGIS types: the caller converts the
+// path to x/y arrays in a projected CRS once and every stage works on them
+// in place.
+
+// Simplification by vertex elimination, as in Visvalingam-Whyatt but with
+// a distance criterion. Each segment carries a bound on how far the original
+// vertices it replaces lie from it; the vertex whose removal gives the
+// smallest bound is dropped, via a heap, until the next would exceed
+// tolerance (map units). The simplified path therefore never strays more
+// than tolerance from the original. The bound adds up along a run of
+// removals, so a little less is dropped than an exact Douglas-Peucker
+// would, in exchange for O(n log n) at worst. End points are always kept.
+// Compacts xs/ys in place and returns the new vertex count.
+size_t simplifyPath(std::vector<double> &xs, std::vector<double> &ys,
+                    double tolerance);
+
+// Gaussian smoothing of the path, approximated by three box filters built
+// from running sums, so the cost is a few linear passes whatever sigma is.
+// sigma is in map units along the path. The path is first resampled at a
+// uniform arc-length spacing of about sigma / 4.5 and filtered in that
+// index space, so sigma holds however unevenly the input vertices are
+// spaced; xs/ys come back with the resampled vertex count. The path is
+// extended past each end by point reflection, which keeps the end points
+// fixed and straight ends straight. A sigma that would need more than 4M
+// samples leaves the path unchanged. scratch is resized as needed and can
+// be reused across calls to avoid allocating.
+void smoothPath(std::vector<double> &xs, std::vector<double> &ys,
+                double sigma, std::vector<double> &scratch);
+
+// Inserts evenly spaced vertices so no segment is longer than interval (map
+// units). Existing vertices are kept. Writes the result to outXs/outYs,
+// which must not alias the inputs.
+void densifyPath(const std::vector<double> &xs, const std::vector<double> &ys,
+                 double interval, std::vector<double> &outXs,
+                 std::vector<double> &outYs);
+
+// Error budget for densifyPathAdaptive(). Lengths are in map units, the
+// vertical tolerance in the units of the height function.
+struct AdaptiveSampling {
+  double verticalTolerance = 2.0; // Terrain vs. straight line between samples
+  double lateralTolerance = 2.0;  // Camera curve vs. path at turns
+  double minSpacing = 1.0;        // Segments this short are never split
+  double maxSpacing = 200.0;      // Segments this long are always split
+};
+
+// Height at a point of the path; NaN where unknown
+using HeightFunction = std::function<double(double x, double y)>;
+
+// Inserts vertices where the path needs them rather than at a fixed step.
+// Each segment is bisected while its terrain midpoint lies more than
+// verticalTolerance off the straight line between its end heights, or while
+// a sub-segment next to a turn is long enough for the camera curve to cut
+// the corner by more than lateralTolerance. maxSpacing and minSpacing bound
+// the result either way, and existing vertices are kept; a minSpacing that
+// is not positive leaves only a limit of 2^20 pieces per input segment.
+// Flat straight runs stay sparse; ridges, gullies and sharp turns get
+// dense. Every input vertex and every midpoint tested is sampled once,
+// whether the midpoint is kept or not, so the cost is up to about two
+// height samples per inserted vertex plus two per input segment. Returns
+// the number of height samples taken.
+size_t densifyPathAdaptive(const std::vector<double> &xs,
+                           const std::vector<double> &ys,
+                           const HeightFunction &height,
+                           const AdaptiveSampling &sampling,
+                           std::vector<double> &outXs,
+                           std::vector<double> &outYs);
+
+#endif // FLYTHROUGH_PATH_H
@@ -0,0 +1,133 @@
+#include "flythrough_playback.h"
+#include "flythrough_core.h"
+#include <QCheckBox>
+#include <QComboBox>
+#include <QDoubleSpinBox>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QPushButton>
+#include <QSignalBlocker>
+#include <QSlider>
+#include <cmath>
+
+// The slider moves in milliseconds of flight
+static const double kSliderSteps = 1000.0;
+
+static QString formatTime(double seconds) {
+  const int total = static_cast<int>(std::floor(qMax(0.0, seconds)));
+  return QString("%1:%2")
+      .arg(total / 60, 2, 10, QChar('0'))
+      .arg(total % 60, 2, 10, QChar('0'));
+}
+
+PlaybackControls::PlaybackControls(FlyThroughCore *core, QWidget *parent)
+    : QWidget(parent), mCore(core) {
+  QHBoxLayout *layout = new QHBoxLayout(this);
+
+  mPlayBtn = new QPushButton("Pause", this);
+  connect(mPlayBtn, &QPushButton::clicked, this,
+          &PlaybackControls::onPlayClicked);
+  layout->addWidget(mPlayBtn);
+
+  mReverseCheck = new QCheckBox("Reverse", this);
+  connect(mReverseCheck, &QCheckBox::toggled, this, [this](bool checked) {
+    if (mCore)
+      mCore->setPlaybackReversed(checked);
+  });
+  layout->addWidget(mReverseCheck);
+
+  mRateCombo = new QComboBox(this);
+  for (double rate : {0.25, 0.5, 1.0, 2.0, 4.0, 8.0})
+    mRateCombo->addItem(QString("%1x").arg(rate), rate);
+  mRateCombo->setCurrentIndex(2);
+  connect(mRateCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
+          this, [this](int index) {
+            if (mCore)
+              mCore->setPlaybackRate(mRateCombo->itemData(index).toDouble());
+          });
+  layout->addWidget(mRateCombo);
+
+  mPositionSlider = new QSlider(Qt::Horizontal, this);
+  connect(mPositionSlider, &QSlider::sliderMoved, this,
+          &PlaybackControls::onSliderMoved);
+  layout->addWidget(mPositionSlider, 1);
+
+  mTimeLabel = new QLabel(this);
+  layout->addWidget(mTimeLabel);
+
+  mDistanceSpin = new QDoubleSpinBox(this);
+  mDistanceSpin->setDecimals(2);
+  mDistanceSpin->setSuffix(" km");
+  mDistanceSpin->setKeyboardTracking(false);
+  mDistanceSpin->setToolTip("Jump to this distance along the path");
+  connect(mDistanceSpin, &QDoubleSpinBox::editingFinished, this,
+          &PlaybackControls::onDistanceEntered);
+  layout->addWidget(mDistanceSpin);
+
+  if (mCore) {
+    connect(mCore, &FlyThroughCore::playbackPositionChanged, this,
+            &PlaybackControls::updatePosition);
+    connect(mCore, &FlyThroughCore::playbackStateChanged, this,
+            &PlaybackControls::updateState);
+  }
+  updateState();
+}
+
+void PlaybackControls::onPlayClicked() {
+  if (!mCore)
+    return;
+  if (mCore->isPlaybackPaused())
+    mCore->resumePlayback();
+  else
+    mCore->pausePlayback();
+}
+
+void PlaybackControls::onSliderMoved(int value) {
+  if (mCore)
+    mCore->seekPlayback(value / kSliderSteps);
+}
+
+void PlaybackControls::onDistanceEntered() {
+  if (mCore)
+    mCore->seekPlaybackDistance(mDistanceSpin->value() * 1000.0);
+}
+
+void PlaybackControls::updatePosition(double time) {
+  if (!mCore)
+    return;
+  // Leave the slider to the user while it is dragged
+  if (!mPositionSlider->isSliderDown()) {
+    const QSignalBlocker blocker(mPositionSlider);
+    mPositionSlider->setValue(qRound(time * kSliderSteps));
+  }
+  mTimeLabel->setText(QString("%1 / %2  %3 of %4 km")
+                          .arg(formatTime(time))
+                          .arg(formatTime(mCore->playbackDuration()))
+                          .arg(mCore->playbackDistance() / 1000.0, 0, 'f', 2)
+                          .arg(mCore->playbackLength() / 1000.0, 0, 'f', 2));
+}
+
+void PlaybackControls::updateState() {
+  setEnabled(mCore != nullptr);
+  if (!mCore)
+    return;
+
+  mPlayBtn->setText(mCore->isPlaybackPaused() ? "Play" : "Pause");
+  {
+    const QSignalBlocker reverseBlocker(mReverseCheck);
+    mReverseCheck->setChecked(mCore->isPlaybackReversed());
+  }
+  {
+    const QSignalBlocker rateBlocker(mRateCombo);
+    const int index = mRateCombo->findData(mCore->playbackRate());
+    if (index >= 0)
+      mRateCombo->setCurrentIndex(index);
+  }
+  mPositionSlider->setRange(
+      0, qRound(mCore->playbackDuration() * kSliderSteps));
+  {
+    const QSignalBlocker distanceBlocker(mDistanceSpin);
+    mDistanceSpin->setRange(0.0, mCore->playbackLength() / 1000.0);
+  }
+  updatePosition(mCore->playbackTime());
+}
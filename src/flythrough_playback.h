@@ -0,0 +1,42 @@
+#ifndef FLYTHROUGH_PLAYBACK_H
+#define FLYTHROUGH_PLAYBACK_H
+
+#include <QPointer>
+#include <QWidget>
+
+class FlyThroughCore;
+class QCheckBox;
+class QComboBox;
+class QDoubleSpinBox;
+class QLabel;
+class QPushButton;
+class QSlider;
+
+// Transport controls for the flight being played: play / pause, reverse,
+// rate, a position slider to scrub through the flight and a distance box
+// to jump to a point along the path. Everything goes through the core's
+// playback API; the widget only mirrors its state.
+class PlaybackControls : public QWidget {
+  Q_OBJECT
+
+public:
+  explicit PlaybackControls(FlyThroughCore *core, QWidget *parent = nullptr);
+
+private slots:
+  void onPlayClicked();
+  void onSliderMoved(int value);
+  void onDistanceEntered();
+  void updatePosition(double time);
+  void updateState();
+
+private:
+  QPointer<FlyThroughCore> mCore;
+  QPushButton *mPlayBtn = nullptr;
+  QCheckBox *mReverseCheck = nullptr;
+  QComboBox *mRateCombo = nullptr;
+  QSlider *mPositionSlider = nullptr;
+  QLabel *mTimeLabel = nullptr;
+  QDoubleSpinBox *mDistanceSpin = nullptr;
+};
+
+#endif // FLYTHROUGH_PLAYBACK_H
@@ -1,4 +1,5 @@
 #include "flythrough_plugin.h"
+#include "flythrough_core.h"
 #include "flythrough_dialog.h"
 #include <QMenu>
 
@@ -19,10 +20,14 @@ void FlyThroughPlugin::unload() {
   mIface->removeToolBarIcon(mAction);
   delete mAction;
   mAction = nullptr;
+  delete mCore;
+  mCore = nullptr;
 }
 
 void FlyThroughPlugin::run() {
-  FlyThroughDialog dlg(mIface);
+  if (!mCore)
+    mCore = new FlyThroughCore(mIface, this);
+  FlyThroughDialog dlg(mIface, mCore);
   dlg.exec();
 }
 
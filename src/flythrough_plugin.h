@@ -6,6 +6,7 @@
 #include <QAction>
 #include <QApplication>
 
+class FlyThroughCore;
 class QgisInterface;
 
 class FlyThroughPlugin : public QObject, public QgisPlugin {
@@ -22,6 +23,9 @@ public slots:
 private:
   QgisInterface *mIface = nullptr;
   QAction *mAction = nullptr;
+  // One core for the session: it keeps the stages of the last run, the 3D
+  // view and the playback controls between runs
+  FlyThroughCore *mCore = nullptr;
 };
 
 // Static metadata strings (matching QGIS plugin pattern)
@@ -0,0 +1,190 @@
+#include "flythrough_prefetch.h"
+#include <QDebug>
+#include <QSet>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
+#include <qgscsexception.h>
+#include <qgsmaprendererparalleljob.h>
+#include <qgsproject.h>
+#include <qgsrasterblock.h>
+#include <qgsrasterdataprovider.h>
+#include <qgsrasterinterface.h>
+
+TerrainPrefetcher::TerrainPrefetcher(QObject *parent) : QObject(parent) {
+  connect(&mTimer, &QTimer::timeout, this, &TerrainPrefetcher::onTick);
+}
+
+TerrainPrefetcher::~TerrainPrefetcher() { stop(); }
+
+void TerrainPrefetcher::start(const std::vector<Keyframe> &keyframes,
+                              const Settings &settings,
+                              QgsRasterDataProvider *demProvider,
+                              const QgsCoordinateTransform &viewToDem,
+                              const QList<QgsMapLayer *> &layers,
+                              const QgsCoordinateReferenceSystem &viewCrs) {
+  stop();
+  mSettings = settings;
+  mBlocksRead = 0;
+  mTilesRendered = 0;
+  planTiles(keyframes);
+  if (mTiles.empty())
+    return;
+
+  // The clone is only ever used by one read at a time
+  mDemProvider.reset(demProvider ? demProvider->clone() : nullptr);
+  mViewToDem = viewToDem;
+  mNextBlock = mDemProvider ? 0 : mTiles.size();
+
+  mMapSettings.setLayers(layers);
+  mMapSettings.setDestinationCrs(viewCrs);
+  mMapSettings.setTransformContext(QgsProject::instance()->transformContext());
+  mMapSettings.setOutputSize(
+      QSize(mSettings.imagePixels, mSettings.imagePixels));
+  mNextRender = layers.isEmpty() ? mTiles.size() : 0;
+
+  qDebug() << "[FTP] Prefetching" << mTiles.size() << "tiles,"
+           << mSettings.horizonSeconds << "s ahead of the camera";
+  mTimer.start(qMax(1, mSettings.intervalMs));
+  onTick();
+}
+
+void TerrainPrefetcher::stop() {
+  mTimer.stop();
+
+  if (mRenderJob) {
+    // The job deletes itself once the cancellation has gone through
+    disconnect(mRenderJob, nullptr, this, nullptr);
+    mRenderJob->cancelWithoutBlocking();
+    mRenderJob = nullptr;
+  }
+  if (mBlockFeedback)
+    mBlockFeedback->cancel();
+  mBlockRead.waitForFinished();
+  mBlockFeedback.reset();
+  mDemProvider.reset();
+
+  if (!mTiles.empty()) {
+    qDebug() << "[FTP] Prefetch stopped:" << mBlocksRead << "DEM blocks,"
+             << mTilesRendered << "tiles rendered of" << mTiles.size();
+    mTiles.clear();
+  }
+}
+
+void TerrainPrefetcher::planTiles(const std::vector<Keyframe> &keyframes) {
+  mTiles.clear();
+  const double size = mSettings.tileSize;
+  if (keyframes.empty() || !(size > 0.0))
+    return;
+
+  // Tiles in the order the camera first comes within margin of them.
+  // Keyframes closer together than a quarter tile add nothing new.
+  QSet<quint64> planned;
+  const double skip = 0.25 * size;
+  double lastX = 0.0, lastY = 0.0;
+  for (size_t k = 0; k < keyframes.size(); ++k) {
+    const Keyframe &kf = keyframes[k];
+    if (k > 0 && k + 1 < keyframes.size() &&
+        std::hypot(kf.x - lastX, kf.y - lastY) < skip)
+      continue;
+    lastX = kf.x;
+    lastY = kf.y;
+
+    const qint64 col0 = static_cast<qint64>(
+        std::floor((kf.x - mSettings.margin) / size));
+    const qint64 col1 = static_cast<qint64>(
+        std::floor((kf.x + mSettings.margin) / size));
+    const qint64 row0 = static_cast<qint64>(
+        std::floor((kf.y - mSettings.margin) / size));
+    const qint64 row1 = static_cast<qint64>(
+        std::floor((kf.y + mSettings.margin) / size));
+    for (qint64 row = row0; row <= row1; ++row) {
+      for (qint64 col = col0; col <= col1; ++col) {
+        const quint64 key = (static_cast<quint64>(static_cast<quint32>(col))
+                             << 32) |
+                            static_cast<quint32>(row);
+        if (planned.contains(key))
+          continue;
+        planned.insert(key);
+        Tile tile;
+        tile.extent = QgsRectangle(col * size, row * size, (col + 1) * size,
+                                   (row + 1) * size);
+        tile.time = kf.time;
+        mTiles.push_back(tile);
+      }
+    }
+  }
+}
+
+bool TerrainPrefetcher::advanceToDue(size_t &cursor) const {
+  // A tile the camera has reached is already being loaded by the scene
+  while (cursor < mTiles.size() && mTiles[cursor].time < mPlaybackTime)
+    ++cursor;
+  return cursor < mTiles.size() &&
+         mTiles[cursor].time <= mPlaybackTime + mSettings.horizonSeconds;
+}
+
+void TerrainPrefetcher::onTick() {
+  if (!mBlockRead.isRunning() && advanceToDue(mNextBlock))
+    startBlockRead(mTiles[mNextBlock++]);
+  if (!mRenderJob && advanceToDue(mNextRender))
+    startRender(mTiles[mNextRender++]);
+
+  // Everything requested: nothing left to tick for
+  if (mNextBlock >= mTiles.size() && mNextRender >= mTiles.size())
+    mTimer.stop();
+}
+
+void TerrainPrefetcher::startBlockRead(const Tile &tile) {
+  QgsRectangle extent = tile.extent;
+  if (mViewToDem.isValid()) {
+    try {
+      extent = mViewToDem.transformBoundingBox(extent);
+    } catch (const QgsCsException &) {
+      return;
+    }
+  }
+
+  const QgsRectangle demExtent = mDemProvider->extent();
+  extent = extent.intersect(demExtent);
+  if (extent.isEmpty() || mDemProvider->xSize() <= 0 ||
+      mDemProvider->ySize() <= 0)
+    return;
+
+  // Native resolution up to the block size; coarser reads are served from
+  // overviews, like the terrain generator's own
+  const double cellX = demExtent.width() / mDemProvider->xSize();
+  const double cellY = demExtent.height() / mDemProvider->ySize();
+  const int width = std::max(
+      1, std::min(mSettings.maxBlockPixels,
+                  static_cast<int>(std::ceil(extent.width() / cellX))));
+  const int height = std::max(
+      1, std::min(mSettings.maxBlockPixels,
+                  static_cast<int>(std::ceil(extent.height() / cellY))));
+
+  mBlockFeedback.reset(new QgsRasterBlockFeedback());
+  QgsRasterDataProvider *provider = mDemProvider.get();
+  QgsRasterBlockFeedback *feedback = mBlockFeedback.get();
+  mBlockRead = QtConcurrent::run([this, provider, feedback, extent, width,
+                                  height]() {
+    std::unique_ptr<QgsRasterBlock> block(
+        provider->block(1, extent, width, height, feedback));
+    if (block && block->isValid() && !feedback->isCanceled())
+      ++mBlocksRead;
+  });
+}
+
+void TerrainPrefetcher::startRender(const Tile &tile) {
+  mMapSettings.setExtent(tile.extent);
+  mRenderJob = new QgsMapRendererParallelJob(mMapSettings);
+  connect(mRenderJob, &QgsMapRendererJob::finished, this,
+          &TerrainPrefetcher::onRenderFinished);
+  connect(mRenderJob, &QgsMapRendererJob::finished, mRenderJob,
+          &QObject::deleteLater);
+  mRenderJob->start();
+}
+
+void TerrainPrefetcher::onRenderFinished() {
+  mRenderJob = nullptr;
+  ++mTilesRendered;
+}
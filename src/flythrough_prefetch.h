@@ -0,0 +1,105 @@
+#ifndef FLYTHROUGH_PREFETCH_H
+#define FLYTHROUGH_PREFETCH_H
+
+#include "flythrough_keyframe.h"
+#include <QFuture>
+#include <QList>
+#include <QObject>
+#include <QTimer>
+#include <atomic>
+#include <memory>
+#include <qgscoordinatereferencesystem.h>
+#include <qgscoordinatetransform.h>
+#include <qgsmapsettings.h>
+#include <qgsrectangle.h>
+#include <vector>
+
+class QgsMapLayer;
+class QgsMapRendererParallelJob;
+class QgsRasterBlockFeedback;
+class QgsRasterDataProvider;
+
+// Warms the data sources ahead of the camera during playback.
+//
+// The 3D scene only asks for terrain and texture tiles once they come into
+// view, so the area ahead starts loading when the camera gets there. The
+// keyframes say where the camera will be, so the prefetcher reads ahead:
+// the ground along the path is cut into square tiles, ordered by when the
+// camera first comes near them, and for the tiles of the next few seconds
+// of flight it
+//  - reads the DEM block under the tile through its own provider clone on a
+//    worker thread, which fills the GDAL and OS caches the terrain
+//    generator reads from, and
+//  - renders the scene's layers over the tile off screen, which fills the
+//    provider and network caches the terrain textures are drawn from.
+// At most one DEM read and one render are in flight and a new one starts
+// at most once per tick, so prefetching never competes hard with the
+// frames. stop() cancels both.
+class TerrainPrefetcher : public QObject {
+  Q_OBJECT
+
+public:
+  struct Settings {
+    double horizonSeconds = 8.0; // How far ahead of the playback time
+    double tileSize = 1000.0;    // Tile edge, view-CRS units
+    double margin = 1000.0;      // Ground around the camera, view-CRS units
+    int intervalMs = 100;        // Tick: at most one new request of a kind
+    int maxBlockPixels = 512;    // DEM block edge per read, at most
+    int imagePixels = 512;       // Edge of the off-screen render per tile
+  };
+
+  explicit TerrainPrefetcher(QObject *parent = nullptr);
+  ~TerrainPrefetcher() override;
+
+  // Plans the tiles along keyframes (view CRS) and starts ticking.
+  // demProvider is cloned here; layers are rendered in viewCrs. A null
+  // provider or no layers skips that kind of prefetch. Prefetching starts
+  // from the last setPlaybackTime().
+  void start(const std::vector<Keyframe> &keyframes, const Settings &settings,
+             QgsRasterDataProvider *demProvider,
+             const QgsCoordinateTransform &viewToDem,
+             const QList<QgsMapLayer *> &layers,
+             const QgsCoordinateReferenceSystem &viewCrs);
+  // Called every frame; tiles the camera has passed are skipped
+  void setPlaybackTime(double seconds) { mPlaybackTime = seconds; }
+  // Cancels whatever is in flight; waits for a DEM read to give up
+  void stop();
+
+  bool isActive() const { return mTimer.isActive(); }
+
+private slots:
+  void onTick();
+  void onRenderFinished();
+
+private:
+  struct Tile {
+    QgsRectangle extent; // View CRS
+    double time = 0.0;   // When the camera first comes near it
+  };
+
+  Settings mSettings;
+  std::vector<Tile> mTiles;
+  size_t mNextBlock = 0;  // Next tile for a DEM read
+  size_t mNextRender = 0; // Next tile for a render
+  double mPlaybackTime = 0.0;
+  QTimer mTimer;
+
+  std::unique_ptr<QgsRasterDataProvider> mDemProvider;
+  QgsCoordinateTransform mViewToDem;
+  QFuture<void> mBlockRead;
+  std::unique_ptr<QgsRasterBlockFeedback> mBlockFeedback;
+  std::atomic<int> mBlocksRead{0};
+
+  QgsMapSettings mMapSettings;
+  QgsMapRendererParallelJob *mRenderJob = nullptr;
+  int mTilesRendered = 0;
+
+  void planTiles(const std::vector<Keyframe> &keyframes);
+  // Moves cursor past tiles the camera has already reached; true if the
+  // tile it then points at is within the horizon
+  bool advanceToDue(size_t &cursor) const;
+  void startBlockRead(const Tile &tile);
+  void startRender(const Tile &tile);
+};
+
+#endif // FLYTHROUGH_PREFETCH_H
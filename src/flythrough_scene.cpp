@@ -0,0 +1,111 @@
+#include "flythrough_scene.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QMetaMethod>
+
+QObject *invokeObjectGetter(QObject *object, const char *signature) {
+  if (!object)
+    return nullptr;
+
+  const QMetaObject *meta = object->metaObject();
+  const int index = meta->indexOfMethod(signature);
+  if (index < 0)
+    return nullptr;
+
+  QMetaMethod method = meta->method(index);
+  QObject *result = nullptr;
+  if (!method.invoke(object, Qt::DirectConnection,
+                     QGenericReturnArgument(method.typeName(), &result)))
+    return nullptr;
+  return result;
+}
+
+SceneReadiness::SceneReadiness(QWidget *canvas, QObject *parent)
+    : QObject(parent) {
+  mSettleTimer.setSingleShot(true);
+  mTimeoutTimer.setSingleShot(true);
+  connect(&mSettleTimer, &QTimer::timeout, this, &SceneReadiness::onSettled);
+  connect(&mTimeoutTimer, &QTimer::timeout, this, &SceneReadiness::onTimeout);
+
+  mScene = findScene(canvas);
+  if (!mScene) {
+    qDebug() << "[FTP] 3D scene not reachable, readiness uses settle time only";
+    return;
+  }
+
+  // Connect by name: any of these firing means tiles are still coming in
+  const QMetaObject *meta = mScene->metaObject();
+  for (const char *signal :
+       {"totalPendingJobsCountChanged()", "terrainPendingJobsCountChanged()",
+        "sceneStateChanged()"}) {
+    const int index = meta->indexOfSignal(signal);
+    if (index >= 0) {
+      connect(mScene, meta->method(index), this,
+              metaObject()->method(
+                  metaObject()->indexOfSlot("onSceneActivity()")));
+    }
+  }
+
+  mCanQueryPending = meta->indexOfMethod("totalPendingJobsCount()") >= 0;
+}
+
+QObject *SceneReadiness::findScene(QWidget *canvas) {
+  if (!canvas)
+    return nullptr;
+
+  if (QObject *scene = invokeObjectGetter(canvas, "scene()"))
+    return scene;
+
+  for (QObject *child : canvas->findChildren<QObject *>()) {
+    if (QString(child->metaObject()->className()) == "Qgs3DMapScene")
+      return child;
+  }
+  return nullptr;
+}
+
+int SceneReadiness::pendingJobs() const {
+  if (!mScene || !mCanQueryPending)
+    return -1;
+  int pending = -1;
+  if (!QMetaObject::invokeMethod(mScene, "totalPendingJobsCount",
+                                 Qt::DirectConnection,
+                                 Q_RETURN_ARG(int, pending)))
+    return -1;
+  return pending;
+}
+
+bool SceneReadiness::waitUntilReady(int timeoutMs, int settleMs) {
+  QElapsedTimer elapsed;
+  elapsed.start();
+
+  mTimedOut = false;
+  mSettleTimer.setInterval(settleMs);
+  mSettleTimer.start();
+  mTimeoutTimer.start(timeoutMs);
+  mLoop.exec();
+  mSettleTimer.stop();
+  mTimeoutTimer.stop();
+
+  qDebug() << "[FTP] Scene" << (mTimedOut ? "timed out" : "ready") << "after"
+           << elapsed.elapsed() << "ms";
+  return !mTimedOut;
+}
+
+void SceneReadiness::onSceneActivity() {
+  // Restart the quiet period on every change
+  if (mLoop.isRunning())
+    mSettleTimer.start();
+}
+
+void SceneReadiness::onSettled() {
+  // Quiet for a full settle period. If the scene can tell us it still has
+  // jobs queued, keep waiting for the next change signal instead.
+  if (pendingJobs() > 0)
+    return;
+  mLoop.quit();
+}
+
+void SceneReadiness::onTimeout() {
+  mTimedOut = true;
+  mLoop.quit();
+}
@@ -0,0 +1,51 @@
+#ifndef FLYTHROUGH_SCENE_H
+#define FLYTHROUGH_SCENE_H
+
+#include <QEventLoop>
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+#include <QWidget>
+
+// Calls a no-argument getter returning some QObject subclass pointer (e.g.
+// "scene()" returning Qgs3DMapScene*) through the meta-object system. The
+// call is made with the method's declared return type name so the type check
+// in QMetaMethod::invoke passes. Returns nullptr if the method is missing.
+QObject *invokeObjectGetter(QObject *object, const char *signature);
+
+// Waits for the 3D scene behind a Qgs3DMapCanvas to finish loading.
+//
+// The scene is reached through the meta-object system only (no
+// qgs3dmapscene.h, same reason as the canvas itself). Its pending-job and
+// state-change signals drive a local event loop: the wait ends once the
+// scene has been quiet for a short settle period (and reports zero pending
+// jobs, when that count is queryable), or when the timeout expires.
+class SceneReadiness : public QObject {
+  Q_OBJECT
+
+public:
+  explicit SceneReadiness(QWidget *canvas, QObject *parent = nullptr);
+
+  bool hasScene() const { return !mScene.isNull(); }
+
+  // Returns true if the scene settled, false on timeout
+  bool waitUntilReady(int timeoutMs, int settleMs = 250);
+
+private slots:
+  void onSceneActivity();
+  void onSettled();
+  void onTimeout();
+
+private:
+  QPointer<QObject> mScene;
+  bool mCanQueryPending = false;
+  bool mTimedOut = false;
+  QEventLoop mLoop;
+  QTimer mSettleTimer;
+  QTimer mTimeoutTimer;
+
+  int pendingJobs() const; // -1 if the scene doesn't expose the count
+  static QObject *findScene(QWidget *canvas);
+};
+
+#endif // FLYTHROUGH_SCENE_H
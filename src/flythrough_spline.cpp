@@ -0,0 +1,304 @@
+#include "flythrough_spline.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+// Knot spacing below this (sqrt of map units) is treated as a repeated point
+const double kMinKnot = 1e-6;
+
+// Arc-length samples in even the shortest segment, whose speed changes
+// fastest next to long neighbours
+const int kMinSegmentSamples = 4;
+
+// Curve speed (map units per unit of segment parameter) below which the
+// arc-length table falls back to the chord
+const double kMinSpeed = 1e-9;
+
+// Hermite form of the centripetal Catmull-Rom segment p1 -> p2, with knot
+// intervals t01, t12, t23 (square roots of the chord lengths)
+void catmullRom(double p0, double p1, double p2, double p3, double t01,
+                double t12, double t23, double &a, double &b, double &c,
+                double &d) {
+  double m1 = (p1 - p0) / t01 - (p2 - p0) / (t01 + t12) + (p2 - p1) / t12;
+  double m2 = (p2 - p1) / t12 - (p3 - p1) / (t12 + t23) + (p3 - p2) / t23;
+  m1 *= t12;
+  m2 *= t12;
+
+  a = 2.0 * p1 - 2.0 * p2 + m1 + m2;
+  b = -3.0 * p1 + 3.0 * p2 - 2.0 * m1 - m2;
+  c = m1;
+  d = p1;
+}
+
+double headingDegrees(double dx, double dy) {
+  const double heading = std::atan2(dx, dy) * 180.0 / kPi;
+  return std::fmod(heading + 360.0, 360.0);
+}
+
+} // namespace
+
+void CameraSpline::clear() {
+  mSegments.clear();
+  mSampleDistance.clear();
+  mSampleParam.clear();
+  mSampleSlopeStart.clear();
+  mSampleSlopeEnd.clear();
+  mBucketStart.clear();
+  mStep = 0.0;
+  mLength = 0.0;
+  mStartTime = 0.0;
+  mDuration = 0.0;
+}
+
+void CameraSpline::build(const std::vector<Keyframe> &keyframes,
+                         int samplesPerSegment) {
+  clear();
+
+  // Repeated positions would give zero-length knot intervals
+  std::vector<const Keyframe *> points;
+  points.reserve(keyframes.size());
+  for (const Keyframe &kf : keyframes) {
+    if (!points.empty() && std::hypot(kf.x - points.back()->x,
+                                      kf.y - points.back()->y) < 1e-9)
+      continue;
+    points.push_back(&kf);
+  }
+  if (points.size() < 2)
+    return;
+
+  const size_t segmentCount = points.size() - 1;
+  mSegments.resize(segmentCount);
+
+  for (size_t i = 0; i < segmentCount; ++i) {
+    const Keyframe &k1 = *points[i];
+    const Keyframe &k2 = *points[i + 1];
+
+    // Phantom end points mirror the neighbouring vertex
+    Keyframe k0 = k1;
+    Keyframe k3 = k2;
+    if (i > 0) {
+      k0 = *points[i - 1];
+    } else {
+      k0.x = 2.0 * k1.x - k2.x;
+      k0.y = 2.0 * k1.y - k2.y;
+      k0.z = 2.0 * k1.z - k2.z;
+      k0.ground_z = 2.0 * k1.ground_z - k2.ground_z;
+    }
+    if (i + 2 < points.size()) {
+      k3 = *points[i + 2];
+    } else {
+      k3.x = 2.0 * k2.x - k1.x;
+      k3.y = 2.0 * k2.y - k1.y;
+      k3.z = 2.0 * k2.z - k1.z;
+      k3.ground_z = 2.0 * k2.ground_z - k1.ground_z;
+    }
+
+    const double t12 = std::sqrt(std::hypot(k2.x - k1.x, k2.y - k1.y));
+    double t01 = std::sqrt(std::hypot(k1.x - k0.x, k1.y - k0.y));
+    double t23 = std::sqrt(std::hypot(k3.x - k2.x, k3.y - k2.y));
+    if (t01 < kMinKnot)
+      t01 = t12;
+    if (t23 < kMinKnot)
+      t23 = t12;
+
+    Segment &seg = mSegments[i];
+    catmullRom(k0.x, k1.x, k2.x, k3.x, t01, t12, t23, seg.x.a, seg.x.b,
+               seg.x.c, seg.x.d);
+    catmullRom(k0.y, k1.y, k2.y, k3.y, t01, t12, t23, seg.y.a, seg.y.b,
+               seg.y.c, seg.y.d);
+    catmullRom(k0.z, k1.z, k2.z, k3.z, t01, t12, t23, seg.z.a, seg.z.b,
+               seg.z.c, seg.z.d);
+    catmullRom(k0.ground_z, k1.ground_z, k2.ground_z, k3.ground_z, t01, t12,
+               t23, seg.groundZ.a, seg.groundZ.b, seg.groundZ.c,
+               seg.groundZ.d);
+    seg.pitch0 = k1.pitch;
+    seg.pitch1 = k2.pitch;
+    seg.roll0 = k1.roll;
+    seg.roll1 = k2.roll;
+  }
+
+  // Cumulative arc length, sampled about evenly in distance: each segment
+  // gets samples in proportion to its chord, so short and long segments
+  // share one resolution in the table below
+  double chordTotal = 0.0;
+  for (size_t i = 0; i < segmentCount; ++i)
+    chordTotal += std::hypot(points[i + 1]->x - points[i]->x,
+                             points[i + 1]->y - points[i]->y);
+  const double spacing =
+      chordTotal / (segmentCount * std::max(1, samplesPerSegment));
+
+  std::vector<double> &cumulative = mSampleDistance;
+  std::vector<double> &params = mSampleParam;
+  cumulative.assign(1, 0.0);
+  params.assign(1, 0.0);
+  cumulative.reserve(segmentCount * (std::max(1, samplesPerSegment) + 1));
+  params.reserve(cumulative.capacity());
+  mSampleSlopeStart.clear();
+  mSampleSlopeEnd.clear();
+  mSampleSlopeStart.reserve(cumulative.capacity());
+  mSampleSlopeEnd.reserve(cumulative.capacity());
+  for (size_t i = 0; i < segmentCount; ++i) {
+    const Segment &seg = mSegments[i];
+    const double chord = std::hypot(points[i + 1]->x - points[i]->x,
+                                    points[i + 1]->y - points[i]->y);
+    const int n = std::max(kMinSegmentSamples,
+                           static_cast<int>(std::ceil(chord / spacing)));
+    double px = seg.x.d;
+    double py = seg.y.d;
+    double speed = std::hypot(seg.x.c, seg.y.c);
+    for (int j = 1; j <= n; ++j) {
+      const double u = static_cast<double>(j) / n;
+      const double x = seg.x.at(u);
+      const double y = seg.y.at(u);
+      const double ds = std::hypot(x - px, y - py);
+      const double nextSpeed = std::hypot(seg.x.slope(u), seg.y.slope(u));
+      cumulative.push_back(cumulative.back() + ds);
+      params.push_back(i + u);
+      // du/ds at both ends of the interval; the chord's where the curve
+      // stalls (a cusp) or the interval has no length
+      const double chordSlope = ds > 0.0 ? (1.0 / n) / ds : 0.0;
+      mSampleSlopeStart.push_back(speed > kMinSpeed ? 1.0 / speed
+                                                    : chordSlope);
+      mSampleSlopeEnd.push_back(nextSpeed > kMinSpeed ? 1.0 / nextSpeed
+                                                      : chordSlope);
+      px = x;
+      py = y;
+      speed = nextSpeed;
+    }
+  }
+
+  mLength = cumulative.back();
+  if (!(mLength > 0.0)) {
+    clear();
+    return;
+  }
+
+  // Uniform distance buckets, each pointing at the sample interval its
+  // start falls in. Buckets are the average sample spacing wide, so most
+  // hold a sample or two, but a cluster of short segments (a GPS track
+  // standing still) can crowd thousands into one; a lookup binary-searches
+  // between its bucket's first interval and the next bucket's. The
+  // parameter is interpolated inside a single interval, never across a
+  // segment boundary where du/ds jumps.
+  const size_t sampleCount = cumulative.size() - 1;
+  mStep = mLength / sampleCount;
+  mBucketStart.resize(sampleCount + 1);
+  size_t p = 0;
+  for (size_t k = 0; k <= sampleCount; ++k) {
+    const double s = k * mStep;
+    while (p + 1 < sampleCount && cumulative[p + 1] < s)
+      ++p;
+    mBucketStart[k] = static_cast<unsigned>(p);
+  }
+
+  mStartTime = keyframes.front().time;
+  mDuration = keyframes.back().time - mStartTime;
+}
+
+double CameraSpline::distanceAt(double time) const {
+  if (!(mDuration > 0.0))
+    return 0.0;
+  const double f = (time - mStartTime) / mDuration;
+  return mLength * std::min(1.0, std::max(0.0, f));
+}
+
+double CameraSpline::timeAtDistance(double s) const {
+  if (!(mLength > 0.0))
+    return mStartTime;
+  const double f = s / mLength;
+  return mStartTime + mDuration * std::min(1.0, std::max(0.0, f));
+}
+
+double CameraSpline::paramAtDistance(double s) const {
+  s = std::min(std::max(s, 0.0), mLength);
+  const size_t last = mSampleDistance.size() - 1;
+  const size_t k = std::min(static_cast<size_t>(s / mStep), last);
+  // The interval holding s, between this bucket's first and the next's
+  const size_t lo = mBucketStart[k];
+  const size_t hi = mBucketStart[std::min(k + 1, last)];
+  const auto first = mSampleDistance.begin();
+  const size_t p =
+      std::lower_bound(first + lo + 1, first + hi + 1, s) - first - 1;
+
+  const double span = mSampleDistance[p + 1] - mSampleDistance[p];
+  const double u0 = mSampleParam[p];
+  const double u1 = mSampleParam[p + 1];
+  if (!(span > 0.0))
+    return u0;
+  const double t =
+      std::min(1.0, std::max(0.0, (s - mSampleDistance[p]) / span));
+
+  // Cubic Hermite in distance through both ends with the curve's du/ds
+  // there, so the speed along the curve stays even inside the interval
+  // too, not just at the samples
+  const double t2 = t * t;
+  const double t3 = t2 * t;
+  const double u = (2.0 * t3 - 3.0 * t2 + 1.0) * u0 +
+                   (t3 - 2.0 * t2 + t) * span * mSampleSlopeStart[p] +
+                   (-2.0 * t3 + 3.0 * t2) * u1 +
+                   (t3 - t2) * span * mSampleSlopeEnd[p];
+  return std::min(u1, std::max(u0, u));
+}
+
+const CameraSpline::Segment &CameraSpline::segmentAt(double param,
+                                                     double &u) const {
+  const size_t index =
+      std::min(static_cast<size_t>(std::max(param, 0.0)),
+               mSegments.size() - 1);
+  u = std::min(1.0, std::max(0.0, param - index));
+  return mSegments[index];
+}
+
+CameraSpline::Pose CameraSpline::poseAtDistance(double s) const {
+  Pose pose;
+  if (!isValid())
+    return pose;
+
+  double u = 0.0;
+  const Segment &seg = segmentAt(paramAtDistance(s), u);
+
+  pose.x = seg.x.at(u);
+  pose.y = seg.y.at(u);
+  pose.z = seg.z.at(u);
+  pose.groundZ = seg.groundZ.at(u);
+  pose.pitch = seg.pitch0 + (seg.pitch1 - seg.pitch0) * u;
+  pose.roll = seg.roll0 + (seg.roll1 - seg.roll0) * u;
+
+  double dx = seg.x.slope(u);
+  double dy = seg.y.slope(u);
+  if (std::hypot(dx, dy) < 1e-12) {
+    // Cusp; fall back to the segment chord
+    dx = seg.x.at(1.0) - seg.x.d;
+    dy = seg.y.at(1.0) - seg.y.d;
+  }
+  pose.yaw = headingDegrees(dx, dy);
+  return pose;
+}
+
+void CameraSpline::positionAtDistance(double s, double &x, double &y,
+                                      double &groundZ) const {
+  x = y = groundZ = 0.0;
+  if (!isValid())
+    return;
+
+  double u = 0.0;
+  const Segment &seg = segmentAt(paramAtDistance(s), u);
+  x = seg.x.at(u);
+  y = seg.y.at(u);
+  groundZ = seg.groundZ.at(u);
+
+  const double overshoot = s < 0.0 ? s : std::max(0.0, s - mLength);
+  if (overshoot == 0.0)
+    return;
+
+  const double dx = seg.x.slope(u);
+  const double dy = seg.y.slope(u);
+  const double norm = std::hypot(dx, dy);
+  if (norm > 1e-12) {
+    x += dx / norm * overshoot;
+    y += dy / norm * overshoot;
+  }
+}
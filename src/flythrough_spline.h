@@ -0,0 +1,88 @@
+#ifndef FLYTHROUGH_SPLINE_H
+#define FLYTHROUGH_SPLINE_H
+
+#include "flythrough_keyframe.h"
+#include <vector>
+
+// Camera path through the keyframes as a centripetal Catmull-Rom spline.
+//
+// Each segment is stored as cubic coefficients. An arc-length table,
+// bucketed at uniform distance steps, maps distance along the path to the
+// spline parameter (a cubic in distance inside each table interval, from
+// the curve's speed at its ends), so a pose costs one table lookup plus one
+// cubic per channel: constant time per frame (logarithmic in the samples
+// of one bucket where keyframes crowd together), and constant ground speed
+// however unevenly the keyframes are spaced. Centripetal knots keep the
+// curve free of cusps and self-intersecting loops at tight corners.
+//
+// Arc length is measured in the XY plane of the view CRS.
+class CameraSpline {
+public:
+  struct Pose {
+    double x = 0.0, y = 0.0; // View CRS
+    double z = 0.0;          // Absolute camera altitude
+    double groundZ = 0.0;    // Terrain elevation under the camera
+    double yaw = 0.0;        // Heading of the path tangent (0-360°)
+    double pitch = 0.0;
+    double roll = 0.0;
+  };
+
+  CameraSpline() = default;
+
+  // samplesPerSegment sets the density of the arc-length table
+  void build(const std::vector<Keyframe> &keyframes,
+             int samplesPerSegment = 16);
+  void clear();
+
+  bool isValid() const { return !mSegments.empty(); }
+  double length() const { return mLength; }
+  double duration() const { return mDuration; }
+
+  // Distance along the path reached at the given time from start, moving at
+  // constant speed over the keyframes' total duration
+  double distanceAt(double time) const;
+  // Its inverse: when the camera passes distance s (clamped to the path)
+  double timeAtDistance(double s) const;
+
+  Pose poseAtDistance(double s) const;
+  Pose poseAt(double time) const { return poseAtDistance(distanceAt(time)); }
+
+  // Position only. Past either end the path continues along the end
+  // tangent, so a look-ahead target keeps moving at the end of the flight.
+  void positionAtDistance(double s, double &x, double &y,
+                          double &groundZ) const;
+
+private:
+  // value(u) = ((a * u + b) * u + c) * u + d for u in [0, 1]
+  struct Cubic {
+    double a = 0.0, b = 0.0, c = 0.0, d = 0.0;
+    double at(double u) const { return ((a * u + b) * u + c) * u + d; }
+    double slope(double u) const { return (3.0 * a * u + 2.0 * b) * u + c; }
+  };
+
+  struct Segment {
+    Cubic x, y, z, groundZ;
+    double pitch0 = 0.0, pitch1 = 0.0;
+    double roll0 = 0.0, roll1 = 0.0;
+  };
+
+  std::vector<Segment> mSegments;
+
+  // Arc-length table: distance and spline parameter (segment index + local
+  // u) at each sample, du/ds at the start and end of each sample interval,
+  // and the first sample interval of each mStep bucket
+  std::vector<double> mSampleDistance;
+  std::vector<double> mSampleParam;
+  std::vector<double> mSampleSlopeStart;
+  std::vector<double> mSampleSlopeEnd;
+  std::vector<unsigned> mBucketStart;
+  double mStep = 0.0;
+  double mLength = 0.0;
+  double mStartTime = 0.0;
+  double mDuration = 0.0;
+
+  double paramAtDistance(double s) const;
+  const Segment &segmentAt(double param, double &u) const;
+};
+
+#endif // FLYTHROUGH_SPLINE_H
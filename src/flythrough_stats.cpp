@@ -0,0 +1,222 @@
+#include "flythrough_stats.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <limits>
+#include <utility>
+
+namespace {
+
+// Microseconds: sub-frame detail at the low end, then whole frames at
+// 30-60 fps, then stalls
+std::vector<double> durationBounds() {
+  return {50,    100,   250,    500,    1000,   2000,   4000,  8000,
+          16000, 33000, 66000, 133000, 250000, 500000, 1000000};
+}
+
+std::vector<double> dropBounds() { return {0, 1, 2, 3, 4, 8, 16, 32}; }
+
+double toMicros(FrameStats::Clock::duration duration) {
+  return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+// printf onto the end of out. Declared as printf-like so the compiler
+// checks every call's arguments against its literal format.
+#if defined(__GNUC__)
+__attribute__((format(printf, 2, 3)))
+#endif
+void appendf(std::string &out, const char *format, ...) {
+  char line[160];
+  va_list args;
+  va_start(args, format);
+  const int length = std::vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  if (length < 0)
+    return;
+  if (static_cast<size_t>(length) < sizeof(line)) {
+    out += line;
+    return;
+  }
+  // Longer than the line buffer: format again straight into out
+  const size_t start = out.size();
+  out.resize(start + length + 1);
+  va_start(args, format);
+  std::vsnprintf(&out[start], length + 1, format, args);
+  va_end(args);
+  out.resize(start + length);
+}
+
+void appendHistogramJson(std::string &out, const char *name,
+                         const Histogram &histogram) {
+  out += "    \"";
+  out += name;
+  out += "\": {";
+  appendf(out, "\"count\": %llu, \"mean\": %.3f, \"max\": %.3f, ",
+          static_cast<unsigned long long>(histogram.count()),
+          histogram.mean(), histogram.max());
+  appendf(out, "\"p50\": %g, \"p95\": %g, \"p99\": %g, \"buckets\": [",
+          histogram.quantile(0.5), histogram.quantile(0.95),
+          histogram.quantile(0.99));
+  for (int i = 0; i < histogram.bucketCount(); ++i) {
+    const double bound = histogram.upperBound(i);
+    if (i > 0)
+      out += ", ";
+    if (std::isinf(bound)) {
+      appendf(out, "{\"le\": null, \"count\": %llu}",
+              static_cast<unsigned long long>(histogram.bucket(i)));
+    } else {
+      appendf(out, "{\"le\": %g, \"count\": %llu}", bound,
+              static_cast<unsigned long long>(histogram.bucket(i)));
+    }
+  }
+  out += "]}";
+}
+
+} // namespace
+
+// --- Histogram ---
+
+Histogram::Histogram(std::vector<double> upperBounds)
+    : mBounds(std::move(upperBounds)), mCounts(mBounds.size() + 1, 0) {}
+
+void Histogram::add(double value) {
+  size_t index = 0;
+  while (index < mBounds.size() && value > mBounds[index])
+    ++index;
+  ++mCounts[index];
+  ++mCount;
+  mSum += value;
+  mMax = mCount == 1 ? value : std::max(mMax, value);
+}
+
+void Histogram::clear() {
+  std::fill(mCounts.begin(), mCounts.end(), 0);
+  mCount = 0;
+  mSum = 0.0;
+  mMax = 0.0;
+}
+
+double Histogram::upperBound(int index) const {
+  return index < static_cast<int>(mBounds.size())
+             ? mBounds[index]
+             : std::numeric_limits<double>::infinity();
+}
+
+double Histogram::quantile(double q) const {
+  if (mCount == 0)
+    return 0.0;
+  const double target = q * mCount;
+  std::uint64_t seen = 0;
+  for (int i = 0; i < bucketCount(); ++i) {
+    seen += mCounts[i];
+    if (seen >= target && mCounts[i] > 0)
+      return i < static_cast<int>(mBounds.size()) ? std::min(mBounds[i], mMax)
+                                                  : mMax;
+  }
+  return mMax;
+}
+
+// --- FrameStats ---
+
+FrameStats::FrameStats()
+    : mPhases{{Histogram(durationBounds()), Histogram(durationBounds()),
+               Histogram(durationBounds())}},
+      mFrameTime(durationBounds()), mLateness(durationBounds()),
+      mDroppedPerTick(dropBounds()) {
+  static_assert(PhaseCount == 3, "one histogram per phase");
+}
+
+void FrameStats::reset(double intervalSeconds) {
+  mIntervalMicros = intervalSeconds * 1e6;
+  mInFrame = false;
+  mHasPreviousTick = false;
+  for (Histogram &histogram : mPhases)
+    histogram.clear();
+  mFrameTime.clear();
+  mLateness.clear();
+  mDroppedPerTick.clear();
+  mDropped = 0;
+}
+
+void FrameStats::beginFrame(Clock::time_point now) {
+  if (mHasPreviousTick) {
+    const double late = toMicros(now - mPreviousTick) - mIntervalMicros;
+    mLateness.add(std::max(0.0, late));
+  }
+  mPreviousTick = now;
+  mHasPreviousTick = true;
+  mFrameStart = now;
+  mCurrent.fill(0.0);
+  mInFrame = true;
+}
+
+void FrameStats::addPhase(Phase phase, Clock::duration duration) {
+  if (mInFrame)
+    mCurrent[phase] += toMicros(duration);
+}
+
+void FrameStats::endFrame(std::int64_t droppedBefore, Clock::time_point now) {
+  if (!mInFrame)
+    return;
+  mInFrame = false;
+  for (int p = 0; p < PhaseCount; ++p)
+    mPhases[p].add(mCurrent[p]);
+  mFrameTime.add(toMicros(now - mFrameStart));
+  mDroppedPerTick.add(static_cast<double>(droppedBefore));
+  if (droppedBefore > 0)
+    mDropped += static_cast<std::uint64_t>(droppedBefore);
+}
+
+const char *FrameStats::phaseName(Phase phase) {
+  switch (phase) {
+  case Pose:
+    return "pose";
+  case Dispatch:
+    return "dispatch";
+  case Events:
+    return "events";
+  case PhaseCount:
+    break;
+  }
+  return "";
+}
+
+std::string FrameStats::summary() const {
+  std::string out;
+  appendf(out, "%llu frames, %llu dropped, interval %.0f us\n",
+          static_cast<unsigned long long>(frames()),
+          static_cast<unsigned long long>(mDropped), mIntervalMicros);
+  out += "phase        mean us    p50 us    p95 us    max us\n";
+
+  auto row = [&out](const char *name, const Histogram &histogram) {
+    appendf(out, "%-10s%10.1f%10.1f%10.1f%10.0f\n", name, histogram.mean(),
+            histogram.quantile(0.5), histogram.quantile(0.95),
+            histogram.max());
+  };
+  for (int p = 0; p < PhaseCount; ++p)
+    row(phaseName(static_cast<Phase>(p)), mPhases[p]);
+  row("frame", mFrameTime);
+  row("lateness", mLateness);
+  return out;
+}
+
+std::string FrameStats::toJson() const {
+  std::string out = "{\n";
+  appendf(out, "  \"frames\": %llu,\n  \"dropped\": %llu,\n",
+          static_cast<unsigned long long>(frames()),
+          static_cast<unsigned long long>(mDropped));
+  appendf(out, "  \"interval_us\": %.0f,\n", mIntervalMicros);
+  out += "  \"unit\": \"us\",\n  \"phases\": {\n";
+  for (int p = 0; p < PhaseCount; ++p) {
+    appendHistogramJson(out, phaseName(static_cast<Phase>(p)), mPhases[p]);
+    out += ",\n";
+  }
+  appendHistogramJson(out, "frame", mFrameTime);
+  out += "\n  },\n  \"timer\": {\n";
+  appendHistogramJson(out, "lateness", mLateness);
+  out += ",\n";
+  appendHistogramJson(out, "dropped_per_tick", mDroppedPerTick);
+  out += "\n  }\n}\n";
+  return out;
+}
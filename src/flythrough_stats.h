@@ -0,0 +1,122 @@
+#ifndef FLYTHROUGH_STATS_H
+#define FLYTHROUGH_STATS_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Histogram with fixed bucket bounds, chosen at construction. Bucket i
+// counts values <= upperBounds[i] (and above the previous bound); a final
+// overflow bucket takes everything larger. Adding a value is a short
+// linear scan and never allocates.
+class Histogram {
+public:
+  explicit Histogram(std::vector<double> upperBounds);
+
+  void add(double value);
+  void clear();
+
+  std::uint64_t count() const { return mCount; }
+  double sum() const { return mSum; }
+  double mean() const { return mCount ? mSum / mCount : 0.0; }
+  double max() const { return mMax; }
+
+  // Buckets including the overflow bucket
+  int bucketCount() const { return static_cast<int>(mCounts.size()); }
+  std::uint64_t bucket(int index) const { return mCounts[index]; }
+  // Upper bound of a bucket; infinity for the overflow bucket
+  double upperBound(int index) const;
+
+  // Upper bound of the bucket holding the given quantile (0-1), capped at
+  // max(): an over-estimate by at most one bucket width
+  double quantile(double q) const;
+
+private:
+  std::vector<double> mBounds;
+  std::vector<std::uint64_t> mCounts;
+  std::uint64_t mCount = 0;
+  double mSum = 0.0;
+  double mMax = 0.0;
+};
+
+// Per-frame timing of interactive playback.
+//
+// Each animation tick is one frame: beginFrame() when the timer fires,
+// phase durations as the frame is built, endFrame() once it is done.
+// Durations go into fixed-bucket histograms in microseconds, together with
+// the timer's lateness (how long after the previous tick plus one interval
+// the tick fired) and the number of frames dropped before each tick. Only
+// std::chrono is used and recording never allocates, so the stats are
+// always on.
+class FrameStats {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  enum Phase {
+    Pose,     // Lookup in the poses baked with the flight
+    Dispatch, // Dynamic call into the camera controller
+    Events,   // Event processing (rendering) after the camera moved
+    PhaseCount
+  };
+
+  FrameStats();
+
+  // Starts a new recording for a timer firing every intervalSeconds
+  void reset(double intervalSeconds);
+
+  void beginFrame(Clock::time_point now = Clock::now());
+  // Phases outside beginFrame()/endFrame() are ignored
+  void addPhase(Phase phase, Clock::duration duration);
+  void endFrame(std::int64_t droppedBefore,
+                Clock::time_point now = Clock::now());
+  // The next frame isn't timed against the last one, e.g. after a pause
+  void restartTicks() { mHasPreviousTick = false; }
+
+  std::uint64_t frames() const { return mFrameTime.count(); }
+  std::uint64_t droppedFrames() const { return mDropped; }
+  const Histogram &phase(Phase phase) const { return mPhases[phase]; }
+  const Histogram &frameTime() const { return mFrameTime; }
+  const Histogram &lateness() const { return mLateness; }
+  const Histogram &droppedPerTick() const { return mDroppedPerTick; }
+
+  static const char *phaseName(Phase phase);
+
+  // Human-readable table: frames, drops, and mean / p50 / p95 / max per
+  // phase, for the log at the end of playback
+  std::string summary() const;
+  // The same data with every histogram bucket, for offline analysis
+  std::string toJson() const;
+
+  // Times one phase of the current frame for as long as it is in scope
+  class Scope {
+  public:
+    Scope(FrameStats &stats, Phase phase)
+        : mStats(stats), mPhase(phase), mStart(Clock::now()) {}
+    ~Scope() { mStats.addPhase(mPhase, Clock::now() - mStart); }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    FrameStats &mStats;
+    Phase mPhase;
+    Clock::time_point mStart;
+  };
+
+private:
+  double mIntervalMicros = 0.0;
+  bool mInFrame = false;
+  bool mHasPreviousTick = false;
+  Clock::time_point mFrameStart;
+  Clock::time_point mPreviousTick;
+  std::array<double, PhaseCount> mCurrent{}; // Microseconds this frame
+
+  std::array<Histogram, PhaseCount> mPhases;
+  Histogram mFrameTime;
+  Histogram mLateness;
+  Histogram mDroppedPerTick;
+  std::uint64_t mDropped = 0;
+};
+
+#endif // FLYTHROUGH_STATS_H
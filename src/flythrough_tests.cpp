@@ -0,0 +1,847 @@
+// flythrough_tests: checks on the engine's edge cases.
+//
+// Plain asserts over small hand-built inputs, no framework. Registered with
+// CTest; exits non-zero on the first failed check.
+//
+//   flythrough_tests
+
+#ifdef FLYTHROUGH_TEST_CACHE
+#include "flythrough_cache.h"
+#include <QFile>
+#include <QTemporaryDir>
+#endif
+#include "flythrough_dem.h"
+#include "flythrough_path.h"
+#include "flythrough_spline.h"
+#include "flythrough_stats.h"
+#include "flythrough_timeline.h"
+#include "flythrough_trajectory.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+namespace {
+
+int gFailures = 0;
+
+void check(bool ok, const char *what) {
+  if (!ok) {
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    ++gFailures;
+  }
+}
+
+const double kNan = std::numeric_limits<double>::quiet_NaN();
+const double kInf = std::numeric_limits<double>::infinity();
+
+// 4 x 4 cells of 10 units from (0, 40) down to (40, 0), z = col + 10 * row
+DemGrid rampGrid() {
+  DemGrid grid;
+  grid.reset(0.0, 40.0, 10.0, 10.0, 4, 4);
+  for (int row = 0; row < 4; ++row)
+    for (int col = 0; col < 4; ++col)
+      grid.data()[row * 4 + col] = static_cast<float>(col + 10 * row);
+  return grid;
+}
+
+// Transform failures arrive as NaN, far-off points as infinities: both are
+// outside the window and give the fallback
+void testDemNonFinite() {
+  const DemGrid grid = rampGrid();
+  const double fallback = -1.0;
+  const double xs[] = {kNan, 15.0, kInf, -kInf, 15.0, 15.0, kNan, 15.0};
+  const double ys[] = {15.0, kNan, 15.0, 15.0, kInf, -kInf, kNan, 15.0};
+  const size_t count = sizeof(xs) / sizeof(xs[0]);
+
+  double zs[count];
+  grid.sampleElevations(xs, ys, zs, count, fallback);
+  for (size_t i = 0; i + 1 < count; ++i)
+    check(zs[i] == fallback, "sampleElevations: non-finite point");
+  check(std::fabs(zs[count - 1] - 21.0) < 1e-9,
+        "sampleElevations: finite point next to non-finite ones");
+
+  for (size_t i = 0; i + 1 < count; ++i)
+    check(grid.sample(xs[i], ys[i], fallback) == fallback,
+          "sample: non-finite point");
+}
+
+// Against every cell of an odd-sized grid with nodata holes: the highest
+// cell centre within radius of the segment, and pathMax() as the highest
+// over its segments
+void testDemPyramid() {
+  std::uint32_t state = 777;
+  const auto random = [&state]() {
+    state = state * 1664525u + 1013904223u;
+    return (state >> 8) / 16777216.0;
+  };
+
+  DemGrid grid;
+  const int width = 37, height = 23;
+  grid.reset(100.0, 500.0, 10.0, 8.0, width, height);
+  for (int i = 0; i < width * height; ++i)
+    grid.data()[i] = random() < 0.15
+                         ? std::numeric_limits<float>::quiet_NaN()
+                         : static_cast<float>(random() * 1000.0);
+  DemPyramid pyramid;
+  pyramid.build(grid);
+
+  const auto bruteForce = [&](double x0, double y0, double x1, double y1,
+                              double radius) {
+    double best = -kInf;
+    for (int row = 0; row < height; ++row) {
+      for (int col = 0; col < width; ++col) {
+        const float z = grid.cell(col, row);
+        const double px = grid.xMin() + (col + 0.5) * grid.cellSizeX() - x0;
+        const double py = grid.yMax() - (row + 0.5) * grid.cellSizeY() - y0;
+        const double dx = x1 - x0, dy = y1 - y0;
+        const double len2 = dx * dx + dy * dy;
+        double t = len2 > 0.0 ? (px * dx + py * dy) / len2 : 0.0;
+        t = std::min(std::max(t, 0.0), 1.0);
+        const double ex = px - t * dx, ey = py - t * dy;
+        if (!std::isnan(z) && ex * ex + ey * ey <= radius * radius)
+          best = std::max(best, static_cast<double>(z));
+      }
+    }
+    return best;
+  };
+
+  for (int run = 0; run < 200; ++run) {
+    // Some segments run partly or wholly outside the grid
+    const size_t count = 1 + static_cast<size_t>(random() * 5);
+    std::vector<double> xs(count), ys(count);
+    for (size_t i = 0; i < count; ++i) {
+      xs[i] = 50.0 + random() * 470.0;
+      ys[i] = 280.0 + random() * 270.0;
+    }
+    const double radius = random() * 30.0;
+
+    double expected = -kInf;
+    for (size_t i = 0; i + 1 < count; ++i) {
+      const double segment =
+          bruteForce(xs[i], ys[i], xs[i + 1], ys[i + 1], radius);
+      check(pyramid.segmentMax(xs[i], ys[i], xs[i + 1], ys[i + 1], radius,
+                               -kInf) == segment,
+            "DemPyramid::segmentMax: matches brute force");
+      expected = std::max(expected, segment);
+    }
+    if (count == 1)
+      expected = bruteForce(xs[0], ys[0], xs[0], ys[0], radius);
+    const double peak = pyramid.pathMax(xs.data(), ys.data(), count, radius);
+    check(expected == -kInf ? std::isnan(peak) : peak == expected,
+          "DemPyramid::pathMax: matches brute force");
+  }
+}
+
+// Against the O(n * window) definition, over random values with NaN gaps
+// and uneven spacing
+void testSlidingWindowMax() {
+  std::uint32_t state = 12345;
+  const auto random = [&state]() {
+    state = state * 1664525u + 1013904223u;
+    return (state >> 8) / 16777216.0;
+  };
+
+  for (int run = 0; run < 50; ++run) {
+    const size_t count = 1 + static_cast<size_t>(random() * 200);
+    std::vector<double> values(count), distances(count);
+    double distance = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+      distance += random() * 10.0;
+      distances[i] = distance;
+      values[i] = random() < 0.1 ? kNan : random() * 100.0;
+    }
+    const double window = random() * 50.0;
+
+    std::vector<double> out(count);
+    slidingWindowMax(values.data(), distances.data(), count, window,
+                     out.data());
+    for (size_t i = 0; i < count; ++i) {
+      double expected = kNan;
+      for (size_t j = 0; j < count; ++j) {
+        if (std::fabs(distances[j] - distances[i]) <= window &&
+            !std::isnan(values[j]))
+          expected = std::isnan(expected) ? values[j]
+                                          : std::max(expected, values[j]);
+      }
+      const bool same = std::isnan(expected) ? std::isnan(out[i])
+                                             : out[i] == expected;
+      check(same, "slidingWindowMax: matches brute force");
+    }
+  }
+}
+
+// A height step splits the segment around it down to minSpacing; with no
+// usable minSpacing the bisection must still stop
+void testAdaptiveMinSpacing() {
+  const std::vector<double> xs = {0.0, 100.0, 100.0};
+  const std::vector<double> ys = {0.0, 0.0, 100.0};
+  const HeightFunction step = [](double x, double y) {
+    return x < 50.3 && y < 50.3 ? 0.0 : 100.0;
+  };
+
+  for (double minSpacing : {1.0, 0.0, -1.0, kNan}) {
+    AdaptiveSampling sampling;
+    sampling.minSpacing = minSpacing;
+    sampling.lateralTolerance = 0.0;
+    std::vector<double> outXs, outYs;
+    const size_t samples =
+        densifyPathAdaptive(xs, ys, step, sampling, outXs, outYs);
+    check(outXs.size() == outYs.size() && outXs.size() >= xs.size(),
+          "densifyPathAdaptive: keeps the input vertices");
+    check(outXs.front() == xs.front() && outXs.back() == xs.back() &&
+              outYs.back() == ys.back(),
+          "densifyPathAdaptive: keeps the end points");
+    check(samples < 1000, "densifyPathAdaptive: bounded with bad minSpacing");
+  }
+}
+
+// Keyframes 1 s apart along an arc then a straight, unevenly spaced
+std::vector<Keyframe> unevenKeyframes() {
+  std::vector<Keyframe> keyframes;
+  const double angles[] = {0.0, 0.05, 0.1, 0.4, 0.45, 1.2, 1.5};
+  for (double angle : angles) {
+    Keyframe kf;
+    kf.x = 300.0 * std::sin(angle);
+    kf.y = 300.0 - 300.0 * std::cos(angle);
+    keyframes.push_back(kf);
+  }
+  for (double step : {5.0, 400.0, 410.0}) {
+    Keyframe kf = keyframes.back();
+    kf.x = 300.0 + step * std::cos(1.5);
+    kf.y = 300.0 + step * std::sin(1.5);
+    keyframes.push_back(kf);
+  }
+  for (size_t i = 0; i < keyframes.size(); ++i) {
+    keyframes[i].time = static_cast<double>(i);
+    keyframes[i].z = 100.0 + 10.0 * i;
+    keyframes[i].ground_z = 5.0 * i;
+  }
+  return keyframes;
+}
+
+// Equal steps of distance are equal steps along the curve, however unevenly
+// the keyframes are spaced, and the curve passes through the keyframes
+void testSplineArcLength() {
+  const std::vector<Keyframe> keyframes = unevenKeyframes();
+  CameraSpline spline;
+  spline.build(keyframes);
+  check(spline.isValid() && spline.duration() == keyframes.size() - 1.0,
+        "CameraSpline: built");
+
+  double chords = 0.0;
+  for (size_t i = 1; i < keyframes.size(); ++i)
+    chords += std::hypot(keyframes[i].x - keyframes[i - 1].x,
+                         keyframes[i].y - keyframes[i - 1].y);
+  check(spline.length() >= chords && spline.length() < 1.01 * chords,
+        "CameraSpline: length just over the chords");
+
+  const int steps = 4000;
+  const double step = spline.length() / steps;
+  CameraSpline::Pose previous = spline.poseAtDistance(0.0);
+  check(std::hypot(previous.x - keyframes.front().x,
+                   previous.y - keyframes.front().y) < 1e-9,
+        "CameraSpline: starts at the first keyframe");
+  double worst = 0.0;
+  for (int i = 1; i <= steps; ++i) {
+    const CameraSpline::Pose pose = spline.poseAtDistance(i * step);
+    const double moved = std::hypot(pose.x - previous.x, pose.y - previous.y);
+    worst = std::max(worst, std::fabs(moved - step) / step);
+    previous = pose;
+  }
+  check(worst < 0.01, "CameraSpline: constant speed along the curve");
+  check(std::hypot(previous.x - keyframes.back().x,
+                   previous.y - keyframes.back().y) < 1e-6,
+        "CameraSpline: ends at the last keyframe");
+}
+
+// A GPS stop: thousands of keyframes within 2 cm of a straight 2 km route
+// crowd one table bucket. Along a straight line the position is the
+// distance itself, inside the cluster too.
+void testSplineCluster() {
+  std::vector<Keyframe> keyframes;
+  const auto add = [&keyframes](double x) {
+    Keyframe kf = {};
+    kf.x = x;
+    kf.time = static_cast<double>(keyframes.size());
+    keyframes.push_back(kf);
+  };
+  for (int i = 0; i <= 10; ++i)
+    add(100.0 * i);
+  for (int i = 1; i <= 20000; ++i)
+    add(1000.0 + 1e-6 * i);
+  for (int i = 1; i <= 10; ++i)
+    add(1000.02 + 100.0 * i);
+  CameraSpline spline;
+  spline.build(keyframes);
+
+  double worst = 0.0;
+  for (int i = 0; i <= 10000; ++i) {
+    const double along = spline.length() * i / 10000;
+    const double inside = 1000.0 + 0.02 * i / 10000;
+    worst = std::max({worst, std::fabs(spline.poseAtDistance(along).x - along),
+                      std::fabs(spline.poseAtDistance(inside).x - inside)});
+  }
+  check(std::fabs(spline.length() - 2000.02) < 1e-6 && worst < 1e-6,
+        "CameraSpline: lookup inside a crowded bucket");
+}
+
+// Time and distance through the spline both ways, and a seek by distance
+// against where the camera actually is
+void testPlaybackTimeline() {
+  CameraSpline spline;
+  spline.build(unevenKeyframes());
+  PlaybackTimeline timeline;
+  check(!timeline.isValid(), "PlaybackTimeline: invalid before reset");
+  timeline.reset(spline);
+  check(timeline.isValid() && timeline.duration() == spline.duration() &&
+            timeline.length() == spline.length(),
+        "PlaybackTimeline: spans the spline");
+
+  // Round trip both ways, and time never falls as distance grows
+  const int steps = 1000;
+  double previous = -1.0;
+  double worstDistance = 0.0;
+  double worstTime = 0.0;
+  bool monotonic = true;
+  for (int i = 0; i <= steps; ++i) {
+    const double distance = spline.length() * i / steps;
+    const double time = timeline.timeAtDistance(distance);
+    monotonic = monotonic && time >= previous;
+    previous = time;
+    const double back = timeline.distanceAt(time);
+    worstDistance = std::max(worstDistance, std::fabs(back - distance));
+
+    const double t = spline.duration() * i / steps;
+    const double there = timeline.timeAtDistance(timeline.distanceAt(t));
+    worstTime = std::max(worstTime, std::fabs(there - t));
+  }
+  check(monotonic, "PlaybackTimeline: time rises with distance");
+  check(worstDistance < 1e-9 * spline.length(),
+        "PlaybackTimeline: distance round trip");
+  check(worstTime < 1e-9 * spline.duration(),
+        "PlaybackTimeline: time round trip");
+  check(timeline.timeAtDistance(-1.0) == 0.0 &&
+            timeline.timeAtDistance(2.0 * spline.length()) ==
+                spline.duration(),
+        "PlaybackTimeline: distances clamp to the flight");
+
+  // A seek by distance puts the camera at that distance along the curve
+  timeline.seekDistance(0.3 * spline.length());
+  const CameraSpline::Pose seeked = spline.poseAt(timeline.time());
+  const CameraSpline::Pose expected =
+      spline.poseAtDistance(0.3 * spline.length());
+  check(std::hypot(seeked.x - expected.x, seeked.y - expected.y) <
+            1e-9 * spline.length(),
+        "PlaybackTimeline: seek lands the camera");
+  check(std::fabs(timeline.distance() - 0.3 * spline.length()) <
+            1e-9 * spline.length(),
+        "PlaybackTimeline: distance after seek");
+}
+
+// A route below sea level whose look-at points cross a nodata hole: the
+// hole must bake like terrain at the spline's ground, not like height 0
+void testBakeNodata() {
+  const double ground = -40.0;
+  std::vector<Keyframe> keyframes;
+  for (int i = 0; i <= 10; ++i) {
+    Keyframe kf = {};
+    kf.time = i;
+    kf.x = 100.0 * i;
+    kf.y = 50.0;
+    kf.z = ground + 20.0;
+    kf.ground_z = ground;
+    kf.yaw = 90.0;
+    kf.pitch = -20.0;
+    keyframes.push_back(kf);
+  }
+  CameraSpline spline;
+  spline.build(keyframes);
+
+  // 10-unit cells from x = -100 to 1300, nodata for 400 <= x < 700
+  DemGrid grid;
+  grid.reset(-100.0, 100.0, 10.0, 10.0, 140, 10);
+  for (int row = 0; row < grid.height(); ++row)
+    for (int col = 0; col < grid.width(); ++col) {
+      const double x = grid.xMin() + (col + 0.5) * grid.cellSizeX();
+      grid.data()[row * grid.width() + col] =
+          x >= 400.0 && x < 700.0 ? std::numeric_limits<float>::quiet_NaN()
+                                  : static_cast<float>(ground);
+    }
+
+  size_t holes = 0;
+  const TerrainBatchSampler withHole = [&](const double *xs, const double *ys,
+                                           double *zs, size_t count) {
+    grid.sampleElevations(xs, ys, zs, count, kNan);
+    for (size_t i = 0; i < count; ++i)
+      holes += std::isnan(zs[i]) ? 1 : 0;
+  };
+  const TerrainBatchSampler solid = [&](const double *, const double *,
+                                        double *zs, size_t count) {
+    std::fill(zs, zs + count, ground);
+  };
+
+  BakedPoses baked, reference;
+  bakePoses(spline, 10.0, 20.0, 200.0, withHole, baked);
+  bakePoses(spline, 10.0, 20.0, 200.0, solid, reference);
+  check(holes > 0 && baked.size() == reference.size(),
+        "bakePoses: route crosses the hole");
+
+  double worst = 0.0;
+  for (size_t i = 0; i < baked.size(); ++i) {
+    const OrbitView a = baked.frame(i);
+    const OrbitView b = reference.frame(i);
+    worst = std::max({worst, std::fabs(a.lookX - b.lookX),
+                      std::fabs(a.lookY - b.lookY),
+                      std::fabs(a.lookZ - b.lookZ),
+                      std::fabs(a.distance - b.distance),
+                      std::fabs(a.pitch - b.pitch),
+                      std::fabs(a.cameraZ - b.cameraZ)});
+  }
+  check(worst < 1e-9, "bakePoses: nodata falls back to the spline ground");
+}
+
+// Bucket counts and quantiles against sorting the values, with values on
+// the bounds and past the last one
+void testHistogram() {
+  std::uint32_t state = 4242;
+  const auto random = [&state]() {
+    state = state * 1664525u + 1013904223u;
+    return (state >> 8) / 16777216.0;
+  };
+  const std::vector<double> bounds = {1.0, 2.0, 5.0, 10.0, 50.0};
+  Histogram histogram(bounds);
+  check(histogram.bucketCount() == 6 && std::isinf(histogram.upperBound(5)),
+        "Histogram: overflow bucket");
+
+  for (int run = 0; run < 20; ++run) {
+    histogram.clear();
+    std::vector<double> values;
+    const int count = 1 + static_cast<int>(random() * 300);
+    for (int i = 0; i < count; ++i) {
+      const double value = random() < 0.2
+                               ? bounds[static_cast<size_t>(random() * 5)]
+                               : random() * 80.0;
+      values.push_back(value);
+      histogram.add(value);
+    }
+
+    bool counts = histogram.count() == values.size();
+    std::uint64_t total = 0;
+    for (int b = 0; b < histogram.bucketCount(); ++b) {
+      const double low = b == 0 ? -kInf : histogram.upperBound(b - 1);
+      const double high = histogram.upperBound(b);
+      const auto inBucket = std::count_if(
+          values.begin(), values.end(),
+          [&](double v) { return v > low && v <= high; });
+      counts = counts && histogram.bucket(b) ==
+                             static_cast<std::uint64_t>(inBucket);
+      total += histogram.bucket(b);
+    }
+    check(counts && total == values.size(), "Histogram: bucket counts");
+
+    std::sort(values.begin(), values.end());
+    check(histogram.max() == values.back(), "Histogram: max");
+    double sum = 0.0;
+    for (double v : values)
+      sum += v;
+    check(std::fabs(histogram.mean() - sum / count) < 1e-9,
+          "Histogram: mean");
+
+    for (double q : {0.0, 0.5, 0.95, 0.99, 1.0}) {
+      const size_t rank = std::max<size_t>(
+          1, static_cast<size_t>(std::ceil(q * count)));
+      const double value = values[rank - 1];
+      double bound = kInf;
+      for (double b : bounds) {
+        if (value <= b) {
+          bound = b;
+          break;
+        }
+      }
+      check(histogram.quantile(q) == std::min(bound, values.back()),
+            "Histogram: quantile is the bound of its bucket");
+    }
+  }
+}
+
+// Uneven random walk with bends and back-tracking; spacing from 0.1 to 20
+void makeWigglyPath(std::uint32_t seed, size_t count, std::vector<double> &xs,
+                    std::vector<double> &ys) {
+  std::uint32_t state = seed;
+  const auto random = [&state]() {
+    state = state * 1664525u + 1013904223u;
+    return (state >> 8) / 16777216.0;
+  };
+  xs.assign(1, 0.0);
+  ys.assign(1, 0.0);
+  double heading = 0.0;
+  for (size_t i = 1; i < count; ++i) {
+    heading += (random() - 0.5) * 1.5;
+    const double step = random() < 0.2 ? 20.0 * random() : 0.1 + random();
+    xs.push_back(xs.back() + step * std::cos(heading));
+    ys.push_back(ys.back() + step * std::sin(heading));
+  }
+}
+
+double polylineDistance(double x, double y, const std::vector<double> &xs,
+                        const std::vector<double> &ys) {
+  double best = kInf;
+  for (size_t i = 1; i < xs.size(); ++i) {
+    const double dx = xs[i] - xs[i - 1], dy = ys[i] - ys[i - 1];
+    const double lengthSq = dx * dx + dy * dy;
+    double t = lengthSq > 0.0
+                   ? ((x - xs[i - 1]) * dx + (y - ys[i - 1]) * dy) / lengthSq
+                   : 0.0;
+    t = std::min(1.0, std::max(0.0, t));
+    best = std::min(best, std::hypot(x - (xs[i - 1] + t * dx),
+                                     y - (ys[i - 1] + t * dy)));
+  }
+  return best;
+}
+
+// Every original vertex, and so every original segment, stays within the
+// tolerance of the simplified path
+void testSimplifyPath() {
+  for (std::uint32_t seed = 1; seed <= 20; ++seed) {
+    std::vector<double> xs, ys;
+    makeWigglyPath(seed, 400, xs, ys);
+    for (double tolerance : {0.5, 2.0, 10.0}) {
+      std::vector<double> simpleXs = xs, simpleYs = ys;
+      const size_t count = simplifyPath(simpleXs, simpleYs, tolerance);
+      check(count == simpleXs.size() && count == simpleYs.size() &&
+                count < xs.size(),
+            "simplifyPath: drops vertices");
+      check(simpleXs.front() == xs.front() && simpleYs.back() == ys.back(),
+            "simplifyPath: keeps the end points");
+      // Each original vertex against the segment that replaced it; the
+      // kept vertices are copied, so they are found by equality
+      double deviation = 0.0;
+      size_t segment = 0;
+      for (size_t i = 0; i < xs.size(); ++i) {
+        const std::vector<double> segXs(simpleXs.begin() + segment,
+                                        simpleXs.begin() + segment + 2);
+        const std::vector<double> segYs(simpleYs.begin() + segment,
+                                        simpleYs.begin() + segment + 2);
+        deviation =
+            std::max(deviation, polylineDistance(xs[i], ys[i], segXs, segYs));
+        if (xs[i] == simpleXs[segment + 1] && ys[i] == simpleYs[segment + 1] &&
+            segment + 2 < count)
+          ++segment;
+      }
+      check(segment + 2 == count, "simplifyPath: keeps vertices in order");
+      check(deviation <= tolerance * (1.0 + 1e-12),
+            "simplifyPath: deviation within the tolerance");
+    }
+  }
+
+  // A dense straight line keeps only its ends
+  std::vector<double> xs, ys;
+  for (int i = 0; i <= 100; ++i) {
+    xs.push_back(i * 0.5);
+    ys.push_back(i * 0.25);
+  }
+  check(simplifyPath(xs, ys, 0.01) == 2, "simplifyPath: straight line");
+}
+
+// A straight line stays on its line with its ends fixed, and a right-angle
+// corner is cut by sigma / sqrt(pi), the Gaussian's, whether the vertices
+// are 1 unit apart or a few far-apart ones
+void testSmoothPath() {
+  const double sigma = 20.0;
+  const double expectedCut = sigma / std::sqrt(3.14159265358979323846);
+  std::vector<double> scratch;
+
+  // Distances along each path, evenly or unevenly spaced
+  std::vector<double> even;
+  for (int i = 0; i <= 1000; ++i)
+    even.push_back(i);
+  const std::vector<double> uneven = {0.0, 3.0, 160.0, 463.0, 499.5,
+                                      500.0, 501.0, 910.0, 1000.0};
+
+  const std::vector<double> *layouts[] = {&even, &uneven};
+  for (const std::vector<double> *stations : layouts) {
+    // Along y = x / 2
+    std::vector<double> xs, ys;
+    for (double s : *stations) {
+      xs.push_back(s - 500.0);
+      ys.push_back(0.5 * (s - 500.0));
+    }
+    smoothPath(xs, ys, sigma, scratch);
+    bool straight = xs.size() == ys.size() && xs.size() > 2;
+    for (size_t i = 0; i < xs.size(); ++i)
+      straight = straight && std::fabs(ys[i] - 0.5 * xs[i]) < 1e-9;
+    check(straight, "smoothPath: straight line stays straight");
+    check(xs.front() == -500.0 && xs.back() == 500.0,
+          "smoothPath: keeps the end points");
+
+    // In along -x to the origin, out along +y
+    xs.clear();
+    ys.clear();
+    for (double s : *stations) {
+      xs.push_back(std::min(s - 500.0, 0.0));
+      ys.push_back(std::max(s - 500.0, 0.0));
+    }
+    smoothPath(xs, ys, sigma, scratch);
+    double cut = kInf;
+    for (size_t i = 0; i < xs.size(); ++i)
+      cut = std::min(cut, std::hypot(xs[i], ys[i]));
+    check(std::fabs(cut - expectedCut) < 0.05 * expectedCut,
+          "smoothPath: corner cut by the Gaussian's amount");
+  }
+}
+
+// A grid covering x, y in [-200, 200] at the given cell size, rolling terrain
+DemGrid hillGrid(double cell) {
+  DemGrid grid;
+  const int size = static_cast<int>(400.0 / cell);
+  grid.reset(-200.0, 200.0, cell, cell, size, size);
+  for (int row = 0; row < size; ++row)
+    for (int col = 0; col < size; ++col) {
+      const double x = grid.xMin() + (col + 0.5) * cell;
+      const double y = grid.yMax() - (row + 0.5) * cell;
+      grid.data()[row * size + col] =
+          static_cast<float>(30.0 * std::sin(x / 17.0) * std::cos(y / 23.0));
+    }
+  return grid;
+}
+
+// The Sample and Keyframes stages from the Smooth output on: resample
+// against grid, profile, keyframes. The peak is the grid's highest cell,
+// as the full-resolution corridor maximum would give.
+std::vector<Keyframe> keyframesOver(const std::vector<double> &xs,
+                                    const std::vector<double> &ys,
+                                    const DemGrid &grid,
+                                    const TrajectoryParams &params) {
+  const HeightFunction height = [&grid](double x, double y) {
+    return grid.sample(x, y, kNan);
+  };
+  AdaptiveSampling sampling;
+  sampling.minSpacing = grid.cellSizeX();
+  sampling.maxSpacing = 50.0;
+  std::vector<double> sampledXs, sampledYs;
+  densifyPathAdaptive(xs, ys, height, sampling, sampledXs, sampledYs);
+
+  const size_t count = sampledXs.size();
+  std::vector<double> distances(count, 0.0), elevations(count);
+  for (size_t i = 0; i < count; ++i) {
+    if (i > 0)
+      distances[i] = distances[i - 1] +
+                     std::hypot(sampledXs[i] - sampledXs[i - 1],
+                                sampledYs[i] - sampledYs[i - 1]);
+    elevations[i] = grid.sample(sampledXs[i], sampledYs[i]);
+  }
+  const float *cells = grid.data();
+  const double peak = *std::max_element(
+      cells, cells + static_cast<size_t>(grid.width()) * grid.height());
+  return generateKeyframes(sampledXs.data(), sampledYs.data(),
+                           distances.data(), elevations.data(), count, peak,
+                           params);
+}
+
+// The Poses stage: spline through the keyframes and views baked against grid
+void bakeOver(const std::vector<Keyframe> &keyframes, const DemGrid &grid,
+              const TrajectoryParams &params, CameraSpline &spline,
+              BakedPoses &frames) {
+  spline.build(keyframes);
+  const TerrainBatchSampler terrain = [&grid](const double *xs,
+                                              const double *ys, double *zs,
+                                              size_t count) {
+    grid.sampleElevations(xs, ys, zs, count, kNan);
+  };
+  bakePoses(spline, 30.0, params.cameraHeight, 150.0, terrain, frames);
+}
+
+// A preview shares the full run's stages. After a keyframe-cache hit it
+// rebuilds only the Poses stage from the stored keyframes, and it is flown
+// at its own wall-clock ticks, which fall between frames. The camera must
+// still be the full run's: positions within 1e-9 of the path length,
+// altitudes within 1e-9 of their size, and in SafePath mode always the
+// clearance above the full-resolution terrain under it.
+void testPreviewFlight() {
+  std::vector<double> xs, ys, scratch;
+  makeWigglyPath(7, 300, xs, ys);
+  smoothPath(xs, ys, 4.0, scratch);
+  const DemGrid grid = hillGrid(1.0);
+
+  for (AltitudeMode mode :
+       {AltitudeMode::SafePath, AltitudeMode::TerrainFollow}) {
+    TrajectoryParams params;
+    params.altitudeMode = mode;
+    params.speed = 10.0;
+
+    const std::vector<Keyframe> keyframes = keyframesOver(xs, ys, grid, params);
+    CameraSpline fullSpline, previewSpline;
+    BakedPoses fullFrames, previewFrames;
+    bakeOver(keyframes, grid, params, fullSpline, fullFrames);
+    const std::vector<Keyframe> stored = keyframes;
+    bakeOver(stored, grid, params, previewSpline, previewFrames);
+    check(fullFrames.size() > 1 && previewFrames.size() == fullFrames.size(),
+          "preview: same frames as the full run");
+
+    const double bound = 1e-9 * fullSpline.length();
+    double worstPosition = 0.0;
+    double worstAltitude = 0.0;
+    double scale = 1.0;
+    bool clear = true;
+    for (double time = 0.0; time <= fullSpline.duration(); time += 0.37) {
+      const CameraSpline::Pose full = fullSpline.poseAt(time);
+      const CameraSpline::Pose preview = previewSpline.poseAt(time);
+      const OrbitView fullView = fullFrames.at(time);
+      const OrbitView previewView = previewFrames.at(time);
+      worstPosition = std::max(
+          {worstPosition, std::hypot(preview.x - full.x, preview.y - full.y),
+           std::hypot(previewView.lookX - fullView.lookX,
+                      previewView.lookY - fullView.lookY),
+           std::fabs(previewView.distance - fullView.distance)});
+      worstAltitude = std::max({worstAltitude, std::fabs(preview.z - full.z),
+                                std::fabs(previewView.lookZ - fullView.lookZ),
+                                std::fabs(previewView.cameraZ -
+                                          fullView.cameraZ)});
+      scale = std::max(scale, std::fabs(full.z));
+      if (mode == AltitudeMode::SafePath)
+        clear = clear && preview.z >= grid.sample(preview.x, preview.y) +
+                                          params.cameraHeight - 1e-9;
+    }
+    check(worstPosition <= bound, "preview: flies the full run's path");
+    check(worstAltitude <= 1e-9 * scale,
+          "preview: flies the full run's altitudes");
+    check(clear, "preview: clear of the full-resolution terrain");
+  }
+}
+
+#ifdef FLYTHROUGH_TEST_CACHE
+// Overwrites size bytes at offset of the file at path
+void patchFile(const QString &path, qint64 offset, const char *bytes,
+               qint64 size) {
+  QFile file(path);
+  if (file.open(QIODevice::ReadWrite) && file.seek(offset))
+    file.write(bytes, size);
+}
+
+QByteArray testKey(const char *text) {
+  CacheKeyBuilder key;
+  key.add(QString::fromLatin1(text));
+  return key.result();
+}
+
+// Keyframes come back exactly as stored, and a file with another key, a
+// bumped version, a foreign magic or a missing tail is ignored
+void testKeyframeCache() {
+  QTemporaryDir directory;
+  check(directory.isValid(), "KeyframeCache: temporary directory");
+  KeyframeCache cache(directory.path());
+
+  std::vector<Keyframe> stored = unevenKeyframes();
+  for (size_t i = 0; i < stored.size(); ++i) {
+    stored[i].yaw = 10.0 * i;
+    stored[i].pitch = 65.0 - i;
+    stored[i].roll = -0.5 * i;
+  }
+  const QByteArray key = testKey("keyframes");
+  check(cache.store(key, stored), "KeyframeCache: store");
+
+  std::vector<Keyframe> loaded;
+  bool same = cache.load(key, loaded) && loaded.size() == stored.size();
+  for (size_t i = 0; same && i < stored.size(); ++i)
+    same = loaded[i].time == stored[i].time && loaded[i].x == stored[i].x &&
+           loaded[i].y == stored[i].y && loaded[i].z == stored[i].z &&
+           loaded[i].ground_z == stored[i].ground_z &&
+           loaded[i].yaw == stored[i].yaw &&
+           loaded[i].pitch == stored[i].pitch &&
+           loaded[i].roll == stored[i].roll;
+  check(same, "KeyframeCache: round trip");
+  check(!cache.load(testKey("other"), loaded),
+        "KeyframeCache: other key misses");
+
+  // Header: magic at 0, version at 4
+  const QString path = cache.filePath(key);
+  const quint32 version = 99;
+  patchFile(path, 4, reinterpret_cast<const char *>(&version),
+            sizeof(version));
+  check(!cache.load(key, loaded), "KeyframeCache: other version rejected");
+
+  check(cache.store(key, stored), "KeyframeCache: store again");
+  patchFile(path, 0, "XXXX", 4);
+  check(!cache.load(key, loaded), "KeyframeCache: other magic rejected");
+
+  check(cache.store(key, stored), "KeyframeCache: store again");
+  QFile file(path);
+  check(file.resize(file.size() - 8) && !cache.load(key, loaded),
+        "KeyframeCache: truncated file rejected");
+}
+
+// Profiles go under the project when it is writable and come back exactly,
+// peak included; a stale version is ignored
+void testProfileCache() {
+  QTemporaryDir project, settings;
+  check(project.isValid() && settings.isValid(),
+        "ProfileCache: temporary directories");
+  ProfileCache cache;
+  cache.setProjectHome(project.path(), settings.path());
+
+  ElevationProfile stored;
+  for (int i = 0; i < 50; ++i) {
+    stored.xs.push_back(1000.0 + i * 3.5);
+    stored.ys.push_back(2000.0 - i * 1.25);
+    stored.distances.push_back(i * 3.7);
+    stored.elevations.push_back(i % 7 == 3 ? kNan : 100.0 + i);
+  }
+  stored.peak = 412.5;
+  const QByteArray key = testKey("profile");
+  check(cache.store(key, stored), "ProfileCache: store");
+  check(cache.filePath(key).startsWith(project.path()),
+        "ProfileCache: kept with the project");
+
+  ElevationProfile loaded;
+  bool same = cache.load(key, loaded) && loaded.peak == stored.peak &&
+              loaded.xs == stored.xs && loaded.ys == stored.ys &&
+              loaded.distances == stored.distances &&
+              loaded.elevations.size() == stored.elevations.size();
+  for (size_t i = 0; same && i < stored.elevations.size(); ++i)
+    same = std::isnan(stored.elevations[i])
+               ? std::isnan(loaded.elevations[i])
+               : loaded.elevations[i] == stored.elevations[i];
+  check(same, "ProfileCache: round trip");
+
+  const quint32 version = 1;
+  patchFile(cache.filePath(key), 4, reinterpret_cast<const char *>(&version),
+            sizeof(version));
+  check(!cache.load(key, loaded), "ProfileCache: other version rejected");
+
+  // Without a project the settings directory takes them
+  cache.setProjectHome(QString(), settings.path());
+  check(cache.store(key, stored) &&
+            cache.filePath(key).startsWith(settings.path()),
+        "ProfileCache: settings directory without a project");
+}
+#endif
+
+} // namespace
+
+int main() {
+  testDemNonFinite();
+  testDemPyramid();
+  testSlidingWindowMax();
+  testAdaptiveMinSpacing();
+  testSimplifyPath();
+  testSmoothPath();
+  testPreviewFlight();
+  testSplineArcLength();
+  testSplineCluster();
+  testPlaybackTimeline();
+  testBakeNodata();
+  testHistogram();
+#ifdef FLYTHROUGH_TEST_CACHE
+  testKeyframeCache();
+  testProfileCache();
+#endif
+  if (gFailures)
+    std::fprintf(stderr, "%d check(s) failed\n", gFailures);
+  else
+    std::printf("All checks passed\n");
+  return gFailures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,52 @@
+#include "flythrough_timeline.h"
+#include "flythrough_spline.h"
+#include <algorithm>
+#include <cmath>
+
+void PlaybackTimeline::reset(const CameraSpline &spline) {
+  mSpline = &spline;
+  mDuration = spline.isValid() ? std::max(0.0, spline.duration()) : 0.0;
+  mLength = spline.isValid() ? spline.length() : 0.0;
+
+  mTime = 0.0;
+  mPaused = false;
+  mReversed = false;
+}
+
+void PlaybackTimeline::setRate(double rate) {
+  if (std::isnan(rate))
+    return;
+  mRate = std::min(kMaxRate, std::max(kMinRate, rate));
+}
+
+void PlaybackTimeline::seek(double time) {
+  if (std::isnan(time))
+    return;
+  mTime = std::min(mDuration, std::max(0.0, time));
+}
+
+void PlaybackTimeline::seekDistance(double distance) {
+  seek(timeAtDistance(distance));
+}
+
+bool PlaybackTimeline::advance(double wallSeconds) {
+  if (!mPaused && wallSeconds > 0.0) {
+    const double step = wallSeconds * mRate;
+    seek(mReversed ? mTime - step : mTime + step);
+  }
+  return !atEnd();
+}
+
+bool PlaybackTimeline::atEnd() const {
+  return mReversed ? mTime <= 0.0 : mTime >= mDuration;
+}
+
+double PlaybackTimeline::distanceAt(double time) const {
+  return isValid() ? mSpline->distanceAt(time) : 0.0;
+}
+
+double PlaybackTimeline::timeAtDistance(double distance) const {
+  if (!isValid() || std::isnan(distance))
+    return 0.0;
+  return mSpline->timeAtDistance(distance);
+}
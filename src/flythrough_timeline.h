@@ -0,0 +1,67 @@
+#ifndef FLYTHROUGH_TIMELINE_H
+#define FLYTHROUGH_TIMELINE_H
+
+#include <cstddef>
+
+class CameraSpline;
+
+// Playback position along one flight.
+//
+// Holds where playback is, in seconds from the first keyframe, whether it
+// is paused, which way it runs and how fast, and moves by wall-clock time
+// on each tick. Time and distance along the path (view CRS units) convert
+// through the flight's CameraSpline, the same arc-length mapping that moves
+// the camera, so a seek to a distance lands the camera there. Nothing is
+// regenerated: the timeline only indexes the spline it was reset with.
+class PlaybackTimeline {
+public:
+  static constexpr double kMinRate = 0.25;
+  static constexpr double kMaxRate = 8.0;
+
+  // Starts at the beginning, running forward. Rate carries over, so a
+  // sequence of flights keeps the speed it was set to. spline is not
+  // copied and must stay alive until the next reset.
+  void reset(const CameraSpline &spline);
+
+  bool isValid() const { return mDuration > 0.0; }
+  double duration() const { return mDuration; }
+  double length() const { return mLength; }
+
+  double time() const { return mTime; }
+  double distance() const { return distanceAt(mTime); }
+
+  bool isPaused() const { return mPaused; }
+  void setPaused(bool paused) { mPaused = paused; }
+  bool isReversed() const { return mReversed; }
+  void setReversed(bool reversed) { mReversed = reversed; }
+  double rate() const { return mRate; }
+  // Clamped to [kMinRate, kMaxRate]
+  void setRate(double rate);
+
+  // Both clamp to the flight
+  void seek(double time);
+  void seekDistance(double distance);
+
+  // Moves wallSeconds times the rate in the current direction, unless
+  // paused. False once playback has reached the end it runs towards.
+  bool advance(double wallSeconds);
+  // At the end playback runs towards: the last keyframe, or the first
+  // when reversed
+  bool atEnd() const;
+
+  // O(1)
+  double distanceAt(double time) const;
+  double timeAtDistance(double distance) const;
+
+private:
+  const CameraSpline *mSpline = nullptr;
+  double mDuration = 0.0;
+  double mLength = 0.0;
+
+  double mTime = 0.0;
+  double mRate = 1.0;
+  bool mPaused = false;
+  bool mReversed = false;
+};
+
+#endif // FLYTHROUGH_TIMELINE_H
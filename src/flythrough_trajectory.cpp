@@ -0,0 +1,363 @@
+#include "flythrough_trajectory.h"
+#include "flythrough_spline.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+const double kDegToRad = kPi / 180.0;
+const double kRadToDeg = 180.0 / kPi;
+
+double wrapTurn(double angle) {
+  while (angle > 180.0)
+    angle -= 360.0;
+  while (angle < -180.0)
+    angle += 360.0;
+  return angle;
+}
+
+// Look-at point lookahead in front of the camera, as an offset from it,
+// and the ground height interpolated there
+void orbitTarget(const LookAtInput &input, double lookahead, double &dx,
+                 double &dy, double &aheadGz) {
+  const double rawDx = input.targetX - input.x;
+  const double rawDy = input.targetY - input.y;
+  const double rawDist = std::sqrt(rawDx * rawDx + rawDy * rawDy);
+
+  if (rawDist > 1.0) {
+    const double scale = std::min(1.0, lookahead / rawDist);
+    dx = rawDx * scale;
+    dy = rawDy * scale;
+    aheadGz = input.groundZ + (input.targetGroundZ - input.groundZ) * scale;
+  } else {
+    // Target on top of the camera: look along the heading instead
+    const double rad = input.yaw * kDegToRad;
+    dx = lookahead * std::sin(rad);
+    dy = lookahead * std::cos(rad);
+    aheadGz = input.groundZ;
+  }
+}
+
+// The rest of the look-at geometry once the terrain at the target offset
+// (dxScaled, dyScaled) is known; sampledZ is NaN without a DEM
+OrbitView finishOrbitView(const LookAtInput &input, double cameraHeight,
+                          double dxScaled, double dyScaled, double aheadGz,
+                          double sampledZ) {
+  OrbitView view;
+  view.lookX = input.x + dxScaled;
+  view.lookY = input.y + dyScaled;
+
+  if (sampledZ > aheadGz)
+    aheadGz = sampledZ;
+
+  double camZ = input.cameraZ;
+
+  // Vertical offset from pitch
+  double horizM = std::sqrt(dxScaled * dxScaled + dyScaled * dyScaled);
+  view.lookZ = camZ + horizM * std::tan(input.pitch * kDegToRad);
+
+  // Prevent looking underground
+  if (view.lookZ < aheadGz) {
+    const double vertDiff = camZ - aheadGz;
+    if (vertDiff > 0 && std::fabs(input.pitch) > 1.0 && horizM > 0.1) {
+      const double reqHorizM =
+          vertDiff / std::tan(std::fabs(input.pitch) * kDegToRad);
+      const double scaleDown = reqHorizM / horizM;
+      if (scaleDown < 1.0) {
+        dxScaled *= scaleDown;
+        dyScaled *= scaleDown;
+        view.lookX = input.x + dxScaled;
+        view.lookY = input.y + dyScaled;
+        view.lookZ = aheadGz;
+        horizM = reqHorizM;
+      }
+    }
+  }
+
+  // Keep the camera clear of the ground
+  if (camZ < input.groundZ + 1.0)
+    camZ = input.groundZ + 10.0;
+  view.cameraZ = camZ;
+
+  const double vert = camZ - view.lookZ;
+  view.distance = std::sqrt(horizM * horizM + vert * vert);
+  if (view.distance < 1.0)
+    view.distance = cameraHeight;
+
+  const double orbPitch =
+      horizM < 0.001 ? 0.0 : std::atan2(vert, horizM) * kRadToDeg;
+  view.pitch = std::max(0.0, std::min(180.0, orbPitch));
+
+  const double bear = std::atan2(dxScaled, dyScaled) * kRadToDeg;
+  view.yaw = std::fmod(360.0 - bear, 360.0);
+  return view;
+}
+
+} // namespace
+
+double bearingDegrees(double x1, double y1, double x2, double y2) {
+  const double bearing = std::atan2(x2 - x1, y2 - y1) * kRadToDeg;
+  return std::fmod(bearing + 360.0, 360.0);
+}
+
+double lerpAngle(double a, double b, double t) {
+  const double angle = a + wrapTurn(b - a) * t;
+  return std::fmod(angle + 360.0, 360.0);
+}
+
+void slidingWindowMax(const double *values, const double *distances,
+                      size_t count, double window, double *out) {
+  assert(out != values);
+  // Indices of the window's candidates, values strictly decreasing from
+  // front to back; front is the window maximum. Every index enters and
+  // leaves once.
+  std::vector<size_t> deque(count);
+  size_t front = 0, back = 0; // deque[front, back)
+  size_t next = 0;            // Next index to enter the window
+  for (size_t i = 0; i < count; ++i) {
+    while (next < count && distances[next] <= distances[i] + window) {
+      const double value = values[next];
+      if (!std::isnan(value)) {
+        while (back > front && values[deque[back - 1]] <= value)
+          --back;
+        deque[back++] = next;
+      }
+      ++next;
+    }
+    while (back > front && distances[deque[front]] < distances[i] - window)
+      ++front;
+    out[i] = back > front ? values[deque[front]]
+                          : std::numeric_limits<double>::quiet_NaN();
+  }
+}
+
+void limitGrade(const double *distances, size_t count, double maxClimbGrade,
+                double maxDescentGrade, double *altitudes) {
+  if (count < 2)
+    return;
+  // Backwards: start climbing early enough to reach each altitude
+  if (maxClimbGrade > 0.0) {
+    for (size_t i = count - 1; i-- > 0;) {
+      const double step = distances[i + 1] - distances[i];
+      altitudes[i] =
+          std::max(altitudes[i], altitudes[i + 1] - maxClimbGrade * step);
+    }
+  }
+  // Forwards: descend no faster than allowed. Only lowers climbs, so the
+  // first pass still holds.
+  if (maxDescentGrade > 0.0) {
+    for (size_t i = 1; i < count; ++i) {
+      const double step = distances[i] - distances[i - 1];
+      altitudes[i] =
+          std::max(altitudes[i], altitudes[i - 1] - maxDescentGrade * step);
+    }
+  }
+}
+
+std::vector<Keyframe>
+generateKeyframes(const double *xs, const double *ys, const double *distances,
+                  const double *elevations, size_t count, double peak,
+                  const TrajectoryParams &params,
+                  const std::function<bool(double)> &progress) {
+  std::vector<Keyframe> keyframes;
+  if (count == 0)
+    return keyframes;
+
+  const double scale = params.verticalExaggeration;
+  const double maxElev = std::isnan(peak) ? 0.0 : peak;
+
+  // Altitude of the constant-altitude modes
+  double fixedZ = 0.0;
+  if (params.altitudeMode == AltitudeMode::SafePath)
+    fixedZ = (maxElev + params.cameraHeight) * scale;
+  else if (params.altitudeMode == AltitudeMode::FixedAmsl)
+    fixedZ = params.cameraHeight * scale;
+
+  // Terrain-following altitudes, unexaggerated until the loop below
+  std::vector<double> followZ;
+  if (params.altitudeMode == AltitudeMode::TerrainFollow) {
+    followZ.resize(count);
+    slidingWindowMax(elevations, distances, count, params.followWindow,
+                     followZ.data());
+    for (double &z : followZ)
+      z = (std::isnan(z) ? 0.0 : z) + params.cameraHeight;
+    limitGrade(distances, count, params.maxClimbGrade, params.maxDescentGrade,
+               followZ.data());
+  }
+
+  double currentTime = 0.0;
+  double previousBearing = 0.0;
+  keyframes.reserve(count);
+
+  for (size_t i = 0; i < count; ++i) {
+    if (progress && (i & 1023) == 0 &&
+        !progress(static_cast<double>(i) / count))
+      return {};
+
+    const double scaledElevation = elevations[i] * scale;
+    const bool hasNext = i + 1 < count;
+
+    double cameraZ = fixedZ;
+    if (params.altitudeMode == AltitudeMode::AboveTerrain)
+      cameraZ = scaledElevation + params.cameraHeight * scale;
+    else if (params.altitudeMode == AltitudeMode::TerrainFollow)
+      cameraZ = followZ[i] * scale;
+
+    const double yaw =
+        hasNext ? bearingDegrees(xs[i], ys[i], xs[i + 1], ys[i + 1])
+                : previousBearing;
+
+    // Bank into turns in proportion to the change of heading
+    double roll = 0.0;
+    if (params.enableBanking && i > 0 && hasNext) {
+      const double bearingIn =
+          bearingDegrees(xs[i - 1], ys[i - 1], xs[i], ys[i]);
+      const double turnAngle = wrapTurn(yaw - bearingIn);
+      roll = std::max(-45.0,
+                      std::min(45.0, -turnAngle * params.bankingFactor));
+    }
+
+    Keyframe kf;
+    kf.time = currentTime;
+    kf.x = xs[i];
+    kf.y = ys[i];
+    kf.z = cameraZ;
+    kf.ground_z = scaledElevation;
+    kf.yaw = yaw;
+    kf.pitch = params.cameraPitch;
+    kf.roll = roll;
+    keyframes.push_back(kf);
+
+    if (hasNext)
+      currentTime += (distances[i + 1] - distances[i]) / params.speed;
+    previousBearing = yaw;
+  }
+
+  return keyframes;
+}
+
+LookAtInput lookAtInputAt(const CameraSpline &spline, double time,
+                          double lookahead) {
+  const double s = spline.distanceAt(time);
+  const CameraSpline::Pose pose = spline.poseAtDistance(s);
+  LookAtInput input;
+  input.x = pose.x;
+  input.y = pose.y;
+  input.cameraZ = pose.z;
+  input.groundZ = pose.groundZ;
+  input.yaw = pose.yaw;
+  input.pitch = pose.pitch;
+  spline.positionAtDistance(s + lookahead, input.targetX, input.targetY,
+                            input.targetGroundZ);
+  return input;
+}
+
+OrbitView computeOrbitView(const LookAtInput &input, double cameraHeight,
+                           double lookahead, const TerrainSampler &terrain) {
+  double dx, dy, aheadGz;
+  orbitTarget(input, lookahead, dx, dy, aheadGz);
+  // Actual terrain at the look-at point, when the caller has a DEM
+  const double sampledZ = terrain ? terrain(input.x + dx, input.y + dy)
+                                  : std::numeric_limits<double>::quiet_NaN();
+  return finishOrbitView(input, cameraHeight, dx, dy, aheadGz, sampledZ);
+}
+
+// --- BakedPoses ---
+
+void BakedPoses::resize(size_t count) {
+  for (std::vector<double> *field :
+       {&lookX, &lookY, &lookZ, &distance, &pitch, &yaw, &cameraZ})
+    field->resize(count);
+}
+
+void BakedPoses::clear() {
+  resize(0);
+  fps = 0.0;
+}
+
+OrbitView BakedPoses::frame(size_t index) const {
+  OrbitView view;
+  view.lookX = lookX[index];
+  view.lookY = lookY[index];
+  view.lookZ = lookZ[index];
+  view.distance = distance[index];
+  view.pitch = pitch[index];
+  view.yaw = yaw[index];
+  view.cameraZ = cameraZ[index];
+  return view;
+}
+
+void BakedPoses::setFrame(size_t index, const OrbitView &view) {
+  lookX[index] = view.lookX;
+  lookY[index] = view.lookY;
+  lookZ[index] = view.lookZ;
+  distance[index] = view.distance;
+  pitch[index] = view.pitch;
+  yaw[index] = view.yaw;
+  cameraZ[index] = view.cameraZ;
+}
+
+OrbitView BakedPoses::at(double time) const {
+  if (empty())
+    return OrbitView();
+  const double position = std::max(0.0, time * fps);
+  const size_t i = static_cast<size_t>(position);
+  if (i + 1 >= size())
+    return frame(size() - 1);
+
+  const double t = position - static_cast<double>(i);
+  const auto lerp = [i, t](const std::vector<double> &field) {
+    return field[i] + (field[i + 1] - field[i]) * t;
+  };
+  OrbitView view;
+  view.lookX = lerp(lookX);
+  view.lookY = lerp(lookY);
+  view.lookZ = lerp(lookZ);
+  view.distance = lerp(distance);
+  view.pitch = lerp(pitch);
+  view.yaw = lerpAngle(yaw[i], yaw[i + 1], t);
+  view.cameraZ = lerp(cameraZ);
+  return view;
+}
+
+void bakePoses(const CameraSpline &spline, double fps, double cameraHeight,
+               double lookahead, const TerrainBatchSampler &terrain,
+               BakedPoses &out) {
+  out.clear();
+  if (!spline.isValid() || !(fps > 0.0))
+    return;
+  const double duration = spline.duration();
+  const size_t count = static_cast<size_t>(std::floor(duration * fps)) + 1;
+  out.fps = fps;
+  out.resize(count);
+
+  // Poses and look-at points before the terrain check; lookX / lookY hold
+  // the points the terrain is sampled at until the last pass
+  std::vector<LookAtInput> inputs(count);
+  std::vector<double> dxs(count), dys(count), aheadGzs(count);
+  for (size_t i = 0; i < count; ++i) {
+    const double time = std::min(duration, static_cast<double>(i) / fps);
+    inputs[i] = lookAtInputAt(spline, time, lookahead);
+    orbitTarget(inputs[i], lookahead, dxs[i], dys[i], aheadGzs[i]);
+    out.lookX[i] = inputs[i].x + dxs[i];
+    out.lookY[i] = inputs[i].y + dys[i];
+  }
+
+  std::vector<double> terrainZs(count,
+                                std::numeric_limits<double>::quiet_NaN());
+  if (terrain)
+    terrain(out.lookX.data(), out.lookY.data(), terrainZs.data(), count);
+  // Nodata and points off the DEM fall back to the spline's ground, the
+  // same as baking without a DEM
+  for (size_t i = 0; i < count; ++i) {
+    if (!std::isfinite(terrainZs[i]))
+      terrainZs[i] = aheadGzs[i];
+  }
+
+  for (size_t i = 0; i < count; ++i)
+    out.setFrame(i, finishOrbitView(inputs[i], cameraHeight, dxs[i], dys[i],
+                                    aheadGzs[i], terrainZs[i]));
+}
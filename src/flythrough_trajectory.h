@@ -0,0 +1,146 @@
+#ifndef FLYTHROUGH_TRAJECTORY_H
+#define FLYTHROUGH_TRAJECTORY_H
+
+#include "flythrough_keyframe.h"
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+class CameraSpline;
+
+// Camera trajectory math shared by the plugin and the batch tool.
+//
+// Free of Qt/QGIS types like the DEM and path modules: the path arrives as
+// x/y arrays in a projected CRS together with its elevation profile, and
+// every result is plain numbers the caller hands to the 3D view or writes
+// out.
+
+enum class AltitudeMode {
+  SafePath,      // Constant altitude above the highest terrain on the route
+  FixedAmsl,     // Constant altitude above sea level
+  AboveTerrain,  // Constant height above the terrain under the camera
+  TerrainFollow, // Height above the highest terrain around the camera, with
+                 // limited climb and descent
+};
+
+struct TrajectoryParams {
+  AltitudeMode altitudeMode = AltitudeMode::SafePath;
+  double cameraHeight = 200.0; // metres; the altitude itself in FixedAmsl
+  double cameraPitch = 65.0;   // degrees (positive = down)
+  double verticalExaggeration = 1.0;
+  double speed = 50.0; // m/s
+  bool enableBanking = true;
+  double bankingFactor = 0.5;
+
+  // TerrainFollow: cameraHeight above the highest terrain within
+  // followWindow metres behind and ahead of the camera. Altitude then
+  // changes by at most these grades (metres per metre along the path; 0 =
+  // unlimited), always by climbing earlier or descending later, never by
+  // cutting into the clearance.
+  double followWindow = 500.0;
+  double maxClimbGrade = 0.25;
+  double maxDescentGrade = 0.25;
+};
+
+// Heading from (x1, y1) to (x2, y2) in degrees clockwise from north (0-360)
+double bearingDegrees(double x1, double y1, double x2, double y2);
+
+// Shortest-way interpolation between two headings in degrees
+double lerpAngle(double a, double b, double t);
+
+// out[i] = highest of values[j] for every j with |distances[j] -
+// distances[i]| <= window. distances must be non-decreasing. NaN values are
+// ignored (out[i] is NaN if the whole window is NaN). One pass with a
+// monotonic deque: O(count) whatever the window. out must not alias values:
+// the deque reads values behind the output position.
+void slidingWindowMax(const double *values, const double *distances,
+                      size_t count, double window, double *out);
+
+// Raises altitudes in place until no step between neighbours climbs more
+// than maxClimbGrade or descends more than maxDescentGrade per unit of
+// distance. A grade <= 0 leaves that direction unlimited. O(count).
+void limitGrade(const double *distances, size_t count, double maxClimbGrade,
+                double maxDescentGrade, double *altitudes);
+
+// One keyframe per path vertex. distances are cumulative metres along the
+// path and elevations the raw DEM values at each vertex; peak is the highest
+// terrain near the route (NaN if unknown) and only matters in SafePath mode.
+// progress(fraction) is called every 1024 vertices and stops generation
+// (returning no keyframes) when it returns false.
+std::vector<Keyframe>
+generateKeyframes(const double *xs, const double *ys, const double *distances,
+                  const double *elevations, size_t count, double peak,
+                  const TrajectoryParams &params,
+                  const std::function<bool(double)> &progress = {});
+
+// Camera pose and look-ahead target for one frame, as read from the spline
+struct LookAtInput {
+  double x = 0.0, y = 0.0;
+  double cameraZ = 0.0; // Absolute camera altitude
+  double groundZ = 0.0; // Terrain under the camera
+  double yaw = 0.0;     // Used when the target is too close to give a heading
+  double pitch = 0.0;   // Keyframe pitch, degrees
+  double targetX = 0.0, targetY = 0.0, targetGroundZ = 0.0;
+};
+
+// Orbit-camera parameters in the form of QgsCameraController::setLookingAt
+struct OrbitView {
+  double lookX = 0.0, lookY = 0.0, lookZ = 0.0; // Point looked at
+  double distance = 0.0;                        // Camera to look-at point
+  double pitch = 0.0;                           // degrees, 0 = straight down
+  double yaw = 0.0;                             // degrees
+  double cameraZ = 0.0; // Camera altitude after the ground clearance check
+};
+
+// Terrain elevation at a point in the path's CRS, or NaN where unknown
+using TerrainSampler = std::function<double(double x, double y)>;
+// The same for count points at once, written to zs
+using TerrainBatchSampler = std::function<void(
+    const double *xs, const double *ys, double *zs, size_t count)>;
+
+// Pose at time along spline and the target lookahead further along the
+// same curve. The spline is flown at constant ground speed.
+LookAtInput lookAtInputAt(const CameraSpline &spline, double time,
+                          double lookahead);
+
+// Look-at geometry for one frame. The target is pulled to lookahead metres
+// in front of the camera, offset vertically along the pitch angle and kept
+// above the terrain (sampled with terrain when given, else interpolated from
+// the ground elevations), and the camera is kept clear of the ground.
+OrbitView computeOrbitView(const LookAtInput &input, double cameraHeight,
+                           double lookahead,
+                           const TerrainSampler &terrain = {});
+
+// Orbit views for every frame of a flight, worked out before playback so
+// that a frame only looks its view up. Frame i shows the flight at i / fps.
+// One array per field rather than one array of OrbitView.
+struct BakedPoses {
+  double fps = 0.0;
+  std::vector<double> lookX, lookY, lookZ;
+  std::vector<double> distance, pitch, yaw;
+  std::vector<double> cameraZ;
+
+  size_t size() const { return lookX.size(); }
+  bool empty() const { return lookX.empty(); }
+  void resize(size_t count);
+  void clear();
+
+  OrbitView frame(size_t index) const;
+  void setFrame(size_t index, const OrbitView &view);
+  // Interpolated between the frames either side of time, headings the
+  // short way round; clamped to the flight
+  OrbitView at(double time) const;
+};
+
+// computeOrbitView for every frame of the flight along spline, at fps. The
+// work is split into passes over the whole flight: spline poses and
+// look-ahead targets, one terrain call for all the targets, then the
+// look-at geometry, so each loop is free of calls back into the caller.
+// Where terrain gives NaN (nodata, off the DEM) the ground_z interpolated
+// along the spline is used instead, so a sampler must not substitute a
+// height of its own.
+void bakePoses(const CameraSpline &spline, double fps, double cameraHeight,
+               double lookahead, const TerrainBatchSampler &terrain,
+               BakedPoses &out);
+
+#endif // FLYTHROUGH_TRAJECTORY_H